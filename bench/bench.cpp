@@ -0,0 +1,353 @@
+// RISCV_Simulator_bench: microbenchmarks and guest kernels, results as JSON
+//   RISCV_Simulator_bench [--repeat N] [--filter substring] [--kernels dir] [--output file]
+//
+// Every benchmark is run --repeat times and the fastest run is reported.
+
+#include <Decoder.hpp>
+#include <assembler.hpp>
+#include <corpus.hpp>
+#include <hart.hpp>
+#include <machine.hpp>
+#include <instrumentation.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef BENCH_KERNEL_DIR
+#define BENCH_KERNEL_DIR "bench/kernels"
+#endif
+
+namespace {
+
+using namespace RISCVS;
+using Clock = std::chrono::steady_clock;
+
+using R = Assembler;
+
+template<typename T>
+void DoNotOptimize(T& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+struct Result {
+    std::string group;
+    std::string name;
+    std::string unit;       // what one operation is: "instr", "decode", "access"
+    uint64_t operations = 0;
+    double nanoseconds = 0;
+    std::optional<uint32_t> checksum;
+    std::optional<uint32_t> expected;
+};
+
+class Suite {
+public:
+    Suite(size_t repeat, std::string filter) : repeat(repeat), filter(std::move(filter)) {}
+
+    bool Selected(const std::string& group, const std::string& name) const {
+        return (group + '/' + name).find(filter) != std::string::npos;
+    }
+
+    // run() returns the number of operations it performed
+    void Run(const std::string& group, const std::string& name, const std::string& unit,
+             const std::function<uint64_t()>& run) {
+        if (!Selected(group, name)) {
+            return;
+        }
+        Result result{.group = group, .name = name, .unit = unit};
+        for (size_t i = 0; i < repeat; ++i) {
+            const auto start = Clock::now();
+            const uint64_t operations = run();
+            const double elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+            if (i == 0 || elapsed < result.nanoseconds) {
+                result.nanoseconds = elapsed;
+                result.operations = operations;
+            }
+        }
+        Report(result);
+    }
+
+    // Like Run() for guest programs: run() also stores a1 at exit, which is
+    // compared against expected
+    void RunChecked(const std::string& group, const std::string& name, uint32_t expected,
+                    const std::function<uint64_t(uint32_t&)>& run) {
+        if (!Selected(group, name)) {
+            return;
+        }
+        uint32_t checksum = 0;
+        Result result{.group = group, .name = name, .unit = "instr", .expected = expected};
+        for (size_t i = 0; i < repeat; ++i) {
+            const auto start = Clock::now();
+            const uint64_t executed = run(checksum);
+            const double elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+            if (i == 0 || elapsed < result.nanoseconds) {
+                result.nanoseconds = elapsed;
+                result.operations = executed;
+            }
+        }
+        result.checksum = checksum;
+        Report(result);
+    }
+
+    const std::vector<Result>& Results() const {
+        return results;
+    }
+
+    size_t Repeat() const {
+        return repeat;
+    }
+
+private:
+    void Report(const Result& result) {
+        std::cerr << std::left << std::setw(28) << result.group + '/' + result.name << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(10) << result.nanoseconds / result.operations
+                  << " ns/" << result.unit << '\n';
+        results.push_back(result);
+    }
+
+    size_t repeat;
+    std::string filter;
+    std::vector<Result> results;
+};
+
+// Loop of `count` copies of body around a countdown, then exit(ecall)
+std::vector<uint8_t> LoopProgram(uint32_t body, size_t count, int32_t iterations) {
+    Assembler as{Corpus::CODE_BASE};
+    auto loop = as.NewLabel();
+    as.Li(R::S0, Corpus::DATA_BASE);
+    as.Li(R::S1, iterations);
+    as.Li(R::T2, 1);
+    as.Bind(loop);
+    for (size_t i = 0; i < count; ++i) {
+        as.Emit(body);
+    }
+    as.AddI(R::S1, R::S1, -1);
+    as.Bnez(R::S1, loop);
+    as.Exit();
+    std::span<const uint8_t> image = as.Image();
+    return {image.begin(), image.end()};
+}
+
+uint64_t RunGuest(std::span<const uint8_t> image, uint32_t* checksum = nullptr) {
+    Machine machine{image, Corpus::CODE_BASE};
+    Hart hart{machine, static_cast<int32_t>(Corpus::CODE_BASE)};
+    Instrumentation::NoTrace policy;
+    const uint64_t executed = hart.Loop(policy);
+    if (checksum != nullptr) {
+        *checksum = hart[R::A1];
+    }
+    return executed;
+}
+
+uint64_t RunGuest(const GuestProgram& program, uint32_t& checksum) {
+    Machine machine{std::span<const uint8_t>{}, 0};
+    program.Load(machine);
+    Hart hart{machine, static_cast<int32_t>(program.entry)};
+    Instrumentation::NoTrace policy;
+    const uint64_t executed = hart.Loop(policy);
+    checksum = hart[R::A1];
+    return executed;
+}
+
+void DecodeBenchmarks(Suite& suite, const std::vector<uint32_t>& corpus) {
+    suite.Run("decode", "kernel_mix", "decode", [&corpus] {
+        constexpr size_t PASSES = 2000;
+        for (size_t pass = 0; pass < PASSES; ++pass) {
+            for (uint32_t word : corpus) {
+                Instruction instruction = Decoder::Decode(word);
+                DoNotOptimize(instruction);
+            }
+        }
+        return PASSES * corpus.size();
+    });
+}
+
+void DispatchBenchmarks(Suite& suite) {
+    constexpr size_t BODY = 64;
+    constexpr int32_t ITERATIONS = 16384;
+
+    const std::pair<const char*, uint32_t> classes[] = {
+        {"alu_reg", Decoder::Add.Build(R::T0, R::T1, R::T2)},
+        {"alu_imm", Decoder::AddI.Build(R::T0, R::T0, 1)},
+        {"shift", Decoder::SllI.Build(R::T0, R::T2, 3)},
+        {"upper", Decoder::Lui.Build(R::T0, 0x12345)},
+        {"load", Decoder::Lw.Build(R::T0, R::S0, 64)},
+        {"store", Decoder::Sw.Build(R::S0, R::T2, 64)},
+        {"branch_taken", Decoder::Beq.Build(R::ZERO, R::ZERO, 4)},
+        {"branch_not_taken", Decoder::Beq.Build(R::ZERO, R::T2, 4)},
+        {"jal", Decoder::Jal.Build(R::ZERO, 4)},
+    };
+
+    for (const auto& [name, body] : classes) {
+        const std::vector<uint8_t> program = LoopProgram(body, BODY, ITERATIONS);
+        suite.Run("dispatch", name, "instr", [&program] {
+            return RunGuest(program);
+        });
+    }
+}
+
+template<typename MachineFactory>
+void MemoryBenchmarks(Suite& suite, const std::string& backend, MachineFactory&& makeMachine) {
+    // Word accesses walking a 64 KiB window, the size of the file backend RAM
+    constexpr uint32_t WINDOW = 0x10000;
+    constexpr uint32_t STRIDE = 68;
+    const size_t accesses = backend == "file" ? 1U << 16U : 1U << 24U;
+
+    std::unique_ptr<Machine> machine;
+    try {
+        machine = makeMachine();
+    } catch (const std::exception& exception) {
+        std::cerr << "memory/" << backend << ": skipped, " << exception.what() << '\n';
+        return;
+    }
+
+    suite.Run("memory", backend + "_load", "access", [&] {
+        uint32_t sum = 0;
+        uint32_t address = 0;
+        for (size_t i = 0; i < accesses; ++i) {
+            sum += machine->Load<int32_t>(address);
+            address = (address + STRIDE) % (WINDOW - sizeof(uint32_t)) & ~3U;
+        }
+        DoNotOptimize(sum);
+        return accesses;
+    });
+
+    // Stores write back what is there, the file backend RAM stays intact
+    std::vector<int32_t> contents(WINDOW / sizeof(int32_t));
+    for (uint32_t address = 0; address < WINDOW; address += sizeof(int32_t)) {
+        contents[address / sizeof(int32_t)] = machine->Load<int32_t>(address);
+    }
+
+    suite.Run("memory", backend + "_store", "access", [&] {
+        uint32_t address = 0;
+        for (size_t i = 0; i < accesses; ++i) {
+            machine->Store<int32_t>(address, contents[address / sizeof(int32_t)]);
+            address = (address + STRIDE) % (WINDOW - sizeof(uint32_t)) & ~3U;
+        }
+        return accesses;
+    });
+}
+
+std::vector<uint8_t> ReadFile(const std::string& path) {
+    std::ifstream file{path, std::ios::binary};
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open " + path);
+    }
+    return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+}
+
+void KernelBenchmarks(Suite& suite, const std::string& directory, std::vector<uint32_t>& corpus) {
+    // Expected a1 at exit, see the comments in bench/kernels/*.S
+    const std::pair<const char*, uint32_t> kernels[] = {
+        {"memset", 1},
+        {"matmul", 527245242},
+        {"crc", 153737177},
+        {"sort", 0},
+        {"dhrystone", 1600840000},
+    };
+
+    for (const auto& [name, expected] : kernels) {
+        const std::vector<uint8_t> image = ReadFile(directory + '/' + name + ".bin");
+        for (size_t i = 0; i + sizeof(uint32_t) <= image.size(); i += sizeof(uint32_t)) {
+            uint32_t word = 0;
+            std::memcpy(&word, image.data() + i, sizeof(word));
+            corpus.push_back(word);
+        }
+
+        suite.RunChecked("kernel", name, expected, [&image](uint32_t& checksum) {
+            return RunGuest(image, &checksum);
+        });
+    }
+}
+
+void CorpusBenchmarks(Suite& suite) {
+    for (const GuestProgram& program : Corpus::Default()) {
+        suite.RunChecked("corpus", program.name, program.expected, [&program](uint32_t& checksum) {
+            return RunGuest(program, checksum);
+        });
+    }
+}
+
+void WriteJson(std::ostream& out, const Suite& suite) {
+    out << std::fixed << std::setprecision(3);
+    out << "{\n  \"version\": 1,\n  \"repeat\": " << suite.Repeat() << ",\n  \"results\": [";
+    const auto& results = suite.Results();
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& result = results[i];
+        const double perOperation = result.nanoseconds / result.operations;
+        out << (i == 0 ? "\n" : ",\n") << "    {\"group\": \"" << result.group << "\", \"name\": \"" << result.name
+            << "\", \"unit\": \"" << result.unit << "\", \"count\": " << result.operations
+            << ", \"ns_per_" << result.unit << "\": " << perOperation;
+        if (result.unit == "instr") {
+            out << ", \"mips\": " << 1000.0 / perOperation;
+        } else {
+            out << ", \"m" << result.unit << "_per_s\": " << 1000.0 / perOperation;
+        }
+        if (result.checksum) {
+            out << ", \"checksum\": " << *result.checksum << ", \"ok\": "
+                << (result.checksum == result.expected ? "true" : "false");
+        }
+        out << '}';
+    }
+    out << "\n  ]\n}\n";
+}
+
+} // anon namespace
+
+int main(int argc, const char* argv[]) {
+    size_t repeat = 3;
+    std::string filter;
+    std::string kernelDirectory = BENCH_KERNEL_DIR;
+    std::optional<std::string> outputPath;
+    for (int i = 1; i + 1 < argc; ++i) {
+        const auto cmdArg = std::string_view(argv[i]);
+        if (cmdArg == "--repeat") {
+            repeat = std::max(1UL, std::stoul(argv[i + 1]));
+        }
+        if (cmdArg == "--filter") {
+            filter = argv[i + 1];
+        }
+        if (cmdArg == "--kernels") {
+            kernelDirectory = argv[i + 1];
+        }
+        if (cmdArg == "--output") {
+            outputPath = argv[i + 1];
+        }
+    }
+
+    Suite suite{repeat, filter};
+
+    std::vector<uint32_t> corpus;
+    KernelBenchmarks(suite, kernelDirectory, corpus);
+    DecodeBenchmarks(suite, corpus);
+    DispatchBenchmarks(suite);
+    CorpusBenchmarks(suite);
+
+    const std::vector<uint8_t> empty;
+    MemoryBenchmarks(suite, "mmap", [&empty] { return std::make_unique<Machine>(empty, 0); });
+    // The file backend opens ../ram/ram.bin relative to the working directory
+    MemoryBenchmarks(suite, "file", [] { return std::make_unique<Machine>(); });
+
+    if (outputPath) {
+        std::ofstream output{*outputPath};
+        WriteJson(output, suite);
+    } else {
+        WriteJson(std::cout, suite);
+    }
+
+    for (const Result& result : suite.Results()) {
+        if (result.checksum && result.checksum != result.expected) {
+            std::cerr << result.name << ": wrong checksum " << *result.checksum << ", expected " << *result.expected << '\n';
+            return 1;
+        }
+    }
+}
@@ -2,53 +2,596 @@
 #include <Decoder.hpp>
 #include <hart.hpp>
 #include <machine.hpp>
+#include <trace.hpp>
+#include <instrumentation.hpp>
+#include <hostCounters.hpp>
+#include <liveStats.hpp>
+#include <cosim.hpp>
+#include <multiHart.hpp>
+#include <guestThreads.hpp>
+#include <scheduler.hpp>
+#include <lockstep.hpp>
 #include <cstdio>
+#include <bit>
 #include <chrono>
+#include <optional>
+#include <iomanip>
+#include <fstream>
+#include <unistd.h>
+
+namespace {
+
+// Prints a binary trace in a text form close to trace_parse.py output
+void DumpTrace(std::string_view path) {
+    RISCVS::TraceReader reader{path};
+    RISCVS::TraceRecord record;
+    while (reader.Next(record)) {
+        std::cout << std::hex << std::setfill('0') << "0x" << std::setw(8) << record.pc
+                  << " (0x" << std::setw(8) << record.code << ')';
+        if (record.flags & RISCVS::TraceRecord::RD) {
+            std::cout << " x" << std::dec << static_cast<unsigned>(record.rd)
+                      << " 0x" << std::hex << std::setw(8) << record.rdValue;
+        }
+        if (record.flags & RISCVS::TraceRecord::MEMORY) {
+            std::cout << " mem 0x" << std::setw(8) << record.memoryRef;
+        }
+        std::cout << '\n';
+    }
+    std::cout << std::dec;
+}
+
+// Guest faults surface as exceptions from Decode/Machine, show what led to them
+void ReportFault(RISCVS::Hart& hart, std::string_view message) {
+    std::cerr << "Fault at pc 0x" << std::hex << hart.GetPC() << std::dec << ": " << message << '\n';
+    std::cerr.flush();
+    hart.GetFlightRecorder().Dump(STDERR_FILENO);
+    hart.Dump();
+}
+
+// The guest stopped itself with ebreak, show what led to it
+void ReportBreakpoint(RISCVS::Hart& hart) {
+    std::cerr << "Breakpoint at pc 0x" << std::hex << hart.GetPC() << std::dec << '\n';
+    std::cerr.flush();
+    hart.GetFlightRecorder().Dump(STDERR_FILENO);
+}
+
+// "addr:size", both may be hex
+RISCVS::Cosim::MemoryRange ParseMemoryRange(const std::string& text) {
+    const size_t colon = text.find(':');
+    if (colon == std::string::npos) {
+        throw std::runtime_error("Expected addr:size, got " + text);
+    }
+    return {.address = static_cast<uint32_t>(std::stoul(text.substr(0, colon), nullptr, 0)),
+            .size = static_cast<uint32_t>(std::stoul(text.substr(colon + 1), nullptr, 0))};
+}
+
+// Runs the decode cache engine against the reference interpreter
+int RunCosim(int32_t pcInitValue, std::string codePath, uint32_t loadOffset, RISCVS::Cosim::Options options) {
+#ifdef MMAP
+    RISCVS::Cosim cosim{
+        [codePath, loadOffset] { return std::make_unique<RISCVS::Machine>(codePath, loadOffset); },
+        pcInitValue, RISCVS::Engines::DecodeCached, RISCVS::Engines::Reference, std::move(options)};
+    const bool ok = cosim.Run();
+    cosim.Report(std::cout);
+    if (!ok) {
+        std::cout.flush();
+        cosim.ReferenceHart().GetFlightRecorder().Dump(STDERR_FILENO);
+    }
+    return ok ? 0 : 1;
+#else // MMAP
+    std::cerr << "Co-simulation needs a Machine per engine, build with -DMMAP=ON\n";
+    return 1;
+#endif // MMAP
+}
+
+// Prints per-hart results and totals, returns true if any hart faulted
+bool ReportHarts(const std::vector<RISCVS::RunResult>& results, std::chrono::milliseconds duration) {
+    uint64_t executed = 0;
+    bool faulted = false;
+    for (size_t id = 0; id < results.size(); ++id) {
+        const RISCVS::RunResult& result = results[id];
+        std::cout << "Hart " << id << ": " << RISCVS::ToString(result.reason) << ", "
+                  << result.retired << " instructions";
+        if (!result.fault.empty()) {
+            std::cout << " (" << result.fault << ')';
+        }
+        std::cout << std::endl;
+        executed += result.retired;
+        faulted |= result.reason == RISCVS::StopReason::FAULT;
+    }
+
+    std::cout << "Execution time: " << duration.count() << " milliseconds" << std::endl;
+    std::cout << "Executed instructions: " << executed << std::endl;
+    return faulted;
+}
+
+// Every hart on its own host thread, without instrumentation
+int RunHarts(RISCVS::Machine& machine, size_t count, int32_t pcInitValue, bool sharedCache) {
+    if (count > 1 && !machine.Shareable()) {
+        std::cerr << "Several harts on host threads need the mmap backend, build with -DMMAP=ON\n";
+        return 1;
+    }
+    RISCVS::MultiHart harts{machine, count, pcInitValue};
+    std::optional<RISCVS::TranslationCache> cache;
+    if (sharedCache) {
+        cache.emplace(machine);
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    const std::vector<RISCVS::RunResult> results = cache ? harts.Run(*cache) : harts.Run();
+    auto end = std::chrono::high_resolution_clock::now();
+
+    const bool faulted = ReportHarts(results, std::chrono::duration_cast<std::chrono::milliseconds>(end - start));
+    if (cache) {
+        const RISCVS::TranslationCache::Stats stats = cache->GetStats();
+        std::cout << "Shared cache: " << stats.translations << " blocks, " << stats.contended << " contended, "
+                  << stats.invalidations << " invalidated, " << stats.reclaimed << " reclaimed" << std::endl;
+    }
+    for (size_t id = 0; id < harts.Size(); ++id) {
+        harts[id].Dump();
+    }
+    return faulted ? 1 : 0;
+}
+
+// All harts on this thread, interleaved by the coroutine scheduler
+int ScheduleHarts(RISCVS::Machine& machine, size_t count, int32_t pcInitValue, uint64_t quantum) {
+    RISCVS::Scheduler scheduler{quantum};
+    for (size_t id = 0; id < count; ++id) {
+        scheduler.Add(machine, pcInitValue);
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    const std::vector<RISCVS::RunResult> results = scheduler.Run();
+    auto end = std::chrono::high_resolution_clock::now();
+
+    const bool faulted = ReportHarts(results, std::chrono::duration_cast<std::chrono::milliseconds>(end - start));
+    std::cout << "Hart switches: " << scheduler.Switches() << std::endl;
+    for (size_t id = 0; id < scheduler.Size(); ++id) {
+        scheduler[id].Dump();
+    }
+    return faulted ? 1 : 0;
+}
+
+// Guest-created threads (clone), each on its own host thread
+int RunGuestThreads(RISCVS::Machine& machine, int32_t pcInitValue) {
+    if (!machine.Shareable()) {
+        std::cerr << "Guest threads need the mmap backend, build with -DMMAP=ON\n";
+        return 1;
+    }
+    RISCVS::GuestThreads threads{machine, pcInitValue};
+
+    auto start = std::chrono::high_resolution_clock::now();
+    const int status = threads.Run();
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+
+    uint64_t executed = 0;
+    for (const RISCVS::GuestThreads::Summary& thread : threads.Threads()) {
+        std::cout << "Thread " << thread.tid << ": " << RISCVS::ToString(thread.result.reason) << ", "
+                  << thread.result.retired << " instructions";
+        if (!thread.result.fault.empty()) {
+            std::cout << " (" << thread.result.fault << ')';
+        }
+        std::cout << std::endl;
+        executed += thread.result.retired;
+    }
+
+    std::cout << "Execution time: " << duration.count() << " milliseconds" << std::endl;
+    std::cout << "Executed instructions: " << executed << std::endl;
+    std::cout << "Exit status: " << status << std::endl;
+    return status;
+}
+
+} // anon namespace
 
 int main(int argc, const char* argv[]) {
     using namespace RISCVS;
 
     int32_t pcInitValue = 0x100d8;
+    std::string codePath = "../ram/code.bin";
+    uint32_t loadOffset = 0x10094;
+    std::optional<std::string_view> tracePath;
+    std::optional<std::string_view> coveragePath;
+    std::optional<std::string_view> diffTracePath;
+    size_t diffHistory = 16;
+    std::optional<std::string_view> profilePath;
+    size_t profileTop = 20;
+    std::optional<std::string_view> elfPath;
+    std::optional<std::string_view> callGraphPath;
+    std::optional<std::string_view> statsName;
+    std::optional<std::string_view> decodeImagePath;
+    std::optional<size_t> flightRecorderSize;
+    bool waitForRegion = false;
+    bool hostCountersEnabled = false;
+    std::optional<Cosim::Options> cosimOptions;
+    std::vector<Cosim::MemoryRange> cosimMemory;
+    size_t hartCount = 1;
+    bool guestThreads = false;
+    bool sharedCache = false;
+    bool decodeCacheEnabled = false;
+    std::optional<bool> timingLossless;
+    std::optional<PipelineModel::Config> pipelineConfig;
+    std::optional<uint64_t> quantum;
     for (size_t i = 0; i < argc; i++) {
         const auto cmdArg = std::string_view(argv[i]);
 
+        if (cmdArg == "--self-test") {
+            // In-tree tests, also run by ctest
+            const int failed = Decoder::TestDecoder() + TestTrace() + TestLockstep() + TestTranslationCache();
+            return failed == 0 ? 0 : 1;
+        }
+
+        if (cmdArg == "--roi") {
+            waitForRegion = true;
+        }
+
+        if (cmdArg == "--perf") {
+            hostCountersEnabled = true;
+        }
+
+        if (cmdArg == "--guest-threads") {
+            guestThreads = true;
+        }
+
+        if (cmdArg == "--shared-cache") {
+            sharedCache = true;
+        }
+
+        if (cmdArg == "--decode-cache") {
+            decodeCacheEnabled = true;
+        }
+
+        if (cmdArg == "--timing") {
+            timingLossless = true;
+        }
+
+        if (cmdArg == "--timing-lossy") {
+            timingLossless = false;
+        }
+
+        if (cmdArg == "--pipeline" && !pipelineConfig) {
+            pipelineConfig.emplace();
+        }
+
         // Flag has 1 parameter
         if (i + 1 < argc) {
             if (cmdArg == "--pc") {
                 // std::stoi does not support std::string_view (it is so stupid)
                 // std::atoi is UB-generator :)
-                pcInitValue = std::stoi(std::string(argv[i + 1]));
+                // Base 0: decimal or 0x-prefixed hex
+                pcInitValue = static_cast<int32_t>(std::stoul(std::string(argv[i + 1]), nullptr, 0));
+            }
+
+            if (cmdArg == "--code") {
+                codePath = argv[i + 1];
+            }
+
+            if (cmdArg == "--load") {
+                loadOffset = static_cast<uint32_t>(std::stoul(std::string(argv[i + 1]), nullptr, 0));
+            }
+
+            if (cmdArg == "--trace") {
+                tracePath = argv[i + 1];
+            }
+
+            if (cmdArg == "--coverage") {
+                coveragePath = argv[i + 1];
+            }
+
+            if (cmdArg == "--diff-trace") {
+                diffTracePath = argv[i + 1];
+            }
+
+            if (cmdArg == "--diff-history") {
+                diffHistory = std::stoul(std::string(argv[i + 1]));
+            }
+
+            if (cmdArg == "--profile") {
+                profilePath = argv[i + 1];
+            }
+
+            if (cmdArg == "--profile-top") {
+                profileTop = std::stoul(std::string(argv[i + 1]));
+            }
+
+            if (cmdArg == "--callgraph") {
+                callGraphPath = argv[i + 1];
+            }
+
+            if (cmdArg == "--flight-recorder") {
+                flightRecorderSize = std::stoul(std::string(argv[i + 1]));
+                if (!std::has_single_bit(*flightRecorderSize)) {
+                    std::cerr << "--flight-recorder takes a power of two, got " << argv[i + 1] << '\n';
+                    return 1;
+                }
+            }
+
+            if (cmdArg == "--decode-image") {
+                decodeImagePath = argv[i + 1];
+            }
+
+            if (cmdArg == "--stats") {
+                statsName = argv[i + 1];
+            }
+
+            if (cmdArg == "--cosim") {
+                // Compare every N instructions or at the end of every basic block
+                const std::string interval{argv[i + 1]};
+                cosimOptions.emplace();
+                cosimOptions->interval = interval == "block" ? 0 : std::stoull(interval);
+            }
+
+            if (cmdArg == "--harts") {
+                hartCount = std::max(1UL, std::stoul(std::string(argv[i + 1])));
+            }
+
+            if (cmdArg == "--quantum") {
+                quantum = std::max(1UL, std::stoul(std::string(argv[i + 1])));
+            }
+
+            if (cmdArg == "--cosim-memory") {
+                cosimMemory.push_back(ParseMemoryRange(argv[i + 1]));
+            }
+
+            if (cmdArg == "--pipeline-config") {
+                pipelineConfig = PipelineModel::Config::Parse(argv[i + 1]);
+            }
+
+            if (cmdArg == "--elf") {
+                elfPath = argv[i + 1];
+            }
+
+            if (cmdArg == "--dump-trace") {
+                DumpTrace(argv[i + 1]);
+                return 0;
             }
         }
       }
 
+    // One instrumentation policy drives the loop (instrumentation.hpp), they do not compose
+    const int policies = tracePath.has_value() + profilePath.has_value() + callGraphPath.has_value() +
+                         coveragePath.has_value() + diffTracePath.has_value() +
+                         (timingLossless.has_value() || pipelineConfig.has_value());
+    if (policies > 1) {
+        std::cerr << "Only one of --trace, --profile, --callgraph, --coverage, --diff-trace and "
+                     "--timing/--timing-lossy/--pipeline can be used at a time\n";
+        return 1;
+    }
+    if (waitForRegion && (tracePath || diffTracePath)) {
+        std::cerr << "--roi does not apply to --trace and --diff-trace, they see every instruction\n";
+        return 1;
+    }
+
+    // --harts, --quantum and --guest-threads run their own loops, the rest of
+    // the flags are for the single hart one below
+    if (guestThreads && (hartCount > 1 || sharedCache || quantum)) {
+        std::cerr << "--guest-threads creates its own harts, it cannot be combined with --harts, --shared-cache "
+                     "and --quantum\n";
+        return 1;
+    }
+    if (quantum && sharedCache) {
+        std::cerr << "--shared-cache applies to --harts without --quantum\n";
+        return 1;
+    }
+    const bool multiHart = hartCount > 1 || sharedCache || quantum || guestThreads;
+    if (multiHart && (policies != 0 || waitForRegion || statsName || hostCountersEnabled || decodeImagePath ||
+                      decodeCacheEnabled || flightRecorderSize)) {
+        std::cerr << "--trace, --profile, --callgraph, --coverage, --diff-trace, --timing, --pipeline, --roi, "
+                     "--stats, --perf, --decode-image, --decode-cache and --flight-recorder are not supported "
+                     "with --harts, --quantum and --guest-threads\n";
+        return 1;
+    }
+    if (decodeCacheEnabled && decodeImagePath) {
+        std::cerr << "--decode-cache and --decode-image are two ways to skip decoding, pick one\n";
+        return 1;
+    }
+
+    if (cosimOptions) {
+        cosimOptions->memory = std::move(cosimMemory);
+        return RunCosim(pcInitValue, codePath, loadOffset, std::move(*cosimOptions));
+    }
   
 #ifdef MMAP
-    uint32_t loadOffset = 0x10094;
-    Machine machine{"../ram/code.bin", loadOffset};
+    Machine machine{codePath, loadOffset};
 #else // MMAP
     Machine machine{};
 #endif // MMAP
 
+    if (quantum) {
+        return ScheduleHarts(machine, hartCount, pcInitValue, *quantum);
+    }
+
+    if (hartCount > 1 || sharedCache) {
+        return RunHarts(machine, hartCount, pcInitValue, sharedCache);
+    }
+
+    if (guestThreads) {
+        return RunGuestThreads(machine, pcInitValue);
+    }
+
     Hart hart{machine, pcInitValue};
+    hart.GetFlightRecorder().Resize(flightRecorderSize.value_or(FlightRecorder::DEFAULT_SIZE));
+
+    // Pre-decoded code shared with other instances through the cache file
+    std::optional<DecodeImage> decodeImage;
+    if (decodeImagePath) {
+        std::ifstream codeFile{codePath, std::ios::binary};
+        const std::vector<uint8_t> code{std::istreambuf_iterator<char>(codeFile), std::istreambuf_iterator<char>()};
+        decodeImage.emplace(*decodeImagePath, loadOffset, code);
+        std::cout << "Decode image: " << decodeImage->Size() << " words, "
+                  << (decodeImage->Reused() ? "reused" : "built") << (decodeImage->Shared() ? ", shared" : ", private")
+                  << std::endl;
+    }
+    FlightRecorder::DumpOnSignal(hart.GetFlightRecorder());
+
+    std::optional<TraceWriter> traceWriter;
+    std::optional<TraceDiffer> traceDiffer;
+    std::optional<BlockProfiler> profiler;
+    std::optional<CallGraph> callGraph;
+    std::optional<TimingModel> timingModel;
+    SymbolTable symbols = elfPath ? SymbolTable{*elfPath} : SymbolTable{};
+
+    // Statistics are gated by the guest ROI markers, with --roi nothing is
+    // counted until the first start marker
+    Region region{!waitForRegion};
+    bool regionAttached = true;
+    Instrumentation::Policy policy;
+    if (tracePath) {
+        traceWriter.emplace(*tracePath);
+        policy.emplace<Instrumentation::Trace>(traceWriter->OpenStream());
+        regionAttached = false;
+    } else if (profilePath) {
+        profiler.emplace(pcInitValue);
+        policy.emplace<Instrumentation::Roi<Instrumentation::Profile>>(region, Instrumentation::Profile{*profiler});
+    } else if (callGraphPath) {
+        callGraph.emplace(pcInitValue);
+        policy.emplace<Instrumentation::Roi<Instrumentation::CallProfile>>(region, Instrumentation::CallProfile{*callGraph});
+    } else if (coveragePath) {
+        policy.emplace<Instrumentation::Roi<Instrumentation::Coverage>>(region);
+    } else if (diffTracePath) {
+        traceDiffer.emplace(OpenReferenceTrace(*diffTracePath), diffHistory);
+        policy.emplace<Instrumentation::Lockstep>(*traceDiffer);
+        regionAttached = false;
+    } else if (timingLossless || pipelineConfig) {
+        timingModel.emplace(pipelineConfig ? TimingModel::Model{PipelineModel{*pipelineConfig}} : CycleModel{},
+                            timingLossless.value_or(true));
+        policy.emplace<Instrumentation::Roi<Instrumentation::Timing>>(region,
+                                                                      Instrumentation::Timing{timingModel->Stream()});
+    } else if (waitForRegion) {
+        policy.emplace<Instrumentation::Roi<Instrumentation::NoTrace>>(region);
+    } else {
+        regionAttached = false;
+    }
+
+    auto* coverage = std::get_if<Instrumentation::Roi<Instrumentation::Coverage>>(&policy);
+    region.SetDumpHandler([&](Hart& hart) {
+        if (profiler) {
+            profiler->Report(std::cout, hart, symbols, profileTop);
+        }
+        if (callGraph) {
+            callGraph->Report(std::cout, symbols, profileTop);
+        }
+        if (coverage) {
+            std::cout << "Covered instructions: " << coverage->GetInner().Count() << std::endl;
+        }
+        if (timingModel) {
+            timingModel->Sync();
+            timingModel->Report(std::cout);
+        }
+    });
+
+    std::optional<LiveStats> liveStats;
+    if (statsName) {
+        liveStats.emplace(*statsName);
+    }
+
+    std::optional<HostCounters> hostCounters;
+    if (hostCountersEnabled) {
+        hostCounters.emplace();
+    }
+
+    // Live stats publish its hit rate when there is one
+    std::optional<DecodeCache> decodeCache;
+    if (decodeCacheEnabled) {
+        decodeCache.emplace();
+    }
+    const DecodeCache* publishedCache = decodeCache ? &*decodeCache : nullptr;
+
+    auto loop = [&](uint64_t budget) {
+        if (decodeImage) {
+            return Instrumentation::Loop(hart, policy, *decodeImage, budget);
+        }
+        return decodeCache ? Instrumentation::Loop(hart, policy, *decodeCache, budget)
+                           : Instrumentation::Loop(hart, policy, budget);
+    };
+
+    // A faulting guest still gets its counters, up to the faulting instruction
+    auto reportFault = [&](std::string_view message, std::chrono::high_resolution_clock::time_point start) {
+        const auto end = std::chrono::high_resolution_clock::now();
+        if (hostCounters) {
+            hostCounters->Stop();
+        }
+        ReportFault(hart, message);
+        if (hostCounters) {
+            hostCounters->Report(std::cout, hart.GetFlightRecorder().Count(), end - start);
+        }
+    };
 
+    if (hostCounters) {
+        hostCounters->Start();
+    }
     auto start = std::chrono::high_resolution_clock::now();
-    for (int i = 0; !hart.IsStop(); ++i) {
-        hart.Execute();
-        // hart.Dump(18);
-        // char x = getchar();
-        // if (x == 'q') {
-        //     break;
-        // }
+    uint64_t executed = 0;
+    try {
+        if (liveStats) {
+            // Slices keep the loop itself free of any stats code
+            while (!hart.IsStop()) {
+                executed += loop(LiveStats::INTERVAL);
+                liveStats->Update(hart, machine, executed, publishedCache);
+            }
+            liveStats->Finish(hart, machine, executed, publishedCache);
+        } else {
+            executed = loop(UINT64_MAX);
+        }
+    } catch (const char* message) {
+        reportFault(message, start);
+        return 1;
+    } catch (const std::exception& exception) {
+        reportFault(exception.what(), start);
+        return 1;
     }
 
     auto end = std::chrono::high_resolution_clock::now();
+    if (hostCounters) {
+        hostCounters->Stop();
+    }
+    if (hart.GetStopReason() == StopReason::BREAKPOINT) {
+        ReportBreakpoint(hart);
+    }
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
 
     std::cout << "Execution time: " << duration.count() << " milliseconds" << std::endl;
+    std::cout << "Executed instructions: " << executed << std::endl;
 
+    if (hostCounters) {
+        hostCounters->Report(std::cout, executed, end - start);
+    }
+
+    if (regionAttached) {
+        region.Report(std::cout);
+    }
+
+    if (profiler) {
+        profiler->Report(std::cout, hart, symbols, profileTop);
+        std::ofstream profileFile{std::string(*profilePath)};
+        profiler->ReportJson(profileFile, hart, symbols, profileTop);
+    }
+
+    if (callGraph) {
+        callGraph->Report(std::cout, symbols, profileTop);
+        std::ofstream collapsedFile{std::string(*callGraphPath)};
+        callGraph->WriteCollapsed(collapsedFile, symbols);
+    }
+
+    if (timingModel) {
+        timingModel->Finish();
+        timingModel->Report(std::cout);
+    }
+
+    if (coverage) {
+        std::ofstream coverageFile{std::string(*coveragePath)};
+        coverage->GetInner().Write(coverageFile);
+        std::cout << "Covered instructions: " << coverage->GetInner().Count() << std::endl;
+    }
 
     hart.Dump();
 
-    // Decoder::TestDecoder();
+    if (traceDiffer) {
+        traceDiffer->Finish();
+        traceDiffer->Report(std::cerr);
+        if (traceDiffer->Diverged()) {
+            return 1;
+        }
+    }
+
 }
@@ -0,0 +1,174 @@
+#include "riscvs.h"
+
+#include <hart.hpp>
+#include <machine.hpp>
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+struct riscvs_machine {
+    RISCVS::Machine machine{std::span<const uint8_t>{}, 0};
+    RISCVS::Hart hart{machine, 0};
+    std::string error;
+};
+
+namespace {
+
+using RISCVS::StopReason;
+
+static_assert(static_cast<int>(StopReason::NONE) == RISCVS_STOP_NONE);
+static_assert(static_cast<int>(StopReason::HALT) == RISCVS_STOP_HALT);
+static_assert(static_cast<int>(StopReason::BUDGET) == RISCVS_STOP_BUDGET);
+static_assert(static_cast<int>(StopReason::BREAKPOINT) == RISCVS_STOP_BREAKPOINT);
+static_assert(static_cast<int>(StopReason::FAULT) == RISCVS_STOP_FAULT);
+static_assert(static_cast<int>(StopReason::WAIT) == RISCVS_STOP_WAIT);
+
+constexpr uint64_t GUEST_SIZE = 1ULL << 32U;
+
+// No exception crosses the C boundary: failures become -1 and last_error
+template<typename Func>
+int Guarded(riscvs_machine* machine, Func&& func) {
+    try {
+        func();
+        machine->error.clear();
+        return 0;
+    } catch (const char* message) {
+        machine->error = message;
+    } catch (const std::exception& exception) {
+        machine->error = exception.what();
+    }
+    return -1;
+}
+
+void CheckRange(uint32_t address, size_t size) {
+    if (address + static_cast<uint64_t>(size) > GUEST_SIZE) {
+        throw std::runtime_error("Range is outside of the guest address space");
+    }
+}
+
+riscvs_run_result Result(riscvs_machine* machine, const RISCVS::RunResult& result) {
+    machine->error = result.fault;
+    return riscvs_run_result{.reason = static_cast<riscvs_stop_reason>(result.reason), .retired = result.retired};
+}
+
+} // anon namespace
+
+extern "C" {
+
+int riscvs_api_version(void) {
+    return RISCVS_API_VERSION;
+}
+
+riscvs_machine* riscvs_create(void) {
+    try {
+        return new riscvs_machine;
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void riscvs_destroy(riscvs_machine* machine) {
+    delete machine;
+}
+
+const char* riscvs_last_error(const riscvs_machine* machine) {
+    return machine->error.c_str();
+}
+
+int riscvs_load_image(riscvs_machine* machine, uint32_t address, const void* data, size_t size) {
+    return Guarded(machine, [&] {
+        CheckRange(address, size);
+        machine->machine.WriteBlock(address, {static_cast<const uint8_t*>(data), size});
+    });
+}
+
+int riscvs_load_file(riscvs_machine* machine, uint32_t address, const char* path) {
+    return Guarded(machine, [&] {
+        std::ifstream file{path, std::ios::binary};
+        if (!file.is_open()) {
+            throw std::runtime_error(std::string("Failed to open ") + path);
+        }
+        const std::vector<uint8_t> image{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+        CheckRange(address, image.size());
+        machine->machine.WriteBlock(address, image);
+    });
+}
+
+int riscvs_read_memory(riscvs_machine* machine, uint32_t address, void* data, size_t size) {
+    return Guarded(machine, [&] {
+        CheckRange(address, size);
+        std::span<uint8_t> buffer{static_cast<uint8_t*>(data), size};
+        std::span<const uint8_t> block = machine->machine.ReadBlock(address, buffer);
+        if (block.data() != buffer.data()) {
+            std::memcpy(buffer.data(), block.data(), size);
+        }
+    });
+}
+
+int riscvs_map_mmio(riscvs_machine* machine, uint32_t base, uint32_t size,
+                    riscvs_mmio_read_fn read, riscvs_mmio_write_fn write, void* user) {
+    return Guarded(machine, [&] {
+        CheckRange(base, size);
+        machine->machine.MapMmio(RISCVS::Machine::MmioRegion{
+            .base = base,
+            .size = size,
+            .read = [read, user](uint32_t offset, uint32_t accessSize) {
+                return read != nullptr ? read(user, offset, accessSize) : 0U;
+            },
+            .write = [write, user](uint32_t offset, uint32_t value, uint32_t accessSize) {
+                if (write != nullptr) {
+                    write(user, offset, value, accessSize);
+                }
+            },
+        });
+    });
+}
+
+void riscvs_set_syscall_handler(riscvs_machine* machine, riscvs_syscall_fn handler, void* user) {
+    if (handler == nullptr) {
+        machine->hart.SetSyscallHandler({});
+        return;
+    }
+
+    machine->hart.SetSyscallHandler([machine, handler, user](RISCVS::Hart& hart) {
+        const int action = handler(user, machine);
+        if (action == RISCVS_SYSCALL_HALT) {
+            hart.Stop();
+        }
+        return action != RISCVS_SYSCALL_PASS;
+    });
+}
+
+uint32_t riscvs_get_pc(const riscvs_machine* machine) {
+    return machine->hart.GetPC();
+}
+
+void riscvs_set_pc(riscvs_machine* machine, uint32_t pc) {
+    machine->hart.SetPC(static_cast<int32_t>(pc));
+}
+
+uint32_t riscvs_get_register(riscvs_machine* machine, unsigned index) {
+    return index < RISCVS::Hart::NUM_REGISTER ? static_cast<uint32_t>(machine->hart[index]) : 0U;
+}
+
+void riscvs_set_register(riscvs_machine* machine, unsigned index, uint32_t value) {
+    if (index < RISCVS::Hart::NUM_REGISTER) {
+        machine->hart[index] = value;
+    }
+}
+
+riscvs_run_result riscvs_run(riscvs_machine* machine, uint64_t budget) {
+    return Result(machine, machine->hart.Run(budget));
+}
+
+riscvs_run_result riscvs_run_until(riscvs_machine* machine, uint32_t pc, uint64_t budget) {
+    return Result(machine, machine->hart.RunUntil(static_cast<int32_t>(pc), budget));
+}
+
+void riscvs_resume(riscvs_machine* machine) {
+    machine->hart.Resume();
+}
+
+} // extern "C"
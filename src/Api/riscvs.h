@@ -0,0 +1,93 @@
+/* C API of the riscvs library: a RV32I hart with its own mmap-backed memory.
+ *
+ *   riscvs_machine* m = riscvs_create();
+ *   riscvs_load_file(m, 0x10094, "code.bin");
+ *   riscvs_set_pc(m, 0x10094);
+ *   riscvs_run_result r = riscvs_run(m, UINT64_MAX);
+ *   uint32_t a0 = riscvs_get_register(m, 10);
+ *   riscvs_destroy(m);
+ *
+ * Functions returning int return 0 on success and -1 on failure, the reason
+ * is then available from riscvs_last_error(). Machines are independent: any
+ * number of them may be used, each one from a single thread at a time.
+ */
+
+#ifndef RISCVS_H
+#define RISCVS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RISCVS_API_VERSION 1
+
+typedef struct riscvs_machine riscvs_machine;
+
+typedef enum riscvs_stop_reason {
+    RISCVS_STOP_NONE = 0,
+    RISCVS_STOP_HALT = 1,           /* exit syscall or a syscall handler asked to halt */
+    RISCVS_STOP_BUDGET = 2,         /* the instruction budget is spent */
+    RISCVS_STOP_BREAKPOINT = 3,     /* riscvs_run_until() target or ebreak */
+    RISCVS_STOP_FAULT = 4,          /* unknown instruction or failed memory access */
+    RISCVS_STOP_WAIT = 5,           /* only under a scheduler, wfi is a no-op here */
+} riscvs_stop_reason;
+
+typedef struct riscvs_run_result {
+    riscvs_stop_reason reason;
+    uint64_t retired;
+} riscvs_run_result;
+
+/* ecall handler: arguments are read and a0 is written with riscvs_get/set_register.
+ * Returns RISCVS_SYSCALL_CONTINUE, RISCVS_SYSCALL_HALT or RISCVS_SYSCALL_PASS to fall
+ * back to the built-in handling (the host syscall, a7 = 93 halts). */
+typedef int (*riscvs_syscall_fn)(void* user, riscvs_machine* machine);
+
+#define RISCVS_SYSCALL_CONTINUE 0
+#define RISCVS_SYSCALL_HALT 1
+#define RISCVS_SYSCALL_PASS 2
+
+/* MMIO callbacks get the offset from the region base and the access size (1, 2 or 4) */
+typedef uint32_t (*riscvs_mmio_read_fn)(void* user, uint32_t offset, uint32_t size);
+typedef void (*riscvs_mmio_write_fn)(void* user, uint32_t offset, uint32_t value, uint32_t size);
+
+int riscvs_api_version(void);
+
+/* Empty 4 GiB guest address space, pc = 0. NULL on failure. */
+riscvs_machine* riscvs_create(void);
+void riscvs_destroy(riscvs_machine* machine);
+
+/* Error message of the last failed call on this machine, "" if none */
+const char* riscvs_last_error(const riscvs_machine* machine);
+
+int riscvs_load_image(riscvs_machine* machine, uint32_t address, const void* data, size_t size);
+int riscvs_load_file(riscvs_machine* machine, uint32_t address, const char* path);
+int riscvs_read_memory(riscvs_machine* machine, uint32_t address, void* data, size_t size);
+
+/* Routes guest accesses to [base, base + size) to the callbacks, either may be NULL */
+int riscvs_map_mmio(riscvs_machine* machine, uint32_t base, uint32_t size,
+                    riscvs_mmio_read_fn read, riscvs_mmio_write_fn write, void* user);
+
+void riscvs_set_syscall_handler(riscvs_machine* machine, riscvs_syscall_fn handler, void* user);
+
+uint32_t riscvs_get_pc(const riscvs_machine* machine);
+void riscvs_set_pc(riscvs_machine* machine, uint32_t pc);
+
+/* index 0..31, x0 reads as zero and ignores writes */
+uint32_t riscvs_get_register(riscvs_machine* machine, unsigned index);
+void riscvs_set_register(riscvs_machine* machine, unsigned index, uint32_t value);
+
+/* Execute up to budget instructions; run_until also stops before the instruction at pc */
+riscvs_run_result riscvs_run(riscvs_machine* machine, uint64_t budget);
+riscvs_run_result riscvs_run_until(riscvs_machine* machine, uint32_t pc, uint64_t budget);
+
+/* Clears a halt, the next run continues from pc */
+void riscvs_resume(riscvs_machine* machine);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RISCVS_H */
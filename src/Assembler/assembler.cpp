@@ -0,0 +1,72 @@
+#include "assembler.hpp"
+
+#include <stdexcept>
+
+namespace RISCVS {
+
+Assembler::Label Assembler::NewLabel() {
+    labels.push_back(UNBOUND);
+    return labels.size() - 1;
+}
+
+void Assembler::Bind(Label label) {
+    labels.at(label) = code.size();
+}
+
+void Assembler::Jal(Reg rd, Label target) {
+    fixups.push_back(Fixup{.index = code.size(), .label = target});
+    Emit(Decoder::Jal.Build(rd, 0));
+}
+
+void Assembler::Li(Reg rd, int32_t value) {
+    if (value >= -2048 && value < 2048) {
+        AddI(rd, ZERO, value);
+        return;
+    }
+
+    // addi sign-extends its 12 bits, round the upper part to compensate
+    const uint32_t upper = (static_cast<uint32_t>(value) + 0x800U) >> 12U;
+    const int32_t lower = static_cast<int32_t>(static_cast<uint32_t>(value) - (upper << 12U));
+    Lui(rd, static_cast<Immediate>(upper & 0xFFFFFU));
+    if (lower != 0) {
+        AddI(rd, rd, lower);
+    }
+}
+
+void Assembler::Exit() {
+    Li(A7, 93);
+    ECall();
+}
+
+const std::vector<uint32_t>& Assembler::Finish() {
+    for (const Fixup& fixup : fixups) {
+        const size_t target = labels.at(fixup.label);
+        if (target == UNBOUND) {
+            throw std::runtime_error("Assembler: unbound label");
+        }
+
+        const int64_t offset = (static_cast<int64_t>(target) - static_cast<int64_t>(fixup.index)) * sizeof(uint32_t);
+        uint32_t& word = code[fixup.index];
+        if (Decoder::GetOpcode(word) == Decoder::Type::J::Opcode) {
+            if (offset < -(1 << 20) || offset >= (1 << 20)) {
+                throw std::runtime_error("Assembler: jump target out of reach");
+            }
+            word = Decoder::Jal.Build(Decoder::GetRd(word), offset);
+        } else {
+            if (offset < -(1 << 12) || offset >= (1 << 12)) {
+                throw std::runtime_error("Assembler: branch target out of reach");
+            }
+            const Decoder::Type::B branch{.funct3 = Decoder::GetFunct3(word)};
+            word = branch.Build(Decoder::GetRs1(word), Decoder::GetRs2(word), offset);
+        }
+    }
+    fixups.clear();
+    return code;
+}
+
+std::span<const uint8_t> Assembler::Image() {
+    const std::vector<uint32_t>& words = Finish();
+    return {reinterpret_cast<const uint8_t*>(words.data()), words.size() * sizeof(uint32_t)};
+}
+
+} // namespace RISCVS
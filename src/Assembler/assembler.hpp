@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <Decoder.hpp>
+
+namespace RISCVS {
+
+// In-process RV32I assembler on top of the Decoder Build() encoders.
+// Instructions are appended in order; branches and jumps may refer to labels
+// bound later, offsets are resolved by Finish().
+//
+//   Assembler as{0x10000};
+//   auto loop = as.NewLabel();
+//   as.Li(Assembler::T0, 100);
+//   as.Bind(loop);
+//   as.AddI(Assembler::T0, Assembler::T0, -1);
+//   as.Bnez(Assembler::T0, loop);
+//   as.Exit();
+class Assembler {
+public:
+    enum Reg : RegIdx {
+        ZERO, RA, SP, GP, TP, T0, T1, T2,
+        S0, S1, A0, A1, A2, A3, A4, A5,
+        A6, A7, S2, S3, S4, S5, S6, S7,
+        S8, S9, S10, S11, T3, T4, T5, T6,
+    };
+
+    using Label = size_t;
+
+    explicit Assembler(uint32_t origin = 0) : origin(origin) {}
+
+    Label NewLabel();
+    void Bind(Label label);
+
+    // Address of the next instruction
+    uint32_t Here() const {
+        return origin + code.size() * sizeof(uint32_t);
+    }
+
+    #define R_TYPE(Instr) void Instr(Reg rd, Reg rs1, Reg rs2) { Emit(Decoder::Instr.Build(rd, rs1, rs2)); }
+    #define I_TYPE(Instr) void Instr(Reg rd, Reg rs1, Immediate imm) { Emit(Decoder::Instr.Build(rd, rs1, imm)); }
+    #define S_TYPE(Instr) void Instr(Reg rs2, Reg rs1, Immediate imm) { Emit(Decoder::Instr.Build(rs1, rs2, imm)); }
+    #define B_TYPE(Instr) void Instr(Reg rs1, Reg rs2, Label target) { EmitBranch(Decoder::Instr, rs1, rs2, target); }
+
+    R_TYPE(Add) R_TYPE(Sub) R_TYPE(Xor) R_TYPE(Or) R_TYPE(And)
+    R_TYPE(Sll) R_TYPE(Srl) R_TYPE(Sra) R_TYPE(Slt) R_TYPE(Sltu)
+
+    I_TYPE(AddI) I_TYPE(XorI) I_TYPE(OrI) I_TYPE(AndI)
+    I_TYPE(SllI) I_TYPE(SrlI) I_TYPE(SraI) I_TYPE(SltI) I_TYPE(SltIU)
+
+    // Loads and stores take the operands in the assembly order: lw rd, imm(rs1) / sw rs2, imm(rs1)
+    I_TYPE(Lb) I_TYPE(Lh) I_TYPE(Lw) I_TYPE(Lbu) I_TYPE(Lhu)
+    S_TYPE(Sb) S_TYPE(Sh) S_TYPE(Sw)
+
+    B_TYPE(Beq) B_TYPE(Bne) B_TYPE(Blt) B_TYPE(Bge) B_TYPE(BltU) B_TYPE(BgeU)
+
+    I_TYPE(Jalr)
+
+    // RV32A in the assembly order: lr.w rd, (rs1) / sc.w rd, rs2, (rs1) / amoadd.w rd, rs2, (rs1)
+    #define A_TYPE(Instr) void Instr(Reg rd, Reg rs2, Reg rs1) { Emit(Decoder::Instr.Build(rd, rs1, rs2, true, true)); }
+
+    void LrW(Reg rd, Reg rs1) { Emit(Decoder::LrW.Build(rd, rs1, ZERO, true, true)); }
+    A_TYPE(ScW) A_TYPE(AmoSwapW) A_TYPE(AmoAddW) A_TYPE(AmoXorW) A_TYPE(AmoAndW)
+    A_TYPE(AmoOrW) A_TYPE(AmoMinW) A_TYPE(AmoMaxW) A_TYPE(AmoMinUW) A_TYPE(AmoMaxUW)
+
+    #undef A_TYPE
+    #undef R_TYPE
+    #undef I_TYPE
+    #undef S_TYPE
+    #undef B_TYPE
+
+    void Jal(Reg rd, Label target);
+
+    // imm is the upper 20 bits
+    void Lui(Reg rd, Immediate imm) {
+        Emit(Decoder::Lui.Build(rd, imm));
+    }
+
+    void AuiPC(Reg rd, Immediate imm) {
+        Emit(Decoder::AuiPC.Build(rd, imm));
+    }
+
+    void ECall() {
+        Emit(Decoder::ECall.Build());
+    }
+
+    void EBreak() {
+        Emit(Decoder::EBreak.Build());
+    }
+
+    void Wfi() {
+        Emit(Decoder::Wfi.Build());
+    }
+
+    void Fence() {
+        Emit(Decoder::Fence.Build());
+    }
+
+    // csrr rd, csr
+    void CsrR(Reg rd, Uint csr) {
+        Emit(Decoder::CsrRs.Build(rd, ZERO, csr));
+    }
+
+    // Pseudo instructions
+    void Li(Reg rd, int32_t value);
+    void Mv(Reg rd, Reg rs) { AddI(rd, rs, 0); }
+    void Not(Reg rd, Reg rs) { XorI(rd, rs, -1); }
+    void Neg(Reg rd, Reg rs) { Sub(rd, ZERO, rs); }
+    void Nop() { AddI(ZERO, ZERO, 0); }
+    void J(Label target) { Jal(ZERO, target); }
+    void Call(Label target) { Jal(RA, target); }
+    void Ret() { Jalr(ZERO, RA, 0); }
+    void Beqz(Reg rs, Label target) { Beq(rs, ZERO, target); }
+    void Bnez(Reg rs, Label target) { Bne(rs, ZERO, target); }
+
+    // Region-of-interest marker, see Decoder::Marker
+    void Marker(Decoder::Marker marker) {
+        Emit(Decoder::MarkerCode(marker));
+    }
+
+    // exit syscall (a7 = 93)
+    void Exit();
+
+    void Emit(uint32_t binInstruction) {
+        code.push_back(binInstruction);
+    }
+
+    // Resolves label references, throws if a label is unbound or out of reach
+    const std::vector<uint32_t>& Finish();
+
+    // Finish() as bytes, ready for Machine::WriteBlock
+    std::span<const uint8_t> Image();
+
+private:
+    struct Fixup {
+        size_t index;
+        Label label;
+    };
+
+    template<typename BType>
+    void EmitBranch(const BType& branch, Reg rs1, Reg rs2, Label target) {
+        fixups.push_back(Fixup{.index = code.size(), .label = target});
+        Emit(branch.Build(rs1, rs2, 0));
+    }
+
+    constexpr static size_t UNBOUND = SIZE_MAX;
+
+    uint32_t origin;
+    std::vector<uint32_t> code;
+    std::vector<size_t> labels;     // instruction index per label
+    std::vector<Fixup> fixups;
+};
+
+} // namespace RISCVS
@@ -0,0 +1,202 @@
+#include "corpus.hpp"
+#include "assembler.hpp"
+
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <utility>
+
+namespace RISCVS {
+
+void GuestProgram::Load(Machine& machine) const {
+    for (const Segment& segment : segments) {
+        machine.WriteBlock(segment.address, segment.bytes);
+    }
+}
+
+namespace Corpus {
+
+namespace {
+
+using R = Assembler;
+
+GuestProgram Make(std::string name, Assembler& as, uint32_t expected) {
+    std::span<const uint8_t> image = as.Image();
+    return GuestProgram{
+        .name = std::move(name),
+        .entry = CODE_BASE,
+        .segments = {{.address = CODE_BASE, .bytes = {image.begin(), image.end()}}},
+        .expected = expected,
+    };
+}
+
+// xorshift32 of t0, t1 is clobbered
+void EmitXorShift(Assembler& as) {
+    as.SllI(R::T1, R::T0, 13);
+    as.Xor(R::T0, R::T0, R::T1);
+    as.SrlI(R::T1, R::T0, 17);
+    as.Xor(R::T0, R::T0, R::T1);
+    as.SllI(R::T1, R::T0, 5);
+    as.Xor(R::T0, R::T0, R::T1);
+}
+
+uint32_t XorShift(uint32_t x) {
+    x ^= x << 13U;
+    x ^= x >> 17U;
+    x ^= x << 5U;
+    return x;
+}
+
+} // anon namespace
+
+GuestProgram AluLoop(uint32_t iterations) {
+    Assembler as{CODE_BASE};
+    auto loop = as.NewLabel();
+
+    as.Li(R::S1, iterations);
+    as.Li(R::T0, 1);
+    as.Li(R::T1, 3);
+    as.Bind(loop);
+    as.Add(R::T0, R::T0, R::T1);
+    as.Xor(R::T1, R::T1, R::T0);
+    as.SllI(R::T2, R::T0, 3);
+    as.SrlI(R::T3, R::T1, 5);
+    as.Sub(R::T0, R::T0, R::T3);
+    as.Add(R::T1, R::T1, R::T2);
+    as.Sltu(R::T3, R::T0, R::T1);
+    as.Add(R::T0, R::T0, R::T3);
+    as.AddI(R::S1, R::S1, -1);
+    as.Bnez(R::S1, loop);
+    as.Xor(R::A1, R::T0, R::T1);
+    as.Exit();
+
+    uint32_t t0 = 1;
+    uint32_t t1 = 3;
+    for (uint32_t i = 0; i < iterations; ++i) {
+        t0 += t1;
+        t1 ^= t0;
+        const uint32_t t2 = t0 << 3U;
+        t0 -= t1 >> 5U;
+        t1 += t2;
+        t0 += t0 < t1;
+    }
+
+    return Make("alu_loop", as, t0 ^ t1);
+}
+
+GuestProgram PointerChase(uint32_t nodes, uint32_t steps, uint32_t seed) {
+    constexpr uint32_t NODE_SIZE = 64;
+
+    // Sattolo's shuffle gives a single cycle through all nodes
+    std::vector<uint32_t> next(nodes);
+    std::iota(next.begin(), next.end(), 0U);
+    std::mt19937 random{seed};
+    for (uint32_t i = nodes - 1; i > 0; --i) {
+        std::uniform_int_distribution<uint32_t> pick{0, i - 1};
+        std::swap(next[i], next[pick(random)]);
+    }
+
+    std::vector<uint8_t> data(static_cast<size_t>(nodes) * NODE_SIZE);
+    for (uint32_t i = 0; i < nodes; ++i) {
+        const uint32_t address = DATA_BASE + next[i] * NODE_SIZE;
+        std::memcpy(data.data() + static_cast<size_t>(i) * NODE_SIZE, &address, sizeof(address));
+    }
+
+    Assembler as{CODE_BASE};
+    auto loop = as.NewLabel();
+
+    as.Li(R::S1, steps);
+    as.Li(R::S0, DATA_BASE);
+    as.Mv(R::T0, R::S0);
+    as.Bind(loop);
+    as.Lw(R::T0, R::T0, 0);
+    as.AddI(R::S1, R::S1, -1);
+    as.Bnez(R::S1, loop);
+    as.Sub(R::T0, R::T0, R::S0);
+    as.SrlI(R::A1, R::T0, 6);
+    as.Exit();
+
+    uint32_t node = 0;
+    for (uint32_t i = 0; i < steps; ++i) {
+        node = next[node];
+    }
+
+    GuestProgram program = Make("pointer_chase", as, node);
+    program.segments.push_back({.address = DATA_BASE, .bytes = std::move(data)});
+    return program;
+}
+
+GuestProgram Branchy(uint32_t iterations, uint32_t takenPercent, uint32_t seed) {
+    const uint32_t threshold = takenPercent * 256U / 100U;
+
+    Assembler as{CODE_BASE};
+    auto loop = as.NewLabel();
+    auto skip = as.NewLabel();
+
+    as.Li(R::S1, iterations);
+    as.Li(R::T0, seed);
+    as.Li(R::S2, 0);
+    as.Li(R::S3, threshold);
+    as.Bind(loop);
+    EmitXorShift(as);
+    as.AndI(R::T1, R::T0, 255);
+    as.BgeU(R::T1, R::S3, skip);
+    as.AddI(R::S2, R::S2, 1);
+    as.Bind(skip);
+    as.AddI(R::S1, R::S1, -1);
+    as.Bnez(R::S1, loop);
+    as.Mv(R::A1, R::S2);
+    as.Exit();
+
+    uint32_t x = seed;
+    uint32_t taken = 0;
+    for (uint32_t i = 0; i < iterations; ++i) {
+        x = XorShift(x);
+        taken += (x & 255U) < threshold;
+    }
+
+    return Make("branchy_" + std::to_string(takenPercent), as, taken);
+}
+
+GuestProgram StreamingStores(uint32_t bytes, uint32_t passes) {
+    constexpr uint32_t UNROLL = 8;
+
+    Assembler as{CODE_BASE};
+    auto pass = as.NewLabel();
+    auto store = as.NewLabel();
+
+    as.Li(R::S0, DATA_BASE);
+    as.Li(R::S1, bytes);
+    as.Add(R::S1, R::S1, R::S0);
+    as.Li(R::S2, 0);
+    as.Li(R::S3, passes);
+    as.Bind(pass);
+    as.AddI(R::S2, R::S2, 1);
+    as.Mv(R::T0, R::S0);
+    as.Bind(store);
+    for (uint32_t i = 0; i < UNROLL; ++i) {
+        as.Sw(R::S2, R::T0, i * sizeof(uint32_t));
+    }
+    as.AddI(R::T0, R::T0, UNROLL * sizeof(uint32_t));
+    as.BltU(R::T0, R::S1, store);
+    as.Blt(R::S2, R::S3, pass);
+    as.Lw(R::A1, R::S1, -4);
+    as.Exit();
+
+    return Make("streaming_stores", as, passes);
+}
+
+std::vector<GuestProgram> Default() {
+    std::vector<GuestProgram> programs;
+    programs.push_back(AluLoop(500000));
+    programs.push_back(PointerChase(1U << 16U, 2000000, 1));
+    programs.push_back(Branchy(400000, 100, 0x12345678));
+    programs.push_back(Branchy(400000, 90, 0x12345678));
+    programs.push_back(Branchy(400000, 50, 0x12345678));
+    programs.push_back(StreamingStores(256U * 1024U, 48));
+    return programs;
+}
+
+} // namespace Corpus
+
+} // namespace RISCVS
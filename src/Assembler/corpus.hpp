@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <machine.hpp>
+
+namespace RISCVS {
+
+// A guest program with its initial memory, as produced by the Assembler
+struct GuestProgram {
+    struct Segment {
+        uint32_t address;
+        std::vector<uint8_t> bytes;
+    };
+
+    std::string name;
+    uint32_t entry;
+    std::vector<Segment> segments;
+    uint32_t expected;      // a1 at exit (ECall overwrites a0 with the host result)
+
+    void Load(Machine& machine) const;
+};
+
+// Synthetic benchmark programs, built in-process so benchmarks and
+// regression checks need no riscv32 toolchain. Expected results are
+// computed by a host model of each program.
+namespace Corpus {
+
+constexpr uint32_t CODE_BASE = 0x10000;
+constexpr uint32_t DATA_BASE = 0x100000;
+
+// Dependent ALU chain (add/sub/xor/shift/sltu), 10 instructions per iteration
+GuestProgram AluLoop(uint32_t iterations);
+
+// Walks a random single-cycle linked list of 64-byte nodes
+GuestProgram PointerChase(uint32_t nodes, uint32_t steps, uint32_t seed);
+
+// A data-dependent branch taken takenPercent% of the time: 0 and 100 are
+// perfectly predictable, 50 is a coin flip
+GuestProgram Branchy(uint32_t iterations, uint32_t takenPercent, uint32_t seed);
+
+// 8x unrolled sw over a buffer, repeated passes times
+GuestProgram StreamingStores(uint32_t bytes, uint32_t passes);
+
+// The set run by RISCV_Simulator_bench, a few million instructions each
+std::vector<GuestProgram> Default();
+
+} // namespace Corpus
+
+} // namespace RISCVS
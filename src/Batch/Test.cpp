@@ -0,0 +1,216 @@
+#include <lockstep.hpp>
+#include <assembler.hpp>
+#include <machine.hpp>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#define CHECK(cond)                                                         \
+    if (!(cond)) {                                                          \
+        std::cerr << testIdx << " is broken\n";     /* Not informative!*/   \
+        ++failures;                                                         \
+        return false;                                                       \
+    }
+
+namespace {
+
+    int failures = 0;
+
+    constexpr uint32_t CodeAddr = 0x10000;
+    constexpr uint32_t DataAddr = 0x100000;
+    constexpr size_t Lanes = 8;
+
+    // One guest per lane, a0 is the lane's input
+    struct Guest {
+        std::unique_ptr<RISCVS::Machine> machine;
+        std::unique_ptr<RISCVS::Hart> hart;
+    };
+
+    Guest NewGuest(RISCVS::Assembler& as, size_t input) {
+        Guest guest;
+        guest.machine = std::make_unique<RISCVS::Machine>(as.Image(), CodeAddr);
+        guest.hart = std::make_unique<RISCVS::Hart>(*guest.machine, CodeAddr);
+        (*guest.hart)[RISCVS::Assembler::A0] = static_cast<int32_t>(input);
+        guest.hart->SetSyscallHandler([](RISCVS::Hart& hart) {
+            hart.Stop();
+            return true;
+        });
+        return guest;
+    }
+
+    // Lanes leave a data dependent loop one by one and rejoin the group at
+    // its exit, lane 2 exits early, odd and even lanes take the two sides
+    // of an if/else and lane 4 runs into an unknown instruction
+    RISCVS::Assembler DivergingGuest() {
+        using RISCVS::Assembler;
+        Assembler as{CodeAddr};
+        auto loop = as.NewLabel();
+        auto early = as.NewLabel();
+        auto even = as.NewLabel();
+        auto join = as.NewLabel();
+        auto call = as.NewLabel();
+        auto func = as.NewLabel();
+
+        as.Li(Assembler::S0, DataAddr);
+        as.SllI(Assembler::T0, Assembler::A0, 1);
+        as.Add(Assembler::T0, Assembler::T0, Assembler::A0);
+        as.AddI(Assembler::T0, Assembler::T0, 1);
+        as.Li(Assembler::T2, 0);
+        as.Bind(loop);
+        as.Add(Assembler::T2, Assembler::T2, Assembler::T0);
+        as.Xor(Assembler::T3, Assembler::T2, Assembler::A0);
+        as.Sw(Assembler::T3, Assembler::S0, 0);
+        as.Lw(Assembler::T4, Assembler::S0, 0);
+        as.Add(Assembler::T2, Assembler::T2, Assembler::T4);
+        as.AddI(Assembler::T0, Assembler::T0, -1);
+        as.Bnez(Assembler::T0, loop);
+
+        as.Li(Assembler::T5, 2);
+        as.Beq(Assembler::A0, Assembler::T5, early);
+        as.AndI(Assembler::T6, Assembler::A0, 1);
+        as.Beqz(Assembler::T6, even);
+        as.AddI(Assembler::T2, Assembler::T2, 100);
+        as.J(join);
+        as.Bind(even);
+        as.AddI(Assembler::T2, Assembler::T2, -7);
+        as.Bind(join);
+        as.Li(Assembler::T5, 4);
+        as.Bne(Assembler::A0, Assembler::T5, call);
+        as.Emit(0xFFFFFFFF);
+        as.Bind(call);
+        as.Jal(Assembler::RA, func);
+        as.Mv(Assembler::A1, Assembler::T2);
+        as.Li(Assembler::A0, 0);
+        as.Exit();
+
+        as.Bind(early);
+        as.Li(Assembler::A0, 77);
+        as.Exit();
+
+        as.Bind(func);
+        as.SllI(Assembler::T2, Assembler::T2, 1);
+        as.Ret();
+        return as;
+    }
+
+    // Lanes 1 and 5 branch off first and wait at tail, the others run a
+    // long loop and lanes 2, 3, 6 and 7 then wait further down the tail.
+    // They have retired more than the group of 1 and 5 that picks them up,
+    // so their budget ends the group early.
+    RISCVS::Assembler CatchUpGuest() {
+        using RISCVS::Assembler;
+        Assembler as{CodeAddr};
+        auto loop = as.NewLabel();
+        auto tail = as.NewLabel();
+        auto rest = as.NewLabel();
+
+        as.AndI(Assembler::T6, Assembler::A0, 3);
+        as.Li(Assembler::T5, 1);
+        as.Beq(Assembler::T6, Assembler::T5, tail);
+        as.Li(Assembler::T0, 100);
+        as.Bind(loop);
+        as.Add(Assembler::T1, Assembler::T1, Assembler::T0);
+        as.AddI(Assembler::T0, Assembler::T0, -1);
+        as.Bnez(Assembler::T0, loop);
+        as.AndI(Assembler::T6, Assembler::A0, 2);
+        as.Bnez(Assembler::T6, rest);
+        as.Exit();
+
+        as.Bind(tail);
+        for (int i = 0; i < 5; ++i) {
+            as.AddI(Assembler::T2, Assembler::T2, i);
+        }
+        as.Bind(rest);
+        for (int i = 0; i < 20; ++i) {
+            as.Xor(Assembler::T3, Assembler::T3, Assembler::A0);
+            as.AddI(Assembler::T3, Assembler::T3, i);
+        }
+        as.Exit();
+        return as;
+    }
+
+} // anon namespace
+
+namespace RISCVS {
+
+    // Every lane ends as Hart::Run leaves the same guest: result, pc and registers
+    bool TestLockstepRun(Assembler& as, uint64_t budget) {
+        std::cerr << "---------[]---------\n";
+        static int testIdx = 0;
+        testIdx++;
+
+        std::vector<Guest> scalar;
+        std::vector<Guest> lanes;
+        std::vector<Hart*> harts;
+        for (size_t lane = 0; lane < Lanes; ++lane) {
+            scalar.push_back(NewGuest(as, lane));
+            lanes.push_back(NewGuest(as, lane));
+            harts.push_back(lanes.back().hart.get());
+        }
+
+        Lockstep lockstep;
+        const std::vector<RunResult> results = lockstep.Run(harts, budget);
+        CHECK(results.size() == Lanes);
+        for (size_t lane = 0; lane < Lanes; ++lane) {
+            Hart& expected = *scalar[lane].hart;
+            Hart& actual = *harts[lane];
+            const RunResult reference = expected.Run(budget);
+            CHECK(results[lane].reason == reference.reason);
+            CHECK(results[lane].retired == reference.retired);
+            CHECK(results[lane].fault == reference.fault);
+            CHECK(actual.GetPC() == expected.GetPC());
+            for (Hart::RegisterIndex r = 0; r < Hart::NUM_REGISTER; ++r) {
+                CHECK(actual[r] == expected[r]);
+            }
+        }
+
+        // Lanes did split and rejoin
+        if (budget == UINT64_MAX) {
+            CHECK(lockstep.GetStats().splits != 0 && lockstep.GetStats().joins != 0);
+        }
+
+        return true;
+    }
+
+    // DivergingGuest takes every path it is written for
+    bool TestLockstepPaths(Assembler& as) {
+        std::cerr << "---------[]---------\n";
+        static int testIdx = 0;
+        testIdx++;
+
+        std::vector<Guest> lanes;
+        std::vector<Hart*> harts;
+        for (size_t lane = 0; lane < Lanes; ++lane) {
+            lanes.push_back(NewGuest(as, lane));
+            harts.push_back(lanes.back().hart.get());
+        }
+
+        Lockstep lockstep;
+        const std::vector<RunResult> results = lockstep.Run(harts);
+        CHECK(results[2].reason == StopReason::HALT && (*harts[2])[Assembler::A0] == 77);
+        CHECK(results[4].reason == StopReason::FAULT && !results[4].fault.empty());
+        CHECK(results[3].reason == StopReason::HALT && (*harts[3])[Assembler::A0] == 0);
+        CHECK(lockstep.GetStats().scalarSteps != 0 && lockstep.GetStats().laneSteps > lockstep.GetStats().steps);
+
+        return true;
+    }
+
+    int TestLockstep() {
+        failures = 0;
+
+        Assembler diverging = DivergingGuest();
+        Assembler catchUp = CatchUpGuest();
+        TestLockstepPaths(diverging);
+
+        // Budgets that end the run before, while and after lanes rejoin
+        for (Assembler* as : {&diverging, &catchUp}) {
+            TestLockstepRun(*as, UINT64_MAX);
+            for (uint64_t budget = 1; budget < 400; budget += 7) {
+                TestLockstepRun(*as, budget);
+            }
+        }
+
+        return failures; // number of failed tests
+    }
+
+} // RISCVS
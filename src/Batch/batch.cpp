@@ -0,0 +1,589 @@
+#include "batch.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <hart.hpp>
+#include <machine.hpp>
+
+#include "lockstep.hpp"
+
+namespace RISCVS {
+
+namespace {
+
+// RISC-V Linux syscall numbers
+constexpr uint32_t SYS_WRITE = 64;
+constexpr uint32_t SYS_EXIT = 93;
+constexpr uint32_t SYS_EXIT_GROUP = 94;
+
+constexpr Hart::RegisterIndex SP = 2;
+constexpr Hart::RegisterIndex A0 = 10;
+constexpr Hart::RegisterIndex A1 = 11;
+constexpr Hart::RegisterIndex A2 = 12;
+constexpr Hart::RegisterIndex A7 = 17;
+
+constexpr uint32_t STACK_TOP = 0xC0000000;
+
+// Just enough JSON for the job list: one flat object per line with string,
+// number and string array values, unknown keys are skipped
+class JobParser {
+public:
+    JobParser(std::string_view text, size_t line) : text(text), line(line) {}
+
+    BatchJob Parse() {
+        BatchJob job;
+        job.id = std::to_string(line);
+        bool pcSet = false;
+        bool imageSet = false;
+
+        Expect('{');
+        if (!Consume('}')) {
+            do {
+                const std::string key = String();
+                Expect(':');
+                if (key == "id") {
+                    job.id = Scalar();
+                } else if (key == "image") {
+                    job.image = String();
+                    imageSet = true;
+                } else if (key == "load") {
+                    job.load = Number();
+                } else if (key == "pc") {
+                    job.pc = static_cast<int32_t>(Number());
+                    pcSet = true;
+                } else if (key == "budget") {
+                    job.budget = Number();
+                } else if (key == "args") {
+                    job.args = Strings();
+                } else {
+                    SkipValue();
+                }
+            } while (Consume(','));
+            Expect('}');
+        }
+
+        SkipSpace();
+        if (pos != text.size()) {
+            Fail("trailing characters");
+        }
+        if (!imageSet) {
+            Fail("no image");
+        }
+        if (!pcSet) {
+            job.pc = static_cast<int32_t>(job.load);
+        }
+        return job;
+    }
+
+private:
+    [[noreturn]] void Fail(std::string_view what) const {
+        throw std::runtime_error("Job list line " + std::to_string(line) + ": " + std::string(what));
+    }
+
+    void SkipSpace() {
+        while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\r')) {
+            ++pos;
+        }
+    }
+
+    bool Consume(char c) {
+        SkipSpace();
+        if (pos < text.size() && text[pos] == c) {
+            ++pos;
+            return true;
+        }
+        return false;
+    }
+
+    void Expect(char c) {
+        if (!Consume(c)) {
+            Fail(std::string("expected '") + c + '\'');
+        }
+    }
+
+    std::string String() {
+        Expect('"');
+        std::string value;
+        while (pos < text.size() && text[pos] != '"') {
+            char c = text[pos++];
+            if (c == '\\') {
+                if (pos >= text.size()) {
+                    break;
+                }
+                c = text[pos++];
+                switch (c) {
+                    case 'n': value += '\n'; break;
+                    case 't': value += '\t'; break;
+                    case 'r': value += '\r'; break;
+                    case 'b': value += '\b'; break;
+                    case 'f': value += '\f'; break;
+                    case 'u': AppendCodePoint(value); break;
+                    default: value += c; break;
+                }
+            } else {
+                value += c;
+            }
+        }
+        Expect('"');
+        return value;
+    }
+
+    // \uXXXX as UTF-8, surrogate pairs are not combined
+    void AppendCodePoint(std::string& value) {
+        if (pos + 4 > text.size()) {
+            Fail("bad \\u escape");
+        }
+        const uint32_t code = std::stoul(std::string(text.substr(pos, 4)), nullptr, 16);
+        pos += 4;
+        if (code < 0x80) {
+            value += static_cast<char>(code);
+        } else if (code < 0x800) {
+            value += static_cast<char>(0xC0 | code >> 6U);
+            value += static_cast<char>(0x80 | (code & 0x3FU));
+        } else {
+            value += static_cast<char>(0xE0 | code >> 12U);
+            value += static_cast<char>(0x80 | (code >> 6U & 0x3FU));
+            value += static_cast<char>(0x80 | (code & 0x3FU));
+        }
+    }
+
+    // A number or a bare literal as text, or a string
+    std::string Scalar() {
+        SkipSpace();
+        if (pos < text.size() && text[pos] == '"') {
+            return String();
+        }
+        const size_t start = pos;
+        while (pos < text.size() && text[pos] != ',' && text[pos] != '}' && text[pos] != ']' &&
+               text[pos] != ' ' && text[pos] != '\t') {
+            ++pos;
+        }
+        if (pos == start) {
+            Fail("expected a value");
+        }
+        return std::string(text.substr(start, pos - start));
+    }
+
+    uint64_t Number() {
+        const std::string value = Scalar();
+        try {
+            size_t used = 0;
+            const uint64_t number = std::stoull(value, &used, 0);
+            if (used == value.size()) {
+                return number;
+            }
+        } catch (const std::logic_error&) {
+        }
+        Fail("bad number " + value);
+    }
+
+    std::vector<std::string> Strings() {
+        std::vector<std::string> values;
+        Expect('[');
+        if (!Consume(']')) {
+            do {
+                values.push_back(String());
+            } while (Consume(','));
+            Expect(']');
+        }
+        return values;
+    }
+
+    void SkipValue() {
+        SkipSpace();
+        if (pos < text.size() && (text[pos] == '[' || text[pos] == '{')) {
+            const char close = text[pos] == '[' ? ']' : '}';
+            ++pos;
+            if (!Consume(close)) {
+                do {
+                    if (close == '}') {
+                        String();
+                        Expect(':');
+                    }
+                    SkipValue();
+                } while (Consume(','));
+                Expect(close);
+            }
+        } else {
+            Scalar();
+        }
+    }
+
+    std::string_view text;
+    size_t line;
+    size_t pos = 0;
+};
+
+void AppendJsonString(std::string& out, std::string_view text) {
+    constexpr char HEX[] = "0123456789abcdef";
+    out += '"';
+    for (const char c : text) {
+        const auto byte = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c == '\n') {
+            out += "\\n";
+        } else if (byte < 0x20 || byte == 0x7F) {
+            out += "\\u00";
+            out += HEX[byte >> 4U];
+            out += HEX[byte & 0xFU];
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+// The cores this process may run on, in order
+std::vector<int> AvailableCpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    if (cpus.empty()) {
+        cpus.push_back(0);
+    }
+    return cpus;
+}
+
+void PinTo(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    // Best effort: an unpinned thread is still correct
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+struct Image {
+    std::vector<uint8_t> bytes;
+    std::string error;
+};
+
+std::unordered_map<std::string, Image> LoadImages(const std::vector<BatchJob>& jobs) {
+    std::unordered_map<std::string, Image> images;
+    for (const BatchJob& job : jobs) {
+        if (images.contains(job.image)) {
+            continue;
+        }
+        Image& image = images[job.image];
+        std::ifstream file{job.image, std::ios::binary};
+        if (!file) {
+            image.error = "cannot open " + job.image;
+            continue;
+        }
+        image.bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    return images;
+}
+
+// What the guest sent through syscalls during one job
+struct GuestIo {
+    int32_t exitStatus = 0;
+    std::string output;
+    size_t limit = 0;
+};
+
+bool ServeSyscall(Machine& machine, Hart& hart, GuestIo& io) {
+    switch (static_cast<uint32_t>(hart[A7])) {
+        case SYS_EXIT:
+        case SYS_EXIT_GROUP:
+            io.exitStatus = static_cast<int32_t>(hart[A0]);
+            hart.Stop();
+            break;
+        case SYS_WRITE: {
+            const uint32_t fd = hart[A0];
+            const uint32_t count = hart[A2];
+            if (fd != 1 && fd != 2) {
+                hart[A0] = static_cast<uint32_t>(-EBADF);
+                break;
+            }
+            const size_t keep = std::min<size_t>(count, io.limit - std::min(io.limit, io.output.size()));
+            if (keep != 0) {
+                std::vector<uint8_t> buffer(keep);
+                const std::span<const uint8_t> bytes = machine.ReadBlock(hart[A1], buffer);
+                io.output.append(bytes.begin(), bytes.end());
+            }
+            hart[A0] = count;
+            break;
+        }
+        default:
+            hart[A0] = static_cast<uint32_t>(-ENOSYS);
+            break;
+    }
+    return true;
+}
+
+// sp -> argc, argv[0..argc), NULL, envp NULL, auxv AT_NULL; strings above.
+// The memory was just reset, so terminators are already zero.
+void SetupStack(Machine& machine, Hart& hart, const std::vector<std::string>& args) {
+    uint32_t top = STACK_TOP;
+    std::vector<uint32_t> words{static_cast<uint32_t>(args.size())};
+    for (const std::string& arg : args) {
+        top -= arg.size() + 1;
+        machine.WriteBlock(top, std::span{reinterpret_cast<const uint8_t*>(arg.data()), arg.size()});
+        words.push_back(top);
+    }
+    words.insert(words.end(), {0U, 0U, 0U, 0U});
+
+    const uint32_t sp = (top - words.size() * sizeof(uint32_t)) & ~15U;
+    machine.WriteBlock(sp, std::span{reinterpret_cast<const uint8_t*>(words.data()), words.size() * sizeof(uint32_t)});
+    hart[SP] = sp;
+    hart[A0] = static_cast<uint32_t>(args.size());
+    hart[A1] = sp + sizeof(uint32_t);
+}
+
+// Guest state a thread reuses job after job, one per lockstep lane
+struct Slot {
+    Machine machine{std::span<const uint8_t>{}, 0};
+    Hart hart{machine};
+    GuestIo io;
+};
+
+struct Queue {
+    std::mutex mutex;
+    std::deque<size_t> jobs;
+};
+
+// Shared state of one Batch::Run()
+struct Pool {
+    const std::vector<BatchJob>& jobs;
+    const Batch::Options& options;
+    const std::unordered_map<std::string, Image>& images;
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<int> cpus;
+
+    std::mutex outputMutex;
+    std::ostream& out;
+
+    std::atomic<uint64_t> steals{0};
+    std::atomic<uint64_t> failed{0};
+    std::atomic<uint64_t> retired{0};
+
+    // Jobs that can run in one lockstep group: same code, entry and budget
+    bool Compatible(size_t first, size_t other) const {
+        const BatchJob& a = jobs[first];
+        const BatchJob& b = jobs[other];
+        return a.image == b.image && a.load == b.load && a.pc == b.pc && a.budget == b.budget;
+    }
+
+    // Up to count compatible jobs from the front of the own queue or, once
+    // it is empty, from the back of another one
+    bool Next(size_t self, size_t count, std::vector<size_t>& group) {
+        group.clear();
+        {
+            Queue& own = *queues[self];
+            std::lock_guard lock{own.mutex};
+            while (!own.jobs.empty() && group.size() < count &&
+                   (group.empty() || Compatible(group.front(), own.jobs.front()))) {
+                group.push_back(own.jobs.front());
+                own.jobs.pop_front();
+            }
+            if (!group.empty()) {
+                return true;
+            }
+        }
+
+        // Every job is queued up front: once all queues are empty, done
+        for (size_t i = 1; i < queues.size(); ++i) {
+            Queue& victim = *queues[(self + i) % queues.size()];
+            std::lock_guard lock{victim.mutex};
+            while (!victim.jobs.empty() && group.size() < count &&
+                   (group.empty() || Compatible(group.front(), victim.jobs.back()))) {
+                group.push_back(victim.jobs.back());
+                victim.jobs.pop_back();
+            }
+            if (!group.empty()) {
+                steals.fetch_add(group.size(), std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Work(size_t self) {
+        if (options.pin) {
+            PinTo(cpus[self % cpus.size()]);
+        }
+
+        std::vector<std::unique_ptr<Slot>> slots;
+        for (size_t lane = 0; lane < std::clamp<size_t>(options.lanes, 1, Lockstep::LANES); ++lane) {
+            Slot& slot = *slots.emplace_back(std::make_unique<Slot>());
+            slot.hart.SetSyscallHandler([&slot](Hart& hart) {
+                return ServeSyscall(slot.machine, hart, slot.io);
+            });
+        }
+        Lockstep lockstep;
+
+        std::vector<size_t> group;
+        std::string lines;
+        while (Next(self, slots.size(), group)) {
+            lines.clear();
+            Execute(group, slots, lockstep, lines);
+            std::lock_guard lock{outputMutex};
+            out << lines;
+        }
+    }
+
+    // Empty if the job is ready to run in slot
+    std::string Prepare(const BatchJob& job, Slot& slot) const {
+        slot.io = GuestIo{.limit = options.outputLimit};
+        const Image& image = images.at(job.image);
+        if (!image.error.empty()) {
+            return image.error;
+        }
+        try {
+            slot.machine.Reset();
+            slot.machine.WriteBlock(job.load, image.bytes);
+            slot.hart.Reset(job.pc);
+            SetupStack(slot.machine, slot.hart, job.args);
+        } catch (const std::exception& exception) {
+            return exception.what();
+        }
+        return {};
+    }
+
+    void Execute(const std::vector<size_t>& group, const std::vector<std::unique_ptr<Slot>>& slots,
+                 Lockstep& lockstep, std::string& lines) {
+        const auto start = std::chrono::steady_clock::now();
+
+        std::vector<std::string> errors(group.size());
+        std::vector<Hart*> ready;
+        for (size_t i = 0; i < group.size(); ++i) {
+            errors[i] = Prepare(jobs[group[i]], *slots[i]);
+            if (errors[i].empty()) {
+                ready.push_back(&slots[i]->hart);
+            }
+        }
+
+        std::vector<RunResult> results;
+        const uint64_t budget = jobs[group.front()].budget;
+        if (ready.size() == 1) {
+            results.push_back(ready.front()->Run(budget));
+        } else if (ready.size() > 1) {
+            results = lockstep.Run(ready, budget);
+        }
+
+        const auto micros = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        auto result = results.begin();
+        for (size_t i = 0; i < group.size(); ++i) {
+            Report(group[i], errors[i].empty() ? *result++ : RunResult{}, errors[i], slots[i]->io, micros, lines);
+        }
+    }
+
+    void Report(size_t index, const RunResult& result, const std::string& error, const GuestIo& io, int64_t micros,
+                std::string& line) {
+        const BatchJob& job = jobs[index];
+        const bool ok = error.empty() && result.reason == StopReason::HALT && io.exitStatus == 0;
+        if (!ok) {
+            failed.fetch_add(1, std::memory_order_relaxed);
+        }
+        retired.fetch_add(result.retired, std::memory_order_relaxed);
+
+        line += "{\"job\": ";
+        AppendJsonString(line, job.id);
+        line += ", \"line\": " + std::to_string(index + 1);
+        line += ", \"status\": ";
+        AppendJsonString(line, error.empty() ? ToString(result.reason) : "error");
+        if (result.reason == StopReason::HALT) {
+            line += ", \"exit\": " + std::to_string(io.exitStatus);
+        }
+        line += ", \"retired\": " + std::to_string(result.retired);
+        line += ", \"micros\": " + std::to_string(micros);
+        if (!io.output.empty()) {
+            line += ", \"output\": ";
+            AppendJsonString(line, io.output);
+        }
+        if (!result.fault.empty() || !error.empty()) {
+            line += ", \"error\": ";
+            AppendJsonString(line, error.empty() ? result.fault : error);
+        }
+        line += "}\n";
+    }
+};
+
+} // anon namespace
+
+std::vector<BatchJob> ReadJobs(std::istream& in) {
+    std::vector<BatchJob> jobs;
+    std::string text;
+    for (size_t line = 1; std::getline(in, text); ++line) {
+        if (text.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+        jobs.push_back(JobParser{text, line}.Parse());
+    }
+    return jobs;
+}
+
+double Batch::Summary::JobsPerSecond() const {
+    const double seconds = std::chrono::duration<double>(duration).count();
+    return seconds == 0 ? 0 : jobs / seconds;
+}
+
+Batch::Batch(std::vector<BatchJob> jobs, Options options) : jobs(std::move(jobs)), options(options) {}
+
+Batch::Summary Batch::Run(std::ostream& out) {
+    const auto start = std::chrono::steady_clock::now();
+    const std::unordered_map<std::string, Image> images = LoadImages(jobs);
+
+    Pool pool{.jobs = jobs, .options = options, .images = images, .cpus = AvailableCpus(), .out = out};
+    const size_t threads = std::max<size_t>(1, std::min(jobs.size(), options.threads != 0 ? options.threads : pool.cpus.size()));
+    for (size_t i = 0; i < threads; ++i) {
+        pool.queues.push_back(std::make_unique<Queue>());
+    }
+    // Contiguous runs, so neighbouring jobs (often the same image) stay on one thread
+    for (size_t job = 0; job < jobs.size(); ++job) {
+        pool.queues[job * threads / jobs.size()]->jobs.push_back(job);
+    }
+
+    {
+        std::vector<std::jthread> workers;
+        for (size_t i = 0; i < threads; ++i) {
+            workers.emplace_back([&pool, i] {
+                pool.Work(i);
+            });
+        }
+    }
+    out.flush();
+
+    Summary summary;
+    summary.jobs = jobs.size();
+    summary.failed = pool.failed;
+    summary.retired = pool.retired;
+    summary.steals = pool.steals;
+    summary.duration = std::chrono::steady_clock::now() - start;
+    return summary;
+}
+
+void Batch::Report(std::ostream& out, const Summary& summary) {
+    out << "++++++++BATCH++++++++\n";
+    out << "Jobs: " << summary.jobs << ", failed: " << summary.failed << '\n';
+    out << "Time: " << std::chrono::duration_cast<std::chrono::milliseconds>(summary.duration).count()
+        << " milliseconds\n";
+    out << "Jobs per second: " << static_cast<uint64_t>(summary.JobsPerSecond()) << '\n';
+    out << "Executed instructions: " << summary.retired << '\n';
+    out << "Steals: " << summary.steals << '\n';
+}
+
+} // namespace RISCVS
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace RISCVS {
+
+// One guest program of a batch, a JSON object per line of the job list:
+//   {"id": "t1", "image": "t1.bin", "load": "0x10000", "pc": "0x10000",
+//    "args": ["t1", "-v"], "budget": 1000000}
+// Only image is required; numbers may also be "0x..." strings, pc defaults
+// to load and id to the line number.
+struct BatchJob {
+    constexpr static uint32_t DEFAULT_LOAD = 0x10000;
+
+    std::string id;
+    std::string image;
+    uint32_t load = DEFAULT_LOAD;
+    int32_t pc = DEFAULT_LOAD;
+    std::vector<std::string> args;
+    uint64_t budget = UINT64_MAX;
+};
+
+// Throws std::runtime_error on malformed lines, blank lines are skipped
+std::vector<BatchJob> ReadJobs(std::istream& in);
+
+// Runs many short, independent guests for throughput. Every host thread
+// owns one Machine/Hart pair that is reset between jobs, so no job pays
+// for a process or a 16 GiB mapping. Jobs are dealt out in contiguous
+// runs to per-thread deques; a thread takes from the front of its own and,
+// once empty, steals from the back of the others.
+//
+// Guests start with a Linux-like stack (sp -> argc, argv, envp, auxv; also
+// a0 = argc, a1 = argv). Only exit/exit_group and write to stdout/stderr
+// are served, other syscalls return -ENOSYS: jobs never reach the host.
+// One JSON line per job is written in completion order:
+//   {"job": "t1", "line": 1, "status": "halt", "exit": 0, "retired": 1234,
+//    "micros": 15, "output": "..."}
+//
+// With lanes > 1 a thread takes up to lanes neighbouring jobs with the same
+// image, load, pc and budget (a parameter sweep) and runs them in Lockstep;
+// micros is then the time of the whole group.
+class Batch {
+public:
+    struct Options {
+        size_t threads;             // 0: one per available core
+        bool pin;                   // thread i on the i-th available core
+        size_t outputLimit;         // bytes of guest output kept per job
+        size_t lanes = 1;           // jobs per lockstep group, up to Lockstep::LANES
+    };
+
+    struct Summary {
+        size_t jobs = 0;
+        size_t failed = 0;          // not halted with exit status 0
+        uint64_t retired = 0;
+        uint64_t steals = 0;
+        std::chrono::nanoseconds duration{0};
+
+        double JobsPerSecond() const;
+    };
+
+    Batch(std::vector<BatchJob> jobs, Options options);
+
+    Summary Run(std::ostream& out);
+
+    static void Report(std::ostream& out, const Summary& summary);
+
+private:
+    std::vector<BatchJob> jobs;
+    Options options;
+};
+
+} // namespace RISCVS
@@ -0,0 +1,428 @@
+#include "lockstep.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+namespace RISCVS {
+
+namespace {
+
+constexpr uint32_t SHIFT_MASK = 0b11111U;
+
+// Instructions are word aligned, no lane waits at an odd pc
+constexpr int32_t NOT_WAITING = 1;
+
+} // anon namespace
+
+Lockstep::Lockstep() : decoded(DECODED) {}
+
+std::vector<RunResult> Lockstep::Run(std::span<Hart* const> harts, uint64_t budget) {
+    if (harts.empty() || harts.size() > LANES) {
+        throw std::runtime_error("Lockstep needs 1 to " + std::to_string(LANES) + " harts");
+    }
+    this->harts = harts;
+    this->budget = budget;
+    results.assign(harts.size(), RunResult{});
+    retired.fill(0);
+    pending = 0;
+    waitingPc.fill(NOT_WAITING);
+    for (size_t lane = 0; lane < harts.size(); ++lane) {
+        if (harts[lane]->IsStop()) {
+            Finish(lane, RunResult{.reason = harts[lane]->GetStopReason()});
+        } else {
+            Wait(lane, harts[lane]->GetPC());
+        }
+    }
+
+    while (pending != 0) {
+        // The lowest waiting lane leads, every waiting lane at its pc joins
+        const size_t leader = std::countr_zero(pending);
+        const int32_t pc = harts[leader]->GetPC();
+        Mask group = 0;
+        uint64_t limit = UINT64_MAX;
+        for (Mask lanes = pending; lanes != 0; lanes &= lanes - 1) {
+            const size_t lane = std::countr_zero(lanes);
+            if (waitingPc[lane] == pc) {
+                group |= Mask{1} << lane;
+                limit = std::min(limit, budget - retired[lane]);
+                waitingPc[lane] = NOT_WAITING;
+            }
+        }
+        pending &= ~group;
+        ++stats.groups;
+
+        if (std::has_single_bit(group)) {
+            RunResult result = harts[leader]->Run(limit);
+            result.retired += retired[leader];
+            Finish(leader, result);
+        } else {
+            RunGroup(group, pc, limit);
+        }
+    }
+    return results;
+}
+
+template<typename Func>
+void Lockstep::Compute(uint16_t rd, Func&& func) {
+    // All lanes, also the inactive ones: a fixed trip count vectorizes,
+    // and the registers of a lane outside the group are not live
+    Lane result;
+    for (size_t lane = 0; lane < LANES; ++lane) {
+        result[lane] = func(lane);
+    }
+    if (rd != 0) {
+        reg[rd] = result;
+    }
+}
+
+template<typename Func>
+Lockstep::Mask Lockstep::Taken(Func&& func) const {
+    Mask taken = 0;
+    for (size_t lane = 0; lane < LANES; ++lane) {
+        taken |= static_cast<Mask>(func(lane)) << lane;
+    }
+    return taken;
+}
+
+void Lockstep::RunGroup(Mask group, int32_t pc, uint64_t limit) {
+    for (Mask lanes = group; lanes != 0; lanes &= lanes - 1) {
+        LoadLane(std::countr_zero(lanes));
+    }
+
+    Mask active = group;
+    uint64_t steps = 0;
+    while (active != 0 && steps < limit) {
+        if (pending != 0) {
+            const Mask joining = pending & Taken([&](size_t l) { return waitingPc[l] == pc; });
+            if (joining != 0) {
+                Join(joining, active, steps, limit);
+            }
+        }
+        ++steps;
+        stats.laneSteps += std::popcount(active);
+
+        uint32_t binInstruction = 0;
+        try {
+            binInstruction = harts[std::countr_zero(active)]->Load(pc);
+        } catch (...) {
+            // Every lane faults the same way on its own hart
+            ScalarStep(active, pc, steps);
+            continue;
+        }
+        Op& op = decoded[(static_cast<uint32_t>(pc) >> 2) & (DECODED - 1)];
+        if (op.pc != pc || op.code != binInstruction) {
+            op = Decode(pc, binInstruction);
+        }
+
+        const Lane& a = reg[op.rs1];
+        const Lane& b = reg[op.rs2];
+        const uint32_t imm = op.imm;
+        const int32_t next = pc + static_cast<int32_t>(sizeof(uint32_t));
+
+        // Lanes that disagree with the leader's path leave the group
+        const auto branch = [&](Mask taken) {
+            taken &= active;
+            if (taken == 0 || taken == active) {
+                pc = taken == 0 ? next : pc + op.imm;
+                return;
+            }
+            // The lower pc first: lanes leaving a loop wait for the others
+            // at its exit, lanes skipping code wait where the group arrives
+            const int32_t target = pc + op.imm;
+            const bool follow = target < next;
+            const Mask leaving = follow ? active & ~taken : taken;
+            for (Mask lanes = leaving; lanes != 0; lanes &= lanes - 1) {
+                Leave(std::countr_zero(lanes), follow ? next : target, steps);
+            }
+            active &= ~leaving;
+            pc = follow ? target : next;
+        };
+
+        switch (op.kind) {
+            case Kind::ADD:   Compute(op.rd, [&](size_t l) { return a[l] + b[l]; }); break;
+            case Kind::SUB:   Compute(op.rd, [&](size_t l) { return a[l] - b[l]; }); break;
+            case Kind::XOR:   Compute(op.rd, [&](size_t l) { return a[l] ^ b[l]; }); break;
+            case Kind::OR:    Compute(op.rd, [&](size_t l) { return a[l] | b[l]; }); break;
+            case Kind::AND:   Compute(op.rd, [&](size_t l) { return a[l] & b[l]; }); break;
+            case Kind::SLL:   Compute(op.rd, [&](size_t l) { return a[l] << (b[l] & SHIFT_MASK); }); break;
+            case Kind::SRL:   Compute(op.rd, [&](size_t l) { return a[l] >> (b[l] & SHIFT_MASK); }); break;
+            case Kind::SRA:
+                Compute(op.rd, [&](size_t l) {
+                    return static_cast<uint32_t>(static_cast<int32_t>(a[l]) >> (b[l] & SHIFT_MASK));
+                });
+                break;
+            case Kind::SLT:
+                Compute(op.rd, [&](size_t l) {
+                    return static_cast<uint32_t>(static_cast<int32_t>(a[l]) < static_cast<int32_t>(b[l]));
+                });
+                break;
+            case Kind::SLTU:  Compute(op.rd, [&](size_t l) { return static_cast<uint32_t>(a[l] < b[l]); }); break;
+            case Kind::ADDI:  Compute(op.rd, [&](size_t l) { return a[l] + imm; }); break;
+            case Kind::XORI:  Compute(op.rd, [&](size_t l) { return a[l] ^ imm; }); break;
+            case Kind::ORI:   Compute(op.rd, [&](size_t l) { return a[l] | imm; }); break;
+            case Kind::ANDI:  Compute(op.rd, [&](size_t l) { return a[l] & imm; }); break;
+            case Kind::SLLI:  Compute(op.rd, [&](size_t l) { return a[l] << (imm & SHIFT_MASK); }); break;
+            case Kind::SRLI:  Compute(op.rd, [&](size_t l) { return a[l] >> (imm & SHIFT_MASK); }); break;
+            case Kind::SRAI:
+                Compute(op.rd, [&](size_t l) {
+                    return static_cast<uint32_t>(static_cast<int32_t>(a[l]) >> (imm & SHIFT_MASK));
+                });
+                break;
+            case Kind::SLTI:
+                Compute(op.rd, [&](size_t l) { return static_cast<uint32_t>(static_cast<int32_t>(a[l]) < op.imm); });
+                break;
+            case Kind::SLTIU: Compute(op.rd, [&](size_t l) { return static_cast<uint32_t>(a[l] < imm); }); break;
+            case Kind::LUI:   Compute(op.rd, [&](size_t) { return imm << 12U; }); break;
+            case Kind::AUIPC:
+                Compute(op.rd, [&](size_t) { return static_cast<uint32_t>(pc) + (imm << 12U); });
+                break;
+
+            case Kind::LOAD:
+            case Kind::SB:
+            case Kind::SH:
+            case Kind::SW:
+                if (!Memory(op, active)) {
+                    ScalarStep(active, pc, steps);
+                    continue;
+                }
+                break;
+
+            case Kind::BEQ:  branch(Taken([&](size_t l) { return a[l] == b[l]; })); continue;
+            case Kind::BNE:  branch(Taken([&](size_t l) { return a[l] != b[l]; })); continue;
+            case Kind::BLT:
+                branch(Taken([&](size_t l) { return static_cast<int32_t>(a[l]) < static_cast<int32_t>(b[l]); }));
+                continue;
+            case Kind::BGE:
+                branch(Taken([&](size_t l) { return static_cast<int32_t>(a[l]) >= static_cast<int32_t>(b[l]); }));
+                continue;
+            case Kind::BLTU: branch(Taken([&](size_t l) { return a[l] < b[l]; })); continue;
+            case Kind::BGEU: branch(Taken([&](size_t l) { return a[l] >= b[l]; })); continue;
+
+            case Kind::JAL:
+                Compute(op.rd, [&](size_t) { return static_cast<uint32_t>(next); });
+                // As InstructionSet::Jal: a zero offset falls through
+                pc = op.imm == 0 ? next : pc + op.imm;
+                continue;
+            case Kind::JALR: {
+                // rd may alias rs1, read the targets first
+                Lane targets;
+                for (size_t l = 0; l < LANES; ++l) {
+                    targets[l] = (a[l] + imm) & ~1U;
+                }
+                Compute(op.rd, [&](size_t) { return static_cast<uint32_t>(next); });
+                pc = static_cast<int32_t>(targets[std::countr_zero(active)]);
+                for (Mask lanes = active; lanes != 0; lanes &= lanes - 1) {
+                    const size_t lane = std::countr_zero(lanes);
+                    if (static_cast<int32_t>(targets[lane]) != pc) {
+                        Leave(lane, static_cast<int32_t>(targets[lane]), steps);
+                        active &= ~(Mask{1} << lane);
+                    }
+                }
+                continue;
+            }
+
+            case Kind::FENCE:
+                // Lanes share no memory
+                break;
+
+            case Kind::SCALAR:
+                ScalarStep(active, pc, steps);
+                continue;
+        }
+        pc = next;
+    }
+
+    stats.steps += steps;
+    for (Mask lanes = active; lanes != 0; lanes &= lanes - 1) {
+        const size_t lane = std::countr_zero(lanes);
+        StoreLane(lane);
+        harts[lane]->SetPC(pc);
+        retired[lane] += steps;
+        if (retired[lane] == budget) {
+            Finish(lane, RunResult{.reason = StopReason::BUDGET, .retired = retired[lane]});
+        } else {
+            Wait(lane, pc);
+        }
+    }
+}
+
+// False if a lane faulted: the instruction is then repeated on the harts,
+// which report the fault (a store repeated on the other lanes is harmless)
+bool Lockstep::Memory(const Op& op, Mask active) {
+    Lane loaded{};
+    try {
+        for (Mask lanes = active; lanes != 0; lanes &= lanes - 1) {
+            const size_t lane = std::countr_zero(lanes);
+            const Hart& hart = *harts[lane];
+            const int32_t address = static_cast<int32_t>(reg[op.rs1][lane] + static_cast<uint32_t>(op.imm));
+            const uint32_t value = reg[op.rs2][lane];
+            switch (op.kind) {
+                case Kind::LOAD: loaded[lane] = hart.Load(address); break;
+                case Kind::SB:   hart.Store<Byte>(address, value & 0xFFU); break;
+                case Kind::SH:   hart.Store<Half>(address, value & 0xFFFFU); break;
+                case Kind::SW:   hart.Store<Word>(address, value); break;
+                default: break;
+            }
+        }
+    } catch (...) {
+        return false;
+    }
+    if (op.kind == Kind::LOAD) {
+        Compute(op.rd, [&](size_t l) { return loaded[l]; });
+    }
+    return true;
+}
+
+// One instruction on the harts of the active lanes; lanes that stop
+// finish, lanes that end up away from the leader's pc leave
+void Lockstep::ScalarStep(Mask& active, int32_t& pc, uint64_t steps) {
+    ++stats.scalarSteps;
+    for (Mask lanes = active; lanes != 0; lanes &= lanes - 1) {
+        const size_t lane = std::countr_zero(lanes);
+        Hart& hart = *harts[lane];
+        StoreLane(lane);
+        hart.SetPC(pc);
+        RunResult result = hart.Run(1);
+        if (hart.IsStop()) {
+            result.retired += retired[lane] + steps - 1;
+            Finish(lane, result);
+            active &= ~(Mask{1} << lane);
+        }
+    }
+    if (active == 0) {
+        return;
+    }
+
+    pc = harts[std::countr_zero(active)]->GetPC();
+    for (Mask lanes = active; lanes != 0; lanes &= lanes - 1) {
+        const size_t lane = std::countr_zero(lanes);
+        if (harts[lane]->GetPC() == pc) {
+            LoadLane(lane);
+        } else {
+            retired[lane] += steps;
+            Wait(lane, harts[lane]->GetPC());
+            active &= ~(Mask{1} << lane);
+            ++stats.splits;
+        }
+    }
+}
+
+void Lockstep::Leave(size_t lane, int32_t pc, uint64_t steps) {
+    StoreLane(lane);
+    harts[lane]->SetPC(pc);
+    retired[lane] += steps;
+    Wait(lane, pc);
+    ++stats.splits;
+}
+
+void Lockstep::Wait(size_t lane, int32_t pc) {
+    waitingPc[lane] = pc;
+    pending |= Mask{1} << lane;
+}
+
+// The joining lanes count the group's steps from now on: retired is offset
+// by the steps already taken (modulo 2^64) and the group may not run past
+// their budget
+void Lockstep::Join(Mask lanes, Mask& active, uint64_t steps, uint64_t& limit) {
+    for (; lanes != 0; lanes &= lanes - 1) {
+        const size_t lane = std::countr_zero(lanes);
+        LoadLane(lane);
+        limit = std::min(limit, steps + (budget - retired[lane]));
+        retired[lane] -= steps;
+        waitingPc[lane] = NOT_WAITING;
+        pending &= ~(Mask{1} << lane);
+        active |= Mask{1} << lane;
+        ++stats.joins;
+    }
+}
+
+void Lockstep::Finish(size_t lane, const RunResult& result) {
+    results[lane] = result;
+}
+
+void Lockstep::LoadLane(size_t lane) {
+    Hart& hart = *harts[lane];
+    for (Hart::RegisterIndex r = 0; r < Hart::NUM_REGISTER; ++r) {
+        reg[r][lane] = hart[r];
+    }
+}
+
+void Lockstep::StoreLane(size_t lane) {
+    Hart& hart = *harts[lane];
+    for (Hart::RegisterIndex r = 1; r < Hart::NUM_REGISTER; ++r) {
+        hart[r] = reg[r][lane];
+    }
+}
+
+Lockstep::Op Lockstep::Decode(int32_t pc, uint32_t binInstruction) {
+    struct KindOf {
+        Decoder::Handler handler;
+        Kind kind;
+    };
+    using namespace InstructionSet;
+    static constexpr KindOf KINDS[] = {
+        {Add, Kind::ADD}, {Sub, Kind::SUB}, {Xor, Kind::XOR}, {Or, Kind::OR}, {And, Kind::AND},
+        {Sll, Kind::SLL}, {Srl, Kind::SRL}, {Sra, Kind::SRA}, {Slt, Kind::SLT}, {Sltu, Kind::SLTU},
+        {AddI, Kind::ADDI}, {XorI, Kind::XORI}, {OrI, Kind::ORI}, {AndI, Kind::ANDI},
+        {SllI, Kind::SLLI}, {SrlI, Kind::SRLI}, {SraI, Kind::SRAI}, {SltI, Kind::SLTI}, {SltIU, Kind::SLTIU},
+        {Lui, Kind::LUI}, {AuiPC, Kind::AUIPC},
+        // Every load is a word load, as in InstructionSet
+        {Lb, Kind::LOAD}, {Lh, Kind::LOAD}, {Lw, Kind::LOAD}, {Lbu, Kind::LOAD}, {Lhu, Kind::LOAD},
+        {Sb, Kind::SB}, {Sh, Kind::SH}, {Sw, Kind::SW},
+        {Beq, Kind::BEQ}, {Bne, Kind::BNE}, {Blt, Kind::BLT}, {Bge, Kind::BGE}, {BltU, Kind::BLTU}, {BgeU, Kind::BGEU},
+        {Jal, Kind::JAL}, {Jalr, Kind::JALR},
+        {Fence, Kind::FENCE},
+    };
+
+    Op op{.pc = pc, .code = binInstruction};
+    DecodeImage::Entry entry;
+    try {
+        entry = DecodeImage::Decode(binInstruction);
+    } catch (const std::bad_function_call&) {
+        // Stepped on the harts, which report the unknown instruction
+        return op;
+    }
+    const auto* found = std::find_if(std::begin(KINDS), std::end(KINDS),
+                                     [&entry](const KindOf& kindOf) { return kindOf.handler == entry.PFN_Instruction; });
+    if (found == std::end(KINDS)) {
+        return op;
+    }
+
+    op.kind = found->kind;
+    const auto regIdx = [](const Instruction::Param& param) { return std::get<Hart::RegisterIndex>(param); };
+    const auto immediate = [](const Instruction::Param& param) { return std::get<Immediate>(param); };
+    switch (op.kind) {
+        case Kind::LUI:
+        case Kind::AUIPC:
+        case Kind::JAL:
+            op.rd = regIdx(entry.param1);
+            op.imm = immediate(entry.param2);
+            break;
+        case Kind::SB: case Kind::SH: case Kind::SW:
+        case Kind::BEQ: case Kind::BNE: case Kind::BLT: case Kind::BGE: case Kind::BLTU: case Kind::BGEU:
+            op.rs1 = regIdx(entry.param1);
+            op.rs2 = regIdx(entry.param2);
+            op.imm = immediate(entry.param3);
+            break;
+        case Kind::ADD: case Kind::SUB: case Kind::XOR: case Kind::OR: case Kind::AND:
+        case Kind::SLL: case Kind::SRL: case Kind::SRA: case Kind::SLT: case Kind::SLTU:
+            op.rd = regIdx(entry.param1);
+            op.rs1 = regIdx(entry.param2);
+            op.rs2 = regIdx(entry.param3);
+            break;
+        case Kind::FENCE:
+        case Kind::SCALAR:
+            break;
+        default:
+            op.rd = regIdx(entry.param1);
+            op.rs1 = regIdx(entry.param2);
+            op.imm = immediate(entry.param3);
+            break;
+    }
+    return op;
+}
+
+} // namespace RISCVS
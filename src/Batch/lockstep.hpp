@@ -0,0 +1,118 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <hart.hpp>
+
+namespace RISCVS {
+
+// Runs up to LANES instances of one program in lockstep, for parameter
+// sweeps: same code, different inputs. The register files of the lanes are
+// kept as structure of arrays (reg[r][lane]) and every decoded instruction
+// is executed for all lanes by one fixed-width loop the compiler vectorizes
+// (SSE2 by default, AVX2/AVX-512 when the build targets them). Loads and
+// stores go lane by lane to the lane's own Machine.
+//
+// Lanes execute while they agree on the pc. At a branch or jalr that
+// diverges the lanes on the leader's path (the majority for branches)
+// continue, the others leave the group and wait at their pc. A waiting lane
+// rejoins as soon as the group reaches its pc (a loop coming around, the
+// end of an if/else); lanes still waiting when the group finishes are
+// regrouped by pc. A group of one lane runs on its Hart. Instructions other than
+// RV32I computation, memory and control flow (ecall, csr, atomics, wfi...)
+// are stepped on every lane's Hart, with its syscall handler.
+//
+// The harts stay owned by the caller, start wherever their pc is and hold
+// the final state after Run(). Instructions are fetched from the group's
+// leader: lanes must run the same code, a lane rewriting its own code is
+// not detected. Decoded instructions are kept between runs.
+class Lockstep {
+public:
+    constexpr static size_t LANES = 16;
+
+    struct Stats {
+        uint64_t groups = 0;
+        uint64_t steps = 0;         // instructions executed for a whole group
+        uint64_t laneSteps = 0;     // the same per lane
+        uint64_t scalarSteps = 0;   // of steps, executed lane by lane on the harts
+        uint64_t splits = 0;        // lanes that left a group
+        uint64_t joins = 0;         // waiting lanes that rejoined a running one
+    };
+
+    Lockstep();
+
+    // Runs every hart (a lane each) until it stops or retires budget
+    // instructions, the results are in the order of the harts. Throws
+    // std::runtime_error for no harts or more than LANES.
+    std::vector<RunResult> Run(std::span<Hart* const> harts, uint64_t budget = UINT64_MAX);
+
+    const Stats& GetStats() const {
+        return stats;
+    }
+
+private:
+    using Mask = uint32_t;
+    using Lane = std::array<uint32_t, LANES>;
+
+    enum class Kind : uint8_t {
+        SCALAR,
+        ADD, SUB, XOR, OR, AND, SLL, SRL, SRA, SLT, SLTU,
+        ADDI, XORI, ORI, ANDI, SLLI, SRLI, SRAI, SLTI, SLTIU,
+        LUI, AUIPC,
+        LOAD, SB, SH, SW,
+        BEQ, BNE, BLT, BGE, BLTU, BGEU,
+        JAL, JALR,
+        FENCE,
+    };
+
+    struct Op {
+        int32_t pc = -1;
+        uint32_t code = 0;
+        Kind kind = Kind::SCALAR;
+        uint16_t rd = 0;
+        uint16_t rs1 = 0;
+        uint16_t rs2 = 0;
+        int32_t imm = 0;
+    };
+
+    constexpr static size_t DECODED = 4096;
+
+    static Op Decode(int32_t pc, uint32_t binInstruction);
+
+    void RunGroup(Mask group, int32_t pc, uint64_t budget);
+    bool Memory(const Op& op, Mask active);
+    void ScalarStep(Mask& active, int32_t& pc, uint64_t steps);
+    void Leave(size_t lane, int32_t pc, uint64_t steps);
+    void Wait(size_t lane, int32_t pc);
+    void Join(Mask lanes, Mask& active, uint64_t steps, uint64_t& limit);
+    void Finish(size_t lane, const RunResult& result);
+    void LoadLane(size_t lane);
+    void StoreLane(size_t lane);
+
+    template<typename Func>
+    void Compute(uint16_t rd, Func&& func);
+
+    template<typename Func>
+    Mask Taken(Func&& func) const;
+
+    std::span<Hart* const> harts;
+    std::vector<RunResult> results;
+    std::array<uint64_t, LANES> retired{};
+    uint64_t budget = 0;
+    Mask pending = 0;           // lanes waiting for a group
+    std::array<int32_t, LANES> waitingPc{};
+
+    alignas(64) std::array<Lane, Hart::NUM_REGISTER> reg{};
+    std::vector<Op> decoded;
+    Stats stats;
+};
+
+// Diverging guests run in lockstep against Hart::Run (Test.cpp), returns
+// the number of failed tests
+int TestLockstep();
+
+} // namespace RISCVS
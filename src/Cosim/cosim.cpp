@@ -0,0 +1,219 @@
+#include "cosim.hpp"
+
+#include <instrumentation.hpp>
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace RISCVS {
+
+namespace Engines {
+
+Engine Reference() {
+    return [](Hart& hart, uint64_t budget) {
+        Instrumentation::NoTrace policy;
+        return hart.Loop(policy, budget);
+    };
+}
+
+Engine DecodeCached() {
+    return [cache = std::make_shared<DecodeCache>()](Hart& hart, uint64_t budget) {
+        Instrumentation::NoTrace policy;
+        return hart.Loop(policy, *cache, budget);
+    };
+}
+
+} // namespace Engines
+
+namespace {
+
+std::string Hex(uint32_t value) {
+    std::ostringstream out;
+    out << "0x" << std::hex << std::setw(8) << std::setfill('0') << value;
+    return out.str();
+}
+
+template<typename T>
+std::string Difference(std::string_view what, const T& reference, const T& candidate) {
+    std::ostringstream out;
+    out << what << ": reference " << reference << ", candidate " << candidate;
+    return out.str();
+}
+
+} // anon namespace
+
+Cosim::Cosim(MachineFactory makeMachine, int32_t entry, EngineFactory candidate,
+             EngineFactory reference, Options options)
+    : makeMachine(std::move(makeMachine)), entry(entry), candidateFactory(std::move(candidate)),
+      referenceFactory(std::move(reference)), options(std::move(options)) {}
+
+Cosim::Side Cosim::MakeSide(const EngineFactory& factory) const {
+    Side side;
+    side.machine = makeMachine();
+    side.hart = std::make_unique<Hart>(*side.machine, entry);
+    side.engine = factory();
+    return side;
+}
+
+Cosim::Pair Cosim::MakePair() const {
+    return Pair{.reference = MakeSide(referenceFactory), .candidate = MakeSide(candidateFactory)};
+}
+
+void Cosim::Advance(Side& side, uint64_t budget) {
+    if (side.Done()) {
+        return;
+    }
+
+    try {
+        side.retired += side.engine(*side.hart, budget);
+    } catch (const char* message) {
+        side.fault = message;
+    } catch (const std::exception& exception) {
+        side.fault = exception.what();
+    }
+
+    // A fault loses the count of its slice, the flight recorder has seen
+    // every fetched instruction including the faulting one
+    if (!side.fault.empty()) {
+        side.retired = side.hart->GetFlightRecorder().Count();
+    }
+}
+
+void Cosim::AdvanceTo(Side& side, uint64_t target) {
+    if (side.retired < target) {
+        Advance(side, target - side.retired);
+    }
+}
+
+void Cosim::AdvanceBlock(Side& side) {
+    while (!side.Done()) {
+        const int32_t pc = side.hart->GetPC();
+        Advance(side, 1);
+        if (side.hart->GetPC() != pc + static_cast<int32_t>(sizeof(uint32_t))) {
+            break;
+        }
+    }
+}
+
+std::vector<std::string> Cosim::Compare(Pair& sides) const {
+    Hart& reference = *sides.reference.hart;
+    Hart& candidate = *sides.candidate.hart;
+    std::vector<std::string> differences;
+
+    if (sides.reference.retired != sides.candidate.retired) {
+        differences.push_back(Difference("retired", sides.reference.retired, sides.candidate.retired));
+    }
+    if (sides.reference.fault != sides.candidate.fault) {
+        differences.push_back(Difference("fault", '"' + sides.reference.fault + '"', '"' + sides.candidate.fault + '"'));
+    }
+    if (reference.IsStop() != candidate.IsStop()) {
+        differences.push_back(Difference("halted", reference.IsStop(), candidate.IsStop()));
+    }
+    if (reference.GetPC() != candidate.GetPC()) {
+        differences.push_back(Difference("pc", Hex(reference.GetPC()), Hex(candidate.GetPC())));
+    }
+    for (Hart::RegisterIndex idx = 0; idx < Hart::NUM_REGISTER; ++idx) {
+        if (static_cast<uint32_t>(reference[idx]) != static_cast<uint32_t>(candidate[idx])) {
+            differences.push_back(Difference("x" + std::to_string(idx), Hex(reference[idx]), Hex(candidate[idx])));
+        }
+    }
+
+    std::vector<uint8_t> referenceBuffer;
+    std::vector<uint8_t> candidateBuffer;
+    for (const MemoryRange& range : options.memory) {
+        referenceBuffer.resize(range.size);
+        candidateBuffer.resize(range.size);
+        std::span<const uint8_t> referenceBytes = sides.reference.machine->ReadBlock(range.address, referenceBuffer);
+        std::span<const uint8_t> candidateBytes = sides.candidate.machine->ReadBlock(range.address, candidateBuffer);
+        const auto [referenceByte, candidateByte] = std::ranges::mismatch(referenceBytes, candidateBytes);
+        if (referenceByte != referenceBytes.end()) {
+            const uint32_t address = range.address + (referenceByte - referenceBytes.begin());
+            differences.push_back(Difference("mem " + Hex(address), static_cast<unsigned>(*referenceByte),
+                                             static_cast<unsigned>(*candidateByte)));
+        }
+    }
+
+    return differences;
+}
+
+bool Cosim::Run() {
+    pair = MakePair();
+    diverged = false;
+    comparisons = 0;
+    replays = 0;
+
+    uint64_t good = 0;
+    while (!(pair.reference.Done() && pair.candidate.Done()) && pair.reference.retired < options.limit) {
+        if (options.interval == 0) {
+            AdvanceBlock(pair.reference);
+        } else {
+            Advance(pair.reference, std::min(options.interval, options.limit - pair.reference.retired));
+        }
+        AdvanceTo(pair.candidate, pair.reference.retired);
+
+        ++comparisons;
+        if (!Compare(pair).empty()) {
+            diverged = true;
+            Bisect(good, std::max(pair.reference.retired, pair.candidate.retired));
+            retired = divergence.index - 1;
+            return false;
+        }
+        good = pair.reference.retired;
+    }
+
+    retired = pair.reference.retired;
+    return true;
+}
+
+void Cosim::Bisect(uint64_t good, uint64_t bad) {
+    while (bad - good > 1) {
+        const uint64_t middle = good + (bad - good) / 2;
+        Pair probe = MakePair();
+        ++replays;
+        AdvanceTo(probe.reference, middle);
+        AdvanceTo(probe.candidate, middle);
+        if (Compare(probe).empty()) {
+            good = middle;
+        } else {
+            bad = middle;
+        }
+    }
+
+    // Replay once more to stop right after the diverging instruction
+    pair = MakePair();
+    ++replays;
+    AdvanceTo(pair.reference, good);
+    AdvanceTo(pair.candidate, good);
+
+    Hart& reference = *pair.reference.hart;
+    divergence.index = bad;
+    divergence.pc = reference.GetPC();
+    divergence.code = pair.reference.Done() ? 0 : reference.Fetch(divergence.pc);
+
+    AdvanceTo(pair.reference, bad);
+    AdvanceTo(pair.candidate, bad);
+    divergence.differences = Compare(pair);
+}
+
+void Cosim::Report(std::ostream& out) const {
+    out << "++++++++COSIM++++++++\n";
+    out << "Compared instructions: " << retired << '\n';
+    out << "Checkpoints: " << comparisons << ", replays: " << replays << '\n';
+    if (!diverged) {
+        out << "No divergence\n";
+        return;
+    }
+
+    out << "First divergence at instruction " << divergence.index << ": pc " << Hex(divergence.pc)
+        << " (" << Hex(divergence.code) << ')';
+    if (divergence.code != 0) {
+        out << ' ' << Decoder::Name(divergence.code);
+    }
+    out << '\n';
+    for (const std::string& difference : divergence.differences) {
+        out << "  " << difference << '\n';
+    }
+}
+
+} // namespace RISCVS
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <hart.hpp>
+#include <machine.hpp>
+
+namespace RISCVS {
+
+// An execution engine runs up to budget instructions on the hart and returns
+// how many it executed. Every engine must retire exactly the instructions
+// the reference (Hart::Execute + Decoder::Decode) would.
+using Engine = std::function<uint64_t(Hart& hart, uint64_t budget)>;
+
+// Engines may keep state (caches), replays start from a fresh one
+using EngineFactory = std::function<Engine()>;
+
+namespace Engines {
+
+// Hart::Execute with Decoder::Decode on every instruction
+Engine Reference();
+
+// Hart::Execute through a DecodeCache
+Engine DecodeCached();
+
+} // namespace Engines
+
+// Lockstep co-simulation: a candidate engine and the reference run side by
+// side on their own Machine/Hart and their architectural state (pc, registers,
+// halt, fault, retired count and the given memory ranges) is compared every
+// interval instructions or at the end of every basic block. On a mismatch
+// the run is replayed from the start to bisect the first diverging
+// instruction, so the guest has to be deterministic; its syscalls are
+// executed once per side and per replay.
+class Cosim {
+public:
+    using MachineFactory = std::function<std::unique_ptr<Machine>()>;
+
+    struct MemoryRange {
+        uint32_t address;
+        uint32_t size;
+    };
+
+    struct Options {
+        uint64_t interval = 1;      // 0 compares at the end of every basic block
+        uint64_t limit = UINT64_MAX;
+        std::vector<MemoryRange> memory;
+    };
+
+    Cosim(MachineFactory makeMachine, int32_t entry, EngineFactory candidate,
+          EngineFactory reference, Options options);
+
+    // Returns false on a divergence
+    bool Run();
+
+    // Instructions retired by the reference before the end or the divergence
+    uint64_t Retired() const {
+        return retired;
+    }
+
+    bool Diverged() const {
+        return diverged;
+    }
+
+    void Report(std::ostream& out) const;
+
+    // The reference side right after the first diverging instruction
+    Hart& ReferenceHart() {
+        return *pair.reference.hart;
+    }
+
+private:
+    struct Side {
+        std::unique_ptr<Machine> machine;
+        std::unique_ptr<Hart> hart;
+        Engine engine;
+        uint64_t retired = 0;
+        std::string fault;
+
+        bool Done() const {
+            return hart->IsStop() || !fault.empty();
+        }
+    };
+
+    struct Pair {
+        Side reference;
+        Side candidate;
+    };
+
+    struct Divergence {
+        uint64_t index = 0;     // 1-based number of the diverging instruction
+        int32_t pc = 0;
+        uint32_t code = 0;
+        std::vector<std::string> differences;
+    };
+
+    Side MakeSide(const EngineFactory& factory) const;
+    Pair MakePair() const;
+
+    static void Advance(Side& side, uint64_t budget);
+    static void AdvanceTo(Side& side, uint64_t target);
+
+    // Steps the reference to the end of the current basic block
+    static void AdvanceBlock(Side& side);
+
+    std::vector<std::string> Compare(Pair& sides) const;
+
+    // The state matches after good instructions and does not after bad
+    void Bisect(uint64_t good, uint64_t bad);
+
+    MachineFactory makeMachine;
+    int32_t entry;
+    EngineFactory candidateFactory;
+    EngineFactory referenceFactory;
+    Options options;
+
+    Pair pair;
+    uint64_t retired = 0;
+    uint64_t comparisons = 0;
+    uint64_t replays = 0;
+    bool diverged = false;
+    Divergence divergence;
+};
+
+} // namespace RISCVS
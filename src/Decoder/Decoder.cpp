@@ -2,61 +2,16 @@
 
 #include <bitset>
 #include <iostream>
+#include <utility>
 
 namespace RISCVS {
 
     namespace Decoder {
 
-        Uint GetField(Uint startBit, Uint endBit, Uint code) {
-            Uint mask = Mask(startBit, endBit);
-            Uint field = (code & mask) >> startBit;
-            return field;
-        }
-
-        Uint PutField(Uint startBit, Uint endBit, Uint code) {
-            return (code & Mask(0U, endBit - startBit)) << startBit;
-        }
-
-        Uint GetSignBit(Uint code) {
-            return GetField(31U, 31U, code);
-        }
-
-        Uint ExtendWithSignBit(Uint from, Uint code) {
-            Uint signBit = GetSignBit(code);
-            Uint oneExtend = Mask(from, 31U);
-            return signBit == 1U ? oneExtend : 0U;
-        }
-
-        #define GETPUT(start_idx, end_idx, field) \
-        Uint Get##field(Uint code) {return GetField(start_idx, end_idx, code);} \
-        Uint Put##field(Uint code) {return PutField(start_idx, end_idx, code);}
-
-        GETPUT(0U, 6U, Opcode)
-        GETPUT(7U, 11U, Rd)
-        GETPUT(12U, 14U, Funct3)
-        GETPUT(15U, 19U, Rs1)
-        GETPUT(20U, 24U, Rs2)
-        GETPUT(25U, 31U, Funct7)
-
-        #undef GETPUT
-
-        Uint GetImmTypeI(Uint code) {
-            Uint immBody = GetField(20U, 30U, code);
-            Uint imm = immBody | ExtendWithSignBit(11U, code);
-            return imm;
-        }
-
         Uint PutImmTypeI(Immediate imm) {
             return PutField(20U, 31U, imm);
         }
 
-        Uint GetImmTypeS(Uint code) {
-            Uint immBodyPart1 = GetField(7U, 11U, code);
-            Uint immBodyPart2 = GetField(25U, 30U, code) << 5U;
-            Uint imm = immBodyPart1 | immBodyPart2 | ExtendWithSignBit(11U, code);
-            return imm;
-        }
-
         Uint PutImmTypeS(Immediate imm) {
             Uint immBodyPart1 = GetField(0U, 4U, imm);
             Uint immBodyPart2 = GetField(5U, 11U, imm);
@@ -91,12 +46,12 @@ namespace RISCVS {
         }
 
         Uint GetImmTypeU(Uint code) {
-            Uint imm = GetField(12U, 30U, code);
+            Uint imm = GetField(12U, 31U, code);
             return imm;
         }
 
         Uint PutImmTypeU(Immediate imm) {
-            Uint res = PutField(12U, 30U, imm);
+            Uint res = PutField(12U, 31U, imm);
             return res;
         }
 
@@ -180,6 +135,23 @@ namespace RISCVS {
             return IBuild(Opcode, funct3, 0, 0, imm);
         }
 
+        Uint Type::A::Build(RegIdx rd, RegIdx rs1, RegIdx rs2, bool aq, bool rl) const {
+            return  Opcode              |
+                    PutRd(rd)           |
+                    PutRs1(rs1)         |
+                    PutRs2(rs2)         |
+                    PutFunct3(funct3)   |
+                    PutFunct7(funct5 << 2U | static_cast<Uint>(aq) << 1U | static_cast<Uint>(rl));
+        }
+
+        Uint Type::ICsr::Build(RegIdx rd, RegIdx rs1, Uint csr) const {
+            return IBuild(Opcode, funct3, rd, rs1, csr);
+        }
+
+        Uint Type::IFence::Build() const {
+            return IBuild(Opcode, funct3, 0, 0, imm);
+        }
+
         #undef BUILD_TYPE
 
         Uint Type::S::Build(RegIdx rs1, RegIdx rs2, Immediate imm) const {
@@ -351,6 +323,14 @@ namespace RISCVS {
             RegIdx rs1 = GetRs1(binInstruction);
             Immediate imm = GetImmTypeI(binInstruction);
 
+            if (funct3 == CsrRs.funct3) {
+                return Instruction{
+                    .PFN_Instruction = InstructionSet::CsrRs,
+                    .param1 = rd,
+                    .param2 = rs1,
+                    .param3 = static_cast<Uint>(GetField(20U, 31U, binInstruction))};
+            }
+
             switch (imm)
             {
             case ECall.imm:
@@ -369,6 +349,9 @@ namespace RISCVS {
                     .param2 = rs1,
                     .param3 = imm};
 
+            case Wfi.imm:
+                return Instruction{.PFN_Instruction = InstructionSet::Wfi};
+
             default:
                 std::cerr   << "Unkown IEnv instruction: "
                             << std::bitset<32>{imm} << '\n';
@@ -376,6 +359,65 @@ namespace RISCVS {
             }
         }
 
+        Instruction DecodeA(Uint binInstruction) {
+            Uint funct3 = GetFunct3(binInstruction);
+            Uint funct5 = GetFunct7(binInstruction) >> 2U;
+            RegIdx rd = GetRd(binInstruction);
+            RegIdx rs1 = GetRs1(binInstruction);
+            RegIdx rs2 = GetRs2(binInstruction);
+
+            if (funct3 != Type::A::funct3) {
+                std::cerr << "Unknown A instruction: " << std::bitset<32>{binInstruction} << '\n';
+                return Instruction{};
+            }
+
+            #define CASE(Instr) case Instr.funct5:             \
+                return Instruction{                            \
+                    .PFN_Instruction = InstructionSet::Instr,  \
+                    .param1 = rd,                              \
+                    .param2 = rs1,                             \
+                    .param3 = rs2};
+
+            switch (funct5)
+            {
+                CASE(LrW)
+                CASE(ScW)
+                CASE(AmoSwapW)
+                CASE(AmoAddW)
+                CASE(AmoXorW)
+                CASE(AmoAndW)
+                CASE(AmoOrW)
+                CASE(AmoMinW)
+                CASE(AmoMaxW)
+                CASE(AmoMinUW)
+                CASE(AmoMaxUW)
+
+                default:
+                    std::cerr << "Unknown A instruction: " << std::bitset<32>{binInstruction} << '\n';
+                    break;
+            }
+
+            #undef CASE
+
+            return Instruction{};
+        }
+
+        Instruction DecodeFence(Uint binInstruction) {
+            switch (GetFunct3(binInstruction))
+            {
+            case Fence.funct3:
+                return Instruction{.PFN_Instruction = InstructionSet::Fence};
+
+            case FenceI.funct3:
+                return Instruction{.PFN_Instruction = InstructionSet::FenceI};
+
+            default:
+                std::cerr   << "Unkown fence instruction: "
+                            << std::bitset<32>{binInstruction} << '\n';
+                return Instruction{};
+            }
+        }
+
         Instruction DecodeS(Uint binInstruction) {
             Uint funct3 = GetFunct3(binInstruction);
             RegIdx rs1 = GetRs1(binInstruction);
@@ -494,6 +536,12 @@ namespace RISCVS {
                     // std::cerr << "IEnv\n";
                     return DecodeIEnv(binInstruction);
 
+                case Type::A::Opcode:
+                    return DecodeA(binInstruction);
+
+                case Type::IFence::Opcode:
+                    return DecodeFence(binInstruction);
+
                 case Type::S::Opcode:
                     // std::cerr << "S\n";
                     return DecodeS(binInstruction);
@@ -518,6 +566,46 @@ namespace RISCVS {
 
             return Instruction{};
         }
+
+        std::span<const NamedHandler> Handlers() {
+            #define NAME(Instr) {InstructionSet::Instr, #Instr},
+            static constexpr NamedHandler Names[] = {
+                NAME(Add) NAME(Sub) NAME(Xor) NAME(Or) NAME(And)
+                NAME(Sll) NAME(Srl) NAME(Sra) NAME(Slt) NAME(Sltu)
+                NAME(AddI) NAME(XorI) NAME(OrI) NAME(AndI)
+                NAME(SllI) NAME(SrlI) NAME(SraI) NAME(SltI) NAME(SltIU)
+                NAME(Lb) NAME(Lh) NAME(Lw) NAME(Lbu) NAME(Lhu)
+                NAME(Sb) NAME(Sh) NAME(Sw)
+                NAME(Beq) NAME(Bne) NAME(Blt) NAME(Bge) NAME(BltU) NAME(BgeU)
+                NAME(Jal) NAME(Jalr)
+                NAME(Lui) NAME(AuiPC)
+                NAME(ECall) NAME(EBreak) NAME(Wfi)
+                NAME(CsrRs) NAME(Fence) NAME(FenceI)
+                NAME(LrW) NAME(ScW) NAME(AmoSwapW) NAME(AmoAddW) NAME(AmoXorW) NAME(AmoAndW)
+                NAME(AmoOrW) NAME(AmoMinW) NAME(AmoMaxW) NAME(AmoMinUW) NAME(AmoMaxUW)
+            };
+            #undef NAME
+            return Names;
+        }
+
+        std::string_view Name(Uint binInstruction) {
+            constexpr std::string_view MarkerNames[] = {"", "RoiStart", "RoiStop", "RoiReset", "RoiDump"};
+            if (const Marker marker = GetMarker(binInstruction); marker != Marker::NONE) {
+                return MarkerNames[static_cast<Uint>(marker)];
+            }
+
+            const Instruction instruction = Decode(binInstruction);
+            const Handler* handler = instruction.PFN_Instruction.target<Handler>();
+            if (handler != nullptr) {
+                for (const auto& [candidate, name] : Handlers()) {
+                    if (candidate == *handler) {
+                        return name;
+                    }
+                }
+            }
+
+            return "Unknown";
+        }
     } // Decoder
 
 }; // RISCVS
\ No newline at end of file
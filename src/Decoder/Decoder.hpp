@@ -2,6 +2,8 @@
 #include "../instruction.hpp"
 
 #include <iostream>
+#include <span>
+#include <string_view>
 
 using Uint = unsigned;
 namespace RISCVS {
@@ -17,15 +19,98 @@ namespace RISCVS {
             return upperBound - lowerBound;
         };
 
-        Uint GetField(Uint startBit, Uint endBit, Uint code);
-        Uint PutField(Uint startBit, Uint endBit, Uint code);
+        // Field accessors are inline: they are on the hot path of Decode()
+        // and of the instrumentation hooks in other translation units.
+        inline Uint GetField(Uint startBit, Uint endBit, Uint code) {
+            Uint mask = Mask(startBit, endBit);
+            Uint field = (code & mask) >> startBit;
+            return field;
+        }
+
+        inline Uint PutField(Uint startBit, Uint endBit, Uint code) {
+            return (code & Mask(0U, endBit - startBit)) << startBit;
+        }
+
+        inline Uint GetSignBit(Uint code) {
+            return GetField(31U, 31U, code);
+        }
+
+        inline Uint ExtendWithSignBit(Uint from, Uint code) {
+            Uint signBit = GetSignBit(code);
+            Uint oneExtend = Mask(from, 31U);
+            return signBit == 1U ? oneExtend : 0U;
+        }
+
+        #define GETPUT(start_idx, end_idx, field) \
+        inline Uint Get##field(Uint code) {return GetField(start_idx, end_idx, code);} \
+        inline Uint Put##field(Uint code) {return PutField(start_idx, end_idx, code);}
+
+        GETPUT(0U, 6U, Opcode)
+        GETPUT(7U, 11U, Rd)
+        GETPUT(12U, 14U, Funct3)
+        GETPUT(15U, 19U, Rs1)
+        GETPUT(20U, 24U, Rs2)
+        GETPUT(25U, 31U, Funct7)
+
+        #undef GETPUT
+
+        inline Uint GetImmTypeI(Uint code) {
+            Uint immBody = GetField(20U, 30U, code);
+            Uint imm = immBody | ExtendWithSignBit(11U, code);
+            return imm;
+        }
+
+        inline Uint GetImmTypeS(Uint code) {
+            Uint immBodyPart1 = GetField(7U, 11U, code);
+            Uint immBodyPart2 = GetField(25U, 30U, code) << 5U;
+            Uint imm = immBodyPart1 | immBodyPart2 | ExtendWithSignBit(11U, code);
+            return imm;
+        }
+
+        // Region-of-interest markers executed by the guest to control the
+        // simulator statistics. They are addi x0, x0, imm HINTs (a nop for the
+        // ISA), so only the instrumentation policies look at them.
+        enum class Marker : Uint {
+            NONE  = 0,
+            START = 1,
+            STOP  = 2,
+            RESET = 3,
+            DUMP  = 4,
+        };
+
+        inline Uint MarkerCode(Marker marker) {
+            return PutField(20U, 31U, static_cast<Uint>(marker)) | PutOpcode(0b0010011);
+        }
+
+        inline Marker GetMarker(Uint code) {
+            // addi x0, x0, imm: everything but the immediate is zero
+            if ((code & Mask(0U, 19U)) != PutOpcode(0b0010011)) {
+                return Marker::NONE;
+            }
+            const Uint imm = GetField(20U, 31U, code);
+            return imm <= static_cast<Uint>(Marker::DUMP) ? static_cast<Marker>(imm) : Marker::NONE;
+        }
 
+        // Returns the number of failed tests
         int TestDecoder();
 
-        Uint GetOpcode(Uint code);
         bool TestGetField();
         Instruction Decode(Uint binInstruction);
 
+        // Name of the decoded instruction as it is spelled in Decoder ("AddI", "Lw", ...)
+        std::string_view Name(Uint binInstruction);
+
+        using Handler = bool(*)(Hart&, const Instruction::Param&, const Instruction::Param&, const Instruction::Param&);
+
+        struct NamedHandler {
+            Handler handler;
+            std::string_view name;
+        };
+
+        // Every handler Decode() can produce, in a fixed order: an index into
+        // it identifies an instruction independently of the process
+        std::span<const NamedHandler> Handlers();
+
 
         namespace Type {
             
@@ -69,6 +154,32 @@ namespace RISCVS {
                 Uint Build() const;
             };
 
+            // RV32A, funct7 holds funct5 and the aq/rl bits
+            struct A {
+                static constexpr Uint Opcode = 0b0101111;
+                static constexpr Uint funct3 = 0x2;
+
+                const Uint funct5;
+
+                Uint Build(RegIdx rd, RegIdx rs1, RegIdx rs2, bool aq = false, bool rl = false) const;
+            };
+
+            // Zicsr, csr is the unsigned 12-bit register number
+            struct ICsr {
+                static constexpr Uint Opcode = 0b1110011;
+                const Uint funct3;
+
+                Uint Build(RegIdx rd, RegIdx rs1, Uint csr) const;
+            };
+
+            struct IFence {
+                static constexpr Uint Opcode = 0b0001111;
+                const Uint funct3;
+                const Uint imm;
+
+                Uint Build() const;
+            };
+
             struct S {
                 static constexpr Uint Opcode = 0b0100011;
 
@@ -133,6 +244,27 @@ namespace RISCVS {
         // I-env
         constexpr Type::IEnv ECall  = Type::IEnv{.funct3 = 0x0, .imm = 0x0};
         constexpr Type::IEnv EBreak = Type::IEnv{.funct3 = 0x0, .imm = 0x1};
+        constexpr Type::IEnv Wfi    = Type::IEnv{.funct3 = 0x0, .imm = 0x105};
+
+        // A
+        constexpr Type::A LrW      = Type::A{.funct5 = 0b00010};
+        constexpr Type::A ScW      = Type::A{.funct5 = 0b00011};
+        constexpr Type::A AmoSwapW = Type::A{.funct5 = 0b00001};
+        constexpr Type::A AmoAddW  = Type::A{.funct5 = 0b00000};
+        constexpr Type::A AmoXorW  = Type::A{.funct5 = 0b00100};
+        constexpr Type::A AmoAndW  = Type::A{.funct5 = 0b01100};
+        constexpr Type::A AmoOrW   = Type::A{.funct5 = 0b01000};
+        constexpr Type::A AmoMinW  = Type::A{.funct5 = 0b10000};
+        constexpr Type::A AmoMaxW  = Type::A{.funct5 = 0b10100};
+        constexpr Type::A AmoMinUW = Type::A{.funct5 = 0b11000};
+        constexpr Type::A AmoMaxUW = Type::A{.funct5 = 0b11100};
+
+        // Zicsr, only reads of the registers in InstructionSet::CsrRs
+        constexpr Type::ICsr CsrRs = Type::ICsr{.funct3 = 0x2};
+
+        // Fence (pred = succ = iorw) and Zifencei
+        constexpr Type::IFence Fence  = Type::IFence{.funct3 = 0x0, .imm = 0x0FF};
+        constexpr Type::IFence FenceI = Type::IFence{.funct3 = 0x1, .imm = 0x0};
     
         // S
         constexpr Type::S Sb  = Type::S{.funct3 = 0x0};
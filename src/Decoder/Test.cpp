@@ -2,17 +2,22 @@
 #include <machine.hpp>
 #include <iostream>
 #include <cstdlib>
+#include <span>
+#include <string_view>
 #include <Decoder.hpp>
 #include <register.hpp>
 
 #define CHECK(cond)                                                         \
     if (!(cond)) {                                                          \
         std::cerr << testIdx << " is broken\n";     /* Not informative!*/   \
+        ++failures;                                                         \
         return false;                                                       \
     }
 
 namespace {
 
+    int failures = 0;
+
     constexpr int32_t MaxValue = 500;
     constexpr int32_t MaxAddr = 500;
     constexpr int32_t MaxAddrShift = 500;
@@ -29,6 +34,9 @@ namespace {
         return (rand() % MaxAddrShift) & (~1);
     }
 
+    // Data of the RV32A tests, away from the code the tests write at the pc
+    constexpr int32_t AtomicAddr = 0x10000;
+
 } // anon namespace
 
 namespace RISCVS {
@@ -138,7 +146,7 @@ namespace RISCVS {
 
                 hart.Execute();
 
-                CHECK(hart.GetPC() == (pc + int(cond(rs1Value, rs2Value)) * imm));
+                CHECK(hart.GetPC() == (cond(rs1Value, rs2Value) ? pc + imm : pc + 4));
 
                 return true;
         }
@@ -244,7 +252,134 @@ namespace RISCVS {
                 hart.Execute();
 
                 CHECK(hart.IsStop() == true);
-                hart.Run();
+                hart.Resume();
+
+                return true;
+        }
+
+        // Build -> Decode -> execute of an AMO with every aq/rl combination,
+        // expected is the memory word after the AMO, rd gets the old one
+        bool TestA( Hart& hart,
+                    Type::A instr,
+                    std::string_view name,
+                    Register::RegisterType memValue,
+                    Register::RegisterType rs2Value,
+                    Register::RegisterType expected) {
+                RegIdx rdIdx = 1;
+                RegIdx rs1Idx = 2;
+                RegIdx rs2Idx = 3;
+
+                static int testIdx = 0;
+
+                for (const bool aq : {false, true}) {
+                    for (const bool rl : {false, true}) {
+                        std::cerr << "---------[]---------\n";
+                        testIdx++;
+
+                        hart[rdIdx] = GetRandValue();
+                        hart[rs1Idx] = AtomicAddr;
+                        hart[rs2Idx] = rs2Value;
+                        hart.Store(AtomicAddr, memValue);
+
+                        auto testInstr = instr.Build(rdIdx, rs1Idx, rs2Idx, aq, rl);
+                        CHECK(Name(testInstr) == name);
+                        auto pc = hart.GetPC();
+                        hart.Store(pc, testInstr);
+
+                        hart.Execute();
+
+                        CHECK(hart[rdIdx] == memValue && static_cast<Uint>(hart.M(AtomicAddr)) == expected &&
+                              hart.GetPC() == pc + 4);
+                    }
+                }
+
+                return true;
+        }
+
+        // LR/SC pair; with other set, other stores to the reserved word in
+        // between and the SC has to fail
+        bool TestLrSc(Hart& hart, Hart* other, bool aq, bool rl) {
+                std::cerr << "---------[]---------\n";
+                RegIdx rdIdx = 1;
+                RegIdx rs1Idx = 2;
+                RegIdx rs2Idx = 3;
+
+                static int testIdx = 0;
+                testIdx++;
+
+                const Uint memValue = GetRandValue();
+                const Uint foreignValue = memValue + 1;
+                hart[rs1Idx] = AtomicAddr;
+                hart[rs2Idx] = memValue + 2;
+                hart.Store(AtomicAddr, memValue);
+
+                auto lr = LrW.Build(rdIdx, rs1Idx, 0, aq, rl);
+                CHECK(Name(lr) == "LrW");
+                hart.Store(hart.GetPC(), lr);
+                hart.Execute();
+                CHECK(hart[rdIdx] == memValue);
+
+                if (other != nullptr) {
+                    other->Store(AtomicAddr, foreignValue);
+                }
+
+                auto sc = ScW.Build(rdIdx, rs1Idx, rs2Idx, aq, rl);
+                CHECK(Name(sc) == "ScW");
+                hart.Store(hart.GetPC(), sc);
+                hart.Execute();
+
+                if (other != nullptr) {
+                    CHECK(hart[rdIdx] == 1 && static_cast<Uint>(hart.M(AtomicAddr)) == foreignValue);
+                } else {
+                    CHECK(hart[rdIdx] == 0 && static_cast<Uint>(hart.M(AtomicAddr)) == hart[rs2Idx]);
+                }
+
+                // The reservation is gone either way
+                hart.Store(hart.GetPC(), sc);
+                hart.Execute();
+                CHECK(hart[rdIdx] == 1);
+
+                return true;
+        }
+
+        bool TestCsr(Hart& hart) {
+                std::cerr << "---------[]---------\n";
+                constexpr Uint MHARTID = 0xF14;
+                RegIdx rdIdx = 1;
+
+                static int testIdx = 0;
+                testIdx++;
+
+                hart[rdIdx] = GetRandValue();
+                hart.SetHartId(7);
+
+                auto testInstr = CsrRs.Build(rdIdx, 0, MHARTID);
+                CHECK(Name(testInstr) == "CsrRs");
+                auto pc = hart.GetPC();
+                hart.Store(pc, testInstr);
+
+                hart.Execute();
+                hart.SetHartId(0);
+
+                CHECK(hart[rdIdx] == 7 && hart.GetPC() == pc + 4);
+
+                return true;
+        }
+
+        bool TestFence(Hart& hart, Type::IFence instr, std::string_view name) {
+                std::cerr << "---------[]---------\n";
+
+                static int testIdx = 0;
+                testIdx++;
+
+                auto testInstr = instr.Build();
+                CHECK(Name(testInstr) == name);
+                auto pc = hart.GetPC();
+                hart.Store(pc, testInstr);
+
+                hart.Execute();
+
+                CHECK(!hart.IsStop() && hart.GetPC() == pc + 4);
 
                 return true;
         }
@@ -267,8 +402,16 @@ namespace RISCVS {
         }
 
         int TestDecoder() {
-            Machine machine{};
+            // Anonymous guest memory, the file backend would write ram.bin
+            Machine machine{std::span<const uint8_t>{}, 0};
             Hart hart{machine};
+            Hart other{machine};
+            // ecall stops the hart instead of going to the host
+            hart.SetSyscallHandler([](Hart& hart) {
+                hart.Stop();
+                return true;
+            });
+            failures = 0;
 
             std::srand(0);
             // FUCK: It's likely to use random values in tests is a bad idea
@@ -342,7 +485,31 @@ namespace RISCVS {
             TestI(hart, ECall);
             TestI(hart, EBreak);
 
-            return 0; // return number of passed tests
+            // A, memory word -1 against rs2 1 tells signed from unsigned
+            TestA(hart, AmoSwapW, "AmoSwapW", 5, 9, 9);
+            TestA(hart, AmoAddW, "AmoAddW", 5, 9, 14);
+            TestA(hart, AmoXorW, "AmoXorW", 5, 9, 5 ^ 9);
+            TestA(hart, AmoAndW, "AmoAndW", 5, 9, 5 & 9);
+            TestA(hart, AmoOrW, "AmoOrW", 5, 9, 5 | 9);
+            TestA(hart, AmoMinW, "AmoMinW", -1, 1, -1);
+            TestA(hart, AmoMaxW, "AmoMaxW", -1, 1, 1);
+            TestA(hart, AmoMinUW, "AmoMinUW", -1, 1, 1);
+            TestA(hart, AmoMaxUW, "AmoMaxUW", -1, 1, -1);
+            TestA(hart, AmoMinW, "AmoMinW", 3, -4, -4);
+            TestA(hart, AmoMaxUW, "AmoMaxUW", 3, -4, -4);
+            for (const bool aq : {false, true}) {
+                for (const bool rl : {false, true}) {
+                    TestLrSc(hart, nullptr, aq, rl);
+                    TestLrSc(hart, &other, aq, rl);
+                }
+            }
+
+            // Zicsr, fences
+            TestCsr(hart);
+            TestFence(hart, Fence, "Fence");
+            TestFence(hart, FenceI, "FenceI");
+
+            return failures; // number of failed tests
         }
 
     } // Decoder
@@ -0,0 +1,109 @@
+#include "symbolTable.hpp"
+
+#include <elf.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace RISCVS {
+
+SymbolTable::SymbolTable(std::string_view elfPath) {
+    std::ifstream file{std::string(elfPath), std::ios::binary};
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open ELF file");
+    }
+    std::vector<uint8_t> content{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+
+    if (content.size() < EI_NIDENT || std::memcmp(content.data(), ELFMAG, SELFMAG) != 0) {
+        throw std::runtime_error("Invalid ELF magic number");
+    }
+
+    if (content[EI_CLASS] == ELFCLASS32) {
+        Parse<Elf32_Ehdr, Elf32_Shdr, Elf32_Sym>(content);
+    } else {
+        Parse<Elf64_Ehdr, Elf64_Shdr, Elf64_Sym>(content);
+    }
+
+    std::sort(symbols.begin(), symbols.end(), [](const Symbol& lhs, const Symbol& rhs) {
+        return lhs.address < rhs.address;
+    });
+}
+
+template<typename Ehdr, typename Shdr, typename Sym>
+void SymbolTable::Parse(const std::vector<uint8_t>& content) {
+    if (content.size() < sizeof(Ehdr)) {
+        throw std::runtime_error("File too small for ELF header");
+    }
+    const auto* header = reinterpret_cast<const Ehdr*>(content.data());
+    if (header->e_shoff + header->e_shnum * sizeof(Shdr) > content.size()) {
+        throw std::runtime_error("Corrupted ELF section headers");
+    }
+    const auto* sections = reinterpret_cast<const Shdr*>(content.data() + header->e_shoff);
+
+    for (unsigned i = 0; i < header->e_shnum; ++i) {
+        const Shdr& symtab = sections[i];
+        if (symtab.sh_type != SHT_SYMTAB || symtab.sh_link >= header->e_shnum) {
+            continue;
+        }
+        const Shdr& strtab = sections[symtab.sh_link];
+        if (symtab.sh_offset + symtab.sh_size > content.size() || strtab.sh_offset + strtab.sh_size > content.size()) {
+            throw std::runtime_error("Corrupted ELF symbol table");
+        }
+
+        const auto* syms = reinterpret_cast<const Sym*>(content.data() + symtab.sh_offset);
+        const char* names = reinterpret_cast<const char*>(content.data() + strtab.sh_offset);
+        const size_t count = symtab.sh_size / sizeof(Sym);
+
+        for (size_t j = 0; j < count; ++j) {
+            const Sym& sym = syms[j];
+            const unsigned type = sym.st_info & 0xF;
+            if ((type != STT_FUNC && type != STT_NOTYPE) || sym.st_shndx == SHN_UNDEF ||
+                sym.st_name == 0 || sym.st_name >= strtab.sh_size) {
+                continue;
+            }
+            std::string name{names + sym.st_name};
+            // Local labels of the assembler ($x, .L...) are not interesting
+            if (name.empty() || name[0] == '$' || name[0] == '.') {
+                continue;
+            }
+            symbols.push_back(Symbol{.address = static_cast<uint32_t>(sym.st_value),
+                                     .size = static_cast<uint32_t>(sym.st_size),
+                                     .name = std::move(name)});
+        }
+    }
+}
+
+const SymbolTable::Symbol* SymbolTable::Lookup(uint32_t address) const {
+    auto it = std::upper_bound(symbols.begin(), symbols.end(), address, [](uint32_t value, const Symbol& symbol) {
+        return value < symbol.address;
+    });
+    if (it == symbols.begin()) {
+        return nullptr;
+    }
+    --it;
+
+    // Sized symbols must cover the address, unsized ones extend to the next symbol
+    if (it->size != 0 && address >= it->address + it->size) {
+        return nullptr;
+    }
+    return &*it;
+}
+
+std::string SymbolTable::Describe(uint32_t address) const {
+    const Symbol* symbol = Lookup(address);
+    if (symbol == nullptr) {
+        return {};
+    }
+
+    std::ostringstream out;
+    out << symbol->name;
+    if (address != symbol->address) {
+        out << "+0x" << std::hex << address - symbol->address;
+    }
+    return out.str();
+}
+
+} // namespace RISCVS
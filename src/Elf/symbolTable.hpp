@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace RISCVS {
+
+// Function symbols of an ELF file (.symtab), used to name guest addresses
+class SymbolTable {
+public:
+    struct Symbol {
+        uint32_t address;
+        uint32_t size;
+        std::string name;
+    };
+
+    SymbolTable() = default;
+
+    // Both ELF32 and ELF64 files are accepted, throws if the file is not an ELF
+    explicit SymbolTable(std::string_view elfPath);
+
+    // Symbol containing address, nullptr if there is none
+    const Symbol* Lookup(uint32_t address) const;
+
+    // "name+0x10", or an empty string when the address is not covered
+    std::string Describe(uint32_t address) const;
+
+    bool Empty() const {
+        return symbols.empty();
+    }
+
+    const std::vector<Symbol>& GetSymbols() const {
+        return symbols;
+    }
+
+private:
+    template<typename Ehdr, typename Shdr, typename Sym>
+    void Parse(const std::vector<uint8_t>& content);
+
+    std::vector<Symbol> symbols; // sorted by address
+};
+
+} // namespace RISCVS
@@ -0,0 +1,120 @@
+#include <translationCache.hpp>
+#include <hart.hpp>
+#include <assembler.hpp>
+#include <machine.hpp>
+#include <iostream>
+
+#define CHECK(cond)                                                         \
+    if (!(cond)) {                                                          \
+        std::cerr << testIdx << " is broken\n";     /* Not informative!*/   \
+        ++failures;                                                         \
+        return false;                                                       \
+    }
+
+namespace {
+
+    int failures = 0;
+
+    constexpr uint32_t CodeAddr = 0x10000;
+    constexpr int32_t Iterations = 3;
+    constexpr int32_t NewIncrement = 100;
+
+    void StopOnSyscall(RISCVS::Hart& hart) {
+        hart.SetSyscallHandler([](RISCVS::Hart& hart) {
+            hart.Stop();
+            return true;
+        });
+    }
+
+} // anon namespace
+
+namespace RISCVS {
+
+    // The guest rewrites a word further down the block it is executing:
+    // the block was translated with the old word, the hart must notice,
+    // execute the new instruction and invalidate the block
+    bool TestSelfModifyingCode() {
+        std::cerr << "---------[]---------\n";
+        static int testIdx = 0;
+        testIdx++;
+
+        Assembler as{CodeAddr};
+        auto loop = as.NewLabel();
+        as.Li(Assembler::T0, Iterations);
+        as.Li(Assembler::S1, static_cast<int32_t>(Decoder::AddI.Build(Assembler::A1, Assembler::A1, NewIncrement)));
+        as.Bind(loop);
+        as.AuiPC(Assembler::S0, 0);
+        as.Sw(Assembler::S1, Assembler::S0, 3 * sizeof(uint32_t));
+        as.AddI(Assembler::T0, Assembler::T0, -1);
+        as.AddI(Assembler::A1, Assembler::A1, 1);   // rewritten to a1 += NewIncrement
+        as.Bnez(Assembler::T0, loop);
+        as.Exit();
+
+        Machine machine{as.Image(), CodeAddr};
+        TranslationCache cache{machine};
+        TranslationCache::Reader reader{cache};
+        Hart hart{machine, CodeAddr};
+        StopOnSyscall(hart);
+
+        const RunResult result = hart.Run(reader, UINT64_MAX);
+        CHECK(result.reason == StopReason::HALT);
+        CHECK(hart[Assembler::A1] == Iterations * NewIncrement);
+
+        // The first block held the old word, the loop block is translated from the new one
+        const TranslationCache::Stats stats = cache.GetStats();
+        CHECK(stats.invalidations == 1);
+
+        // Not freed while the reader was online at the epoch it was retired
+        // in, freed once the reader went offline with the run
+        CHECK(stats.reclaimed == 0);
+        cache.Reclaim();
+        CHECK(cache.GetStats().reclaimed == 1);
+
+        return true;
+    }
+
+    // A host that rewrites guest code unlinks the blocks over it, the next run
+    // translates the new code
+    bool TestHostInvalidate() {
+        std::cerr << "---------[]---------\n";
+        static int testIdx = 0;
+        testIdx++;
+
+        Assembler as{CodeAddr};
+        as.AddI(Assembler::A1, Assembler::A1, 1);
+        as.Exit();
+
+        Machine machine{as.Image(), CodeAddr};
+        TranslationCache cache{machine};
+        TranslationCache::Reader reader{cache};
+
+        Hart first{machine, CodeAddr};
+        StopOnSyscall(first);
+        CHECK(first.Run(reader, UINT64_MAX).reason == StopReason::HALT);
+        CHECK(first[Assembler::A1] == 1);
+
+        const uint32_t rewritten = Decoder::AddI.Build(Assembler::A1, Assembler::A1, NewIncrement);
+        machine.WriteBlock(CodeAddr, {reinterpret_cast<const uint8_t*>(&rewritten), sizeof(rewritten)});
+        cache.Invalidate(CodeAddr, sizeof(uint32_t));
+        const TranslationCache::Stats stats = cache.GetStats();
+        CHECK(stats.invalidations == 1 && stats.reclaimed == 1);
+
+        Hart second{machine, CodeAddr};
+        StopOnSyscall(second);
+        CHECK(second.Run(reader, UINT64_MAX).reason == StopReason::HALT);
+        CHECK(second[Assembler::A1] == NewIncrement);
+        CHECK(cache.GetStats().translations == stats.translations + 1);
+
+        return true;
+    }
+
+    int TestTranslationCache() {
+        failures = 0;
+
+        TestSelfModifyingCode();
+        TestHostInvalidate();
+
+        return failures; // number of failed tests
+    }
+
+} // RISCVS
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <Decoder.hpp>
+
+namespace RISCVS {
+
+// Direct-mapped cache of decoded instructions. Decode() depends on the
+// instruction word only, so entries are tagged by the word itself: there is
+// nothing to invalidate when the guest rewrites its code.
+class DecodeCache {
+public:
+    constexpr static size_t DEFAULT_SIZE = 4096U;
+
+    // size must be a power of two
+    explicit DecodeCache(size_t size = DEFAULT_SIZE) : entries(size), mask(size - 1) {}
+
+    const Instruction& Lookup(uint32_t binInstruction) {
+        ++lookups;
+        Entry& entry = entries[Index(binInstruction)];
+        if (!entry.valid || entry.code != binInstruction) [[unlikely]] {
+            ++misses;
+            entry.code = binInstruction;
+            entry.valid = true;
+            entry.instruction = Decoder::Decode(binInstruction);
+        }
+        return entry.instruction;
+    }
+
+    uint64_t Lookups() const {
+        return lookups;
+    }
+
+    uint64_t Hits() const {
+        return lookups - misses;
+    }
+
+private:
+    struct Entry {
+        uint32_t code = 0;
+        bool valid = false;
+        Instruction instruction;
+    };
+
+    size_t Index(uint32_t binInstruction) const {
+        // Fibonacci hashing: opcode and register fields all reach the index
+        return (binInstruction * 0x9E3779B1U) >> 16U & mask;
+    }
+
+    std::vector<Entry> entries;
+    size_t mask;
+    uint64_t lookups = 0;
+    uint64_t misses = 0;
+};
+
+} // namespace RISCVS
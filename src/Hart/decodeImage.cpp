@@ -0,0 +1,245 @@
+#include "decodeImage.hpp"
+
+#include <cstring>
+#include <functional>
+#include <map>
+#include <string>
+#include <variant>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace RISCVS {
+
+struct DecodeImage::Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t handlersHash;      // names in Decoder::Handlers() order
+    uint64_t decoderHash;       // what Decode() makes of the probe words
+    uint32_t base;
+    uint32_t reserved;
+    uint64_t count;
+    uint64_t codeHash;
+};
+
+namespace {
+
+constexpr char MAGIC[8] = "RVSDIMG";
+constexpr uint32_t VERSION = 2;
+
+uint64_t Fnv1a(std::span<const uint8_t> bytes, uint64_t hash = 0xCBF29CE484222325ULL) {
+    for (const uint8_t byte : bytes) {
+        hash = (hash ^ byte) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+uint64_t HandlersHash(std::span<const Decoder::NamedHandler> handlers) {
+    constexpr uint8_t SEPARATOR[] = {','};
+    uint64_t hash = Fnv1a({});
+    for (const Decoder::NamedHandler& handler : handlers) {
+        hash = Fnv1a({reinterpret_cast<const uint8_t*>(handler.name.data()), handler.name.size()}, hash);
+        hash = Fnv1a(SEPARATOR, hash);
+    }
+    return hash;
+}
+
+// Data words make Decode() complain on stderr, building the table is quiet
+class QuietDecode {
+public:
+    QuietDecode() : saved(std::cerr.rdbuf(nullptr)) {}
+
+    ~QuietDecode() {
+        std::cerr.rdbuf(saved);
+        std::cerr.clear();
+    }
+
+private:
+    std::streambuf* saved;
+};
+
+template <typename Value>
+uint64_t FnvValue(Value value, uint64_t hash) {
+    return Fnv1a({reinterpret_cast<const uint8_t*>(&value), sizeof(value)}, hash);
+}
+
+// Decodes every major opcode with every funct3 and funct7 and a few rs2
+// values (ecall/ebreak), and hashes the handler index and parameters of each.
+// A decoder change that keeps the handler names still changes the hash, so
+// a file built by another build of the simulator is not reused.
+uint64_t DecoderHash(std::span<const Decoder::NamedHandler> handlers) {
+    std::map<Decoder::Handler, uint16_t> indices;
+    for (size_t index = 0; index < handlers.size(); ++index) {
+        indices.emplace(handlers[index].handler, index);
+    }
+
+    constexpr uint32_t RD = 5;
+    constexpr uint32_t RS1 = 10;
+    constexpr uint32_t RS2[] = {0, 1, 17};
+
+    QuietDecode quiet;
+    uint64_t hash = Fnv1a({});
+    for (uint32_t opcode = 0b11; opcode < 0x80; opcode += 0b100) {
+        for (uint32_t funct3 = 0; funct3 < 8; ++funct3) {
+            for (uint32_t funct7 = 0; funct7 < 0x80; ++funct7) {
+                for (const uint32_t rs2 : RS2) {
+                    const uint32_t binInstruction =
+                        funct7 << 25U | rs2 << 20U | RS1 << 15U | funct3 << 12U | RD << 7U | opcode;
+                    const Instruction instruction = Decoder::Decode(binInstruction);
+
+                    uint16_t handler = UINT16_MAX;
+                    if (const Decoder::Handler* target = instruction.PFN_Instruction.target<Decoder::Handler>()) {
+                        const auto found = indices.find(*target);
+                        handler = found != indices.end() ? found->second : UINT16_MAX - 1;
+                    }
+                    hash = FnvValue(handler, hash);
+                    for (const Instruction::Param* param : {&instruction.param1, &instruction.param2, &instruction.param3}) {
+                        hash = FnvValue(static_cast<uint8_t>(param->index()), hash);
+                        hash = std::visit([hash](auto value) { return FnvValue(static_cast<int64_t>(value), hash); },
+                                          *param);
+                    }
+                }
+            }
+        }
+    }
+    return hash;
+}
+
+// Writes to a temporary name and renames it, so concurrent instances see
+// either no file or a complete one
+bool WriteFile(const std::string& path, std::span<const uint8_t> header, std::span<const uint8_t> data) {
+    const std::string temporary = path + ".tmp." + std::to_string(getpid());
+    const int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        return false;
+    }
+
+    bool ok = true;
+    for (const std::span<const uint8_t> part : {header, data}) {
+        size_t written = 0;
+        while (ok && written < part.size()) {
+            const ssize_t result = write(fd, part.data() + written, part.size() - written);
+            ok = result > 0;
+            written += ok ? result : 0;
+        }
+    }
+    ok = close(fd) == 0 && ok;
+    if (!ok || rename(temporary.c_str(), path.c_str()) != 0) {
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // anon namespace
+
+DecodeImage::DecodeImage(std::string_view cachePath, uint32_t base, std::span<const uint8_t> code)
+    : base(base), count(code.size() / sizeof(uint32_t)), handlers(Decoder::Handlers()) {
+    static_assert(sizeof(Header) % alignof(Record) == 0);
+
+    Header expected{};
+    std::memcpy(expected.magic, MAGIC, sizeof(MAGIC));
+    expected.version = VERSION;
+    expected.recordSize = sizeof(Record);
+    expected.handlersHash = HandlersHash(handlers);
+    expected.decoderHash = DecoderHash(handlers);
+    expected.base = base;
+    expected.count = count;
+    expected.codeHash = Fnv1a(code.first(count * sizeof(uint32_t)));
+
+    if (Map(cachePath, expected)) {
+        reused = true;
+        return;
+    }
+
+    std::vector<Record> built = Build(code.first(count * sizeof(uint32_t)));
+    const std::span<const uint8_t> header{reinterpret_cast<const uint8_t*>(&expected), sizeof(Header)};
+    const std::span<const uint8_t> data{reinterpret_cast<const uint8_t*>(built.data()), built.size() * sizeof(Record)};
+    if (WriteFile(std::string(cachePath), header, data) && Map(cachePath, expected)) {
+        return;
+    }
+
+    privateRecords = std::move(built);
+    records = privateRecords.data();
+}
+
+DecodeImage::~DecodeImage() {
+    if (mapping != nullptr) {
+        munmap(mapping, mappingSize);
+    }
+}
+
+bool DecodeImage::Map(std::string_view cachePath, const Header& expected) {
+    const int fd = open(std::string(cachePath).c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+
+    const size_t size = sizeof(Header) + count * sizeof(Record);
+    struct stat status{};
+    if (fstat(fd, &status) != 0 || static_cast<size_t>(status.st_size) != size) {
+        close(fd);
+        return false;
+    }
+
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    if (std::memcmp(mapped, &expected, sizeof(Header)) != 0) {
+        munmap(mapped, size);
+        return false;
+    }
+
+    mapping = mapped;
+    mappingSize = size;
+    records = reinterpret_cast<const Record*>(static_cast<const uint8_t*>(mapped) + sizeof(Header));
+    return true;
+}
+
+std::vector<DecodeImage::Record> DecodeImage::Build(std::span<const uint8_t> code) {
+    const std::span<const Decoder::NamedHandler> handlers = Decoder::Handlers();
+    std::vector<Record> built(code.size() / sizeof(uint32_t));
+
+    QuietDecode quiet;
+    for (size_t i = 0; i < built.size(); ++i) {
+        uint32_t binInstruction = 0;
+        std::memcpy(&binInstruction, code.data() + i * sizeof(uint32_t), sizeof(uint32_t));
+
+        const Instruction instruction = Decoder::Decode(binInstruction);
+        // The record goes to the file byte for byte, padding included: zero
+        // it so equal tables make equal files
+        Record& record = built[i];
+        std::memset(static_cast<void*>(&record), 0, sizeof(Record));
+        record.code = binInstruction;
+        record.handler = INVALID;
+        record.param1 = instruction.param1;
+        record.param2 = instruction.param2;
+        record.param3 = instruction.param3;
+        if (const Decoder::Handler* handler = instruction.PFN_Instruction.target<Decoder::Handler>()) {
+            for (size_t index = 0; index < handlers.size(); ++index) {
+                if (handlers[index].handler == *handler) {
+                    record.handler = index;
+                    break;
+                }
+            }
+        }
+    }
+    return built;
+}
+
+DecodeImage::Entry DecodeImage::Decode(uint32_t binInstruction) {
+    const Instruction instruction = Decoder::Decode(binInstruction);
+    const Decoder::Handler* handler = instruction.PFN_Instruction.target<Decoder::Handler>();
+    if (handler == nullptr) {
+        // What calling the empty std::function of the reference path throws
+        throw std::bad_function_call();
+    }
+    return Entry{*handler, instruction.param1, instruction.param2, instruction.param3};
+}
+
+} // namespace RISCVS
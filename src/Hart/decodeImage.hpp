@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include <Decoder.hpp>
+
+namespace RISCVS {
+
+// Pre-decoded instructions of a code image, one record per word indexed by
+// pc, kept in a cache file that every simulator instance running the same
+// image maps read-only and MAP_SHARED: the table is decoded once and its
+// pages are shared. Instruction itself (a std::function) only makes sense
+// inside one process, so a record names its handler by the index in
+// Decoder::Handlers() and Lookup() turns it back into a function pointer.
+//
+// The file is checked against the image (base, size, hash), the handler
+// table and a fingerprint of the decoder, and rebuilt when it does not match. Words the guest rewrote, or
+// pcs outside the image, are decoded as usual.
+class DecodeImage {
+public:
+    // Decoded instruction as Hart::Step() executes it
+    struct Entry {
+        Decoder::Handler PFN_Instruction;
+        Instruction::Param param1;
+        Instruction::Param param2;
+        Instruction::Param param3;
+    };
+
+    // Opens cachePath, or builds it from code placed at base. If the file
+    // cannot be written the table is kept in private memory instead.
+    DecodeImage(std::string_view cachePath, uint32_t base, std::span<const uint8_t> code);
+    ~DecodeImage();
+
+    DecodeImage(const DecodeImage&) = delete;
+    DecodeImage& operator=(const DecodeImage&) = delete;
+
+    // Decoder::Decode() as an Entry, throws for unknown instructions
+    static Entry Decode(uint32_t binInstruction);
+
+    Entry Lookup(int32_t pc, uint32_t binInstruction) const {
+        const uint32_t index = (static_cast<uint32_t>(pc) - base) / sizeof(uint32_t);
+        if (index < count) [[likely]] {
+            const Record& record = records[index];
+            if (record.code == binInstruction && record.handler != INVALID) [[likely]] {
+                return Entry{handlers[record.handler].handler, record.param1, record.param2, record.param3};
+            }
+        }
+        return Decode(binInstruction);
+    }
+
+    size_t Size() const {
+        return count;
+    }
+
+    // True if the table came from an existing cache file
+    bool Reused() const {
+        return reused;
+    }
+
+    // True if the table lives in a shared file mapping
+    bool Shared() const {
+        return mapping != nullptr;
+    }
+
+private:
+    constexpr static uint16_t INVALID = UINT16_MAX;
+
+    // Trivially copyable: written to and mapped from the cache file as is
+    struct Record {
+        uint32_t code;
+        uint16_t handler;
+        Instruction::Param param1;
+        Instruction::Param param2;
+        Instruction::Param param3;
+    };
+    static_assert(std::is_trivially_copyable_v<Record>);
+
+    struct Header;
+
+    static std::vector<Record> Build(std::span<const uint8_t> code);
+    bool Map(std::string_view cachePath, const Header& expected);
+
+    uint32_t base;
+    size_t count;
+    std::span<const Decoder::NamedHandler> handlers;
+    const Record* records = nullptr;
+
+    void* mapping = nullptr;
+    size_t mappingSize = 0;
+    std::vector<Record> privateRecords;
+    bool reused = false;
+};
+
+} // namespace RISCVS
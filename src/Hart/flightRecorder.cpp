@@ -0,0 +1,105 @@
+#include "flightRecorder.hpp"
+
+#include <atomic>
+#include <csignal>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace RISCVS {
+
+namespace {
+
+std::atomic<const FlightRecorder*> signalRecorder{nullptr};
+
+// Line builder usable from a signal handler: no allocation, no locale
+class Line {
+public:
+    Line& Text(const char* text) {
+        while (*text != '\0' && size < sizeof(buffer)) {
+            buffer[size++] = *text++;
+        }
+        return *this;
+    }
+
+    Line& Decimal(uint64_t value) {
+        char digits[20];
+        size_t length = 0;
+        do {
+            digits[length++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        while (length > 0 && size < sizeof(buffer)) {
+            buffer[size++] = digits[--length];
+        }
+        return *this;
+    }
+
+    Line& Hex(uint32_t value) {
+        constexpr char HEX_DIGITS[] = "0123456789abcdef";
+        Text("0x");
+        for (int shift = 28; shift >= 0 && size < sizeof(buffer); shift -= 4) {
+            buffer[size++] = HEX_DIGITS[(value >> shift) & 0xFU];
+        }
+        return *this;
+    }
+
+    void Write(int fd) {
+        const char* data = buffer;
+        while (size > 0) {
+            const ssize_t written = ::write(fd, data, size);
+            if (written <= 0) {
+                break;
+            }
+            data += written;
+            size -= written;
+        }
+        size = 0;
+    }
+
+private:
+    char buffer[128];
+    size_t size = 0;
+};
+
+void DumpAndTerminate(int signal) {
+    if (const FlightRecorder* recorder = signalRecorder.load()) {
+        recorder->Dump(STDERR_FILENO);
+    }
+    std::signal(signal, SIG_DFL);
+    std::raise(signal);
+}
+
+} // anon namespace
+
+FlightRecorder::FlightRecorder(size_t size) {
+    Resize(size);
+}
+
+void FlightRecorder::Resize(size_t size) {
+    if (size == 0 || (size & (size - 1)) != 0) {
+        throw std::runtime_error("Flight recorder size must be a power of two");
+    }
+    entries.assign(size, Entry{});
+    mask = size - 1;
+    count = 0;
+}
+
+void FlightRecorder::Dump(int fd) const {
+    const uint64_t size = count < entries.size() ? count : entries.size();
+
+    Line line;
+    line.Text("++++++++FLIGHT_RECORDER++++++++\n").Write(fd);
+    line.Text("Last ").Decimal(size).Text(" of ").Decimal(count).Text(" instructions:\n").Write(fd);
+    for (uint64_t i = count - size; i < count; ++i) {
+        const Entry& entry = entries[i & mask];
+        line.Text("  #").Decimal(i).Text(" pc ").Hex(entry.pc).Text(" (").Hex(entry.code).Text(")\n").Write(fd);
+    }
+    line.Text("+++++++++++++++++++++++++++++++\n").Write(fd);
+}
+
+void FlightRecorder::DumpOnSignal(const FlightRecorder& recorder) {
+    signalRecorder.store(&recorder);
+    std::signal(SIGINT, DumpAndTerminate);
+}
+
+} // namespace RISCVS
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace RISCVS {
+
+// Always-on history of the last executed instructions. Recording is two
+// plain stores and an increment into a power-of-two ring, no branches, so
+// it stays enabled in every run and is dumped when the guest faults.
+class FlightRecorder {
+public:
+    constexpr static size_t DEFAULT_SIZE = 256U;
+
+    struct Entry {
+        int32_t pc;
+        uint32_t code;
+    };
+
+    explicit FlightRecorder(size_t size = DEFAULT_SIZE);
+
+    // Drops the history, size must be a power of two
+    void Resize(size_t size);
+
+    void Record(int32_t pc, uint32_t code) {
+        entries[count & mask] = Entry{.pc = pc, .code = code};
+        ++count;
+    }
+
+    // Drops the history, keeps the size
+    void Clear() {
+        count = 0;
+    }
+
+    // Number of recorded instructions, including the overwritten ones
+    uint64_t Count() const {
+        return count;
+    }
+
+    // Oldest to newest, async-signal-safe (formats by hand, write(2) only)
+    void Dump(int fd) const;
+
+    // Dumps the recorder to stderr on SIGINT and terminates the process
+    static void DumpOnSignal(const FlightRecorder& recorder);
+
+private:
+    std::vector<Entry> entries;
+    uint64_t mask;
+    uint64_t count = 0;
+};
+
+} // namespace RISCVS
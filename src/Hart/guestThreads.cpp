@@ -0,0 +1,319 @@
+#include "guestThreads.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <ctime>
+#include <stdexcept>
+
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace RISCVS {
+
+namespace {
+
+// RISC-V Linux syscall numbers
+constexpr uint32_t SYS_SET_TID_ADDRESS = 96;
+constexpr uint32_t SYS_FUTEX = 98;
+constexpr uint32_t SYS_EXIT = 93;
+constexpr uint32_t SYS_EXIT_GROUP = 94;
+constexpr uint32_t SYS_GETTID = 178;
+constexpr uint32_t SYS_CLONE = 220;
+constexpr uint32_t SYS_FUTEX_TIME64 = 422;
+
+constexpr Hart::RegisterIndex SP = 2;
+constexpr Hart::RegisterIndex TP = 4;
+constexpr Hart::RegisterIndex A0 = 10;
+constexpr Hart::RegisterIndex A7 = 17;
+
+Hart::RegisterIndex Arg(unsigned index) {
+    return A0 + index;
+}
+
+long HostFutex(uint32_t* word, int op, uint32_t value, const timespec* timeout = nullptr, uint32_t bitset = 0) {
+    return syscall(SYS_futex, word, op | FUTEX_PRIVATE_FLAG, value, timeout, nullptr, bitset);
+}
+
+// Guest struct timespec: 64-bit fields for futex_time64, 32-bit for futex
+std::chrono::nanoseconds ReadTimespec(Machine& machine, uint32_t address, bool time64) {
+    int64_t seconds = 0;
+    int64_t nanoseconds = 0;
+    if (time64) {
+        seconds = machine.Load<uint32_t>(address) | static_cast<int64_t>(machine.Load<uint32_t>(address + 4)) << 32U;
+        nanoseconds = machine.Load<uint32_t>(address + 8) | static_cast<int64_t>(machine.Load<uint32_t>(address + 12)) << 32U;
+    } else {
+        seconds = machine.Load<int32_t>(address);
+        nanoseconds = machine.Load<int32_t>(address + 4);
+    }
+    return std::chrono::seconds{seconds} + std::chrono::nanoseconds{nanoseconds};
+}
+
+} // anon namespace
+
+GuestThreads::GuestThreads(Machine& machine, int32_t entry) : machine(machine), entry(entry) {
+    if (!machine.Shareable()) {
+        throw std::runtime_error("Guest threads need the mmap backend");
+    }
+}
+
+GuestThreads::~GuestThreads() {
+    exiting = true;
+    std::lock_guard lock{mutex};
+    for (Thread& thread : threads) {
+        if (thread.host.joinable()) {
+            thread.host.join();
+        }
+    }
+}
+
+GuestThreads::Thread& GuestThreads::Create(int32_t pc) {
+    Thread& thread = threads.emplace_back();
+    thread.tid = nextTid++;
+    thread.hart = std::make_unique<Hart>(machine, pc);
+    thread.hart->SetHartId(thread.tid - 1);
+    thread.hart->SetSyscallHandler([this, &thread](Hart&) {
+        return Syscall(thread);
+    });
+    return thread;
+}
+
+void GuestThreads::Start(Thread& thread) {
+    thread.host = std::jthread{[this, &thread] {
+        Execute(thread);
+    }};
+}
+
+int GuestThreads::Run() {
+    {
+        std::lock_guard lock{mutex};
+        Start(Create(entry));
+    }
+
+    // Only running threads create new ones: once every known thread is
+    // joined, none can appear
+    for (;;) {
+        Thread* next = nullptr;
+        {
+            std::lock_guard lock{mutex};
+            for (Thread& thread : threads) {
+                if (thread.host.joinable()) {
+                    next = &thread;
+                    break;
+                }
+            }
+        }
+        if (next == nullptr) {
+            break;
+        }
+        next->host.join();
+    }
+
+    return exitStatus;
+}
+
+std::vector<GuestThreads::Summary> GuestThreads::Threads() {
+    std::lock_guard lock{mutex};
+    std::vector<Summary> summary;
+    for (const Thread& thread : threads) {
+        summary.push_back(Summary{.tid = thread.tid, .result = thread.result});
+    }
+    return summary;
+}
+
+void GuestThreads::Execute(Thread& thread) {
+    RunResult& result = thread.result;
+    while (!exiting.load(std::memory_order_relaxed)) {
+        const RunResult slice = thread.hart->Run(SLICE);
+        result.retired += slice.retired;
+        result.reason = slice.reason;
+        result.fault = slice.fault;
+        if (slice.reason != StopReason::BUDGET) {
+            break;
+        }
+    }
+
+    // A fault kills the whole process, as SIGSEGV would
+    if (result.reason == StopReason::FAULT && !exiting.exchange(true)) {
+        exitStatus = 128 + SIGSEGV;
+    }
+}
+
+bool GuestThreads::Syscall(Thread& thread) {
+    Hart& hart = *thread.hart;
+    int32_t result = 0;
+    switch (static_cast<uint32_t>(hart[A7])) {
+        case SYS_CLONE:
+            result = Clone(thread);
+            break;
+        case SYS_FUTEX:
+            result = Futex(hart, false);
+            break;
+        case SYS_FUTEX_TIME64:
+            result = Futex(hart, true);
+            break;
+        case SYS_SET_TID_ADDRESS:
+            thread.clearChildTid = hart[Arg(0)];
+            result = thread.tid;
+            break;
+        case SYS_GETTID:
+            result = thread.tid;
+            break;
+        case SYS_EXIT:
+            Exit(thread, hart[Arg(0)], false);
+            return true;
+        case SYS_EXIT_GROUP:
+            Exit(thread, hart[Arg(0)], true);
+            return true;
+        default:
+            return false;
+    }
+
+    hart[A0] = result;
+    return true;
+}
+
+int32_t GuestThreads::Clone(Thread& parent) {
+    Hart& hart = *parent.hart;
+    const uint32_t flags = hart[Arg(0)];
+    const uint32_t stack = hart[Arg(1)];
+    const uint32_t parentTid = hart[Arg(2)];
+    const uint32_t tls = hart[Arg(3)];
+    const uint32_t childTid = hart[Arg(4)];
+
+    // fork and vfork would need a copy of the Machine
+    constexpr uint32_t THREAD = CLONE_VM | CLONE_THREAD;
+    if ((flags & THREAD) != THREAD) {
+        return -ENOSYS;
+    }
+
+    std::lock_guard lock{mutex};
+    // The child resumes after the ecall with a0 = 0
+    Thread& child = Create(hart.GetPC() + sizeof(uint32_t));
+    Hart& childHart = *child.hart;
+    for (Hart::RegisterIndex idx = 1; idx < Hart::NUM_REGISTER; ++idx) {
+        childHart[idx] = static_cast<uint32_t>(hart[idx]);
+    }
+    childHart[A0] = 0;
+    if (stack != 0) {
+        childHart[SP] = stack;
+    }
+    if (flags & CLONE_SETTLS) {
+        childHart[TP] = tls;
+    }
+    if (flags & CLONE_PARENT_SETTID) {
+        machine.Store<uint32_t>(parentTid, child.tid);
+    }
+    if (flags & CLONE_CHILD_SETTID) {
+        machine.Store<uint32_t>(childTid, child.tid);
+    }
+    if (flags & CLONE_CHILD_CLEARTID) {
+        child.clearChildTid = childTid;
+    }
+
+    Start(child);
+    return child.tid;
+}
+
+int32_t GuestThreads::Futex(Hart& hart, bool time64) {
+    using Clock = std::chrono::steady_clock;
+
+    const uint32_t address = hart[Arg(0)];
+    const uint32_t op = hart[Arg(1)];
+    const uint32_t value = hart[Arg(2)];
+    const uint32_t timeout = hart[Arg(3)];
+    const uint32_t bitset = hart[Arg(5)];
+
+    uint32_t* word = HostWord(address);
+    if (word == nullptr) {
+        return -EINVAL;
+    }
+
+    switch (op & FUTEX_CMD_MASK) {
+        case FUTEX_WAIT: {
+            std::optional<Clock::time_point> deadline;
+            if (timeout != 0) {
+                deadline = Clock::now() + ReadTimespec(machine, timeout, time64);
+            }
+            return FutexWait(word, value, FUTEX_BITSET_MATCH_ANY, deadline);
+        }
+        case FUTEX_WAIT_BITSET: {
+            // Absolute timeout, CLOCK_MONOTONIC unless FUTEX_CLOCK_REALTIME
+            std::optional<Clock::time_point> deadline;
+            if (timeout != 0) {
+                const std::chrono::nanoseconds time = ReadTimespec(machine, timeout, time64);
+                if (op & FUTEX_CLOCK_REALTIME) {
+                    const auto epoch = std::chrono::system_clock::now().time_since_epoch();
+                    deadline = Clock::now() + (time - std::chrono::duration_cast<std::chrono::nanoseconds>(epoch));
+                } else {
+                    deadline = Clock::time_point{std::chrono::duration_cast<Clock::duration>(time)};
+                }
+            }
+            return FutexWait(word, value, bitset, deadline);
+        }
+        case FUTEX_WAKE:
+            return HostFutex(word, FUTEX_WAKE, value);
+        case FUTEX_WAKE_BITSET:
+            return HostFutex(word, FUTEX_WAKE_BITSET, value, nullptr, bitset);
+        default:
+            return -ENOSYS;
+    }
+}
+
+int32_t GuestThreads::FutexWait(uint32_t* word, uint32_t value, uint32_t bitset,
+                                std::optional<std::chrono::steady_clock::time_point> deadline) {
+    using Clock = std::chrono::steady_clock;
+
+    for (;;) {
+        if (exiting.load(std::memory_order_relaxed)) {
+            return -EINTR;
+        }
+
+        const Clock::time_point now = Clock::now();
+        if (deadline && now >= *deadline) {
+            return -ETIMEDOUT;
+        }
+
+        // steady_clock is CLOCK_MONOTONIC, the clock of FUTEX_WAIT_BITSET
+        const Clock::time_point until = deadline ? std::min(now + EXIT_POLL, *deadline) : now + EXIT_POLL;
+        const auto sinceEpoch = std::chrono::duration_cast<std::chrono::nanoseconds>(until.time_since_epoch());
+        const timespec absolute{.tv_sec = static_cast<time_t>(sinceEpoch.count() / 1'000'000'000),
+                                .tv_nsec = static_cast<long>(sinceEpoch.count() % 1'000'000'000)};
+        if (HostFutex(word, FUTEX_WAIT_BITSET, value, &absolute, bitset) == 0) {
+            return 0;
+        }
+        if (errno != ETIMEDOUT && errno != EINTR) {
+            return -errno;
+        }
+    }
+}
+
+void GuestThreads::Exit(Thread& thread, int32_t status, bool group) {
+    if (group) {
+        if (!exiting.exchange(true)) {
+            exitStatus = status;
+        }
+    } else {
+        if (!exiting.load()) {
+            exitStatus = status;
+        }
+        // CLONE_CHILD_CLEARTID/set_tid_address: pthread_join waits on it
+        if (thread.clearChildTid != 0) {
+            machine.Store<uint32_t>(thread.clearChildTid, 0);
+            if (uint32_t* word = HostWord(thread.clearChildTid)) {
+                HostFutex(word, FUTEX_WAKE, 1);
+            }
+        }
+    }
+    thread.hart->Stop();
+}
+
+uint32_t* GuestThreads::HostWord(uint32_t address) {
+    if (address % sizeof(uint32_t) != 0) {
+        return nullptr;
+    }
+    return reinterpret_cast<uint32_t*>(machine.HostSpan(address, sizeof(uint32_t)).data());
+}
+
+} // namespace RISCVS
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "hart.hpp"
+
+namespace RISCVS {
+
+// User-mode Linux threading for the guest: clone (thread flavour), futex,
+// set_tid_address, gettid, exit and exit_group are emulated, every other
+// syscall goes to the usual ecall handling. Each guest thread is a Hart on
+// its own host thread over the shared Machine, guest futexes are host
+// futexes on the guest word, so blocked threads sleep in the host kernel.
+class GuestThreads {
+public:
+    // Running threads check for exit_group between slices, blocked ones
+    // between futex waits of at most EXIT_POLL
+    constexpr static uint64_t SLICE = 1U << 16U;
+    constexpr static std::chrono::milliseconds EXIT_POLL{50};
+
+    struct Summary {
+        uint32_t tid;
+        RunResult result;
+    };
+
+    // Throws if the machine cannot be shared between host threads
+    GuestThreads(Machine& machine, int32_t entry);
+    ~GuestThreads();
+
+    // Runs the initial thread and everything it clones until exit_group or
+    // until every thread exits, returns the exit status
+    int Run();
+
+    // Per thread results in creation order, after Run()
+    std::vector<Summary> Threads();
+
+private:
+    struct Thread {
+        uint32_t tid;
+        std::unique_ptr<Hart> hart;
+        uint32_t clearChildTid = 0;
+        RunResult result;
+        std::jthread host;
+    };
+
+    // Under the lock: a new thread with its syscall handler, not started yet
+    Thread& Create(int32_t pc);
+    void Start(Thread& thread);
+    void Execute(Thread& thread);
+
+    bool Syscall(Thread& thread);
+    int32_t Clone(Thread& parent);
+    int32_t Futex(Hart& hart, bool time64);
+    int32_t FutexWait(uint32_t* word, uint32_t value, uint32_t bitset,
+                      std::optional<std::chrono::steady_clock::time_point> deadline);
+    void Exit(Thread& thread, int32_t status, bool group);
+
+    uint32_t* HostWord(uint32_t address);
+
+    Machine& machine;
+    const int32_t entry;
+    std::mutex mutex;
+    std::list<Thread> threads;      // element addresses are stable
+    uint32_t nextTid = 1;
+
+    std::atomic<bool> exiting{false};
+    std::atomic<int> exitStatus{0};
+};
+
+} // namespace RISCVS
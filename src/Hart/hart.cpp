@@ -1 +1,44 @@
-#include "hart.hpp"
\ No newline at end of file
+#include "hart.hpp"
+#include "instrumentation.hpp"
+
+namespace RISCVS {
+
+void Hart::Execute(bool requireSkip) {
+    Instrumentation::NoTrace policy;
+    Execute(policy, requireSkip);
+}
+
+RunResult Hart::Run(uint64_t budget) {
+    Instrumentation::NoTrace policy;
+    return Run(policy, budget);
+}
+
+RunResult Hart::Run(TranslationCache::Reader& reader, uint64_t budget) {
+    Instrumentation::NoTrace policy;
+    return Run(policy, reader, budget);
+}
+
+RunResult Hart::RunUntil(int32_t breakpoint, uint64_t budget) {
+    Instrumentation::NoTrace policy;
+    return RunUntil(policy, breakpoint, budget);
+}
+
+std::string_view ToString(StopReason reason) {
+    switch (reason) {
+        case StopReason::NONE:
+            return "none";
+        case StopReason::HALT:
+            return "halt";
+        case StopReason::BUDGET:
+            return "budget";
+        case StopReason::BREAKPOINT:
+            return "breakpoint";
+        case StopReason::FAULT:
+            return "fault";
+        case StopReason::WAIT:
+            return "wait";
+    }
+    return "unknown";
+}
+
+} // namespace RISCVS
@@ -2,14 +2,40 @@
 
 #include <cstdint>
 #include <array>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <stdexcept>
 #include <type_traits>
 
 #include <machine.hpp>
 #include <Decoder.hpp>
 #include "register.hpp"
+#include "shadowStack.hpp"
+#include "flightRecorder.hpp"
+#include "decodeCache.hpp"
+#include "decodeImage.hpp"
+#include "translationCache.hpp"
 
 namespace RISCVS {
 
+enum class StopReason {
+    NONE,
+    HALT,           // exit syscall or Stop()
+    BUDGET,         // the instruction budget is spent
+    BREAKPOINT,     // RunUntil() target or ebreak
+    FAULT,          // unknown instruction or failed memory access
+    WAIT,           // wfi or a blocking syscall, see Hart::WaitForInterrupt()
+};
+
+std::string_view ToString(StopReason reason);
+
+struct RunResult {
+    StopReason reason = StopReason::NONE;
+    uint64_t retired = 0;
+    std::string fault;      // what() of the guest fault
+};
+
 class Hart {
 public:
     using RegisterIndex = uint16_t;
@@ -56,20 +82,100 @@ public:
         machine.Store<T>(memoryRef, value);
     }
 
-    void Execute(bool requireSkip = false) {
+    // LR/SC: the reservation is the hart's own (address, loaded value) and
+    // SC is a compare-exchange against that value, so no lock is shared
+    // between harts. As in most emulators, an ABA store of the same value
+    // between LR and SC goes unnoticed.
+    uint32_t LoadReserved(const int32_t memoryRef) {
+        const uint32_t value = machine.AtomicLoad(memoryRef);
+        reservation = Reservation{.valid = true, .address = memoryRef, .value = value};
+        return value;
+    }
+
+    bool StoreConditional(const int32_t memoryRef, const uint32_t value) {
+        const bool reserved = reservation.valid && reservation.address == memoryRef;
+        reservation.valid = false;
+        return reserved && machine.CompareExchange(memoryRef, reservation.value, value);
+    }
+
+    uint32_t Amo(const int32_t memoryRef, const Machine::AmoOp op, const uint32_t value) {
+        return machine.Amo(memoryRef, op, value);
+    }
+
+    // Policy hooks are described in instrumentation.hpp
+    template<typename Policy>
+    void Execute(Policy& policy, bool requireSkip = false) {
         if (!IsStop()) {
-            uint32_t binInstruction = Load(pc);
-            Instruction instruction = Decoder::Decode(binInstruction);
-            bool shiftPC = instruction.PFN_Instruction(*this, instruction.param1, instruction.param2, instruction.param3);
-            
-            // NextInstructionPC();
-            if (shiftPC && !requireSkip) {
-                NextInstructionPC();
-            }
+            Step(policy, Decode{}, requireSkip);
+        }
+    }
+
+    // Same as Execute(), decoded instructions come from cache
+    template<typename Policy>
+    void Execute(Policy& policy, DecodeCache& cache) {
+        if (!IsStop()) {
+            Step(policy, CachedDecode{cache});
         }
-        // Dump();
     }
 
+    void Execute(bool requireSkip = false);
+
+    // Executes until the hart stops or budget instructions are executed,
+    // returns the number of executed instructions. Guest faults propagate
+    // as exceptions, see Run() for a version that reports them.
+    template<typename Policy>
+    uint64_t Loop(Policy& policy, uint64_t budget = UINT64_MAX) {
+        return Countdown(policy, Decode{}, budget, NoBreakpoint{});
+    }
+
+    template<typename Policy>
+    uint64_t Loop(Policy& policy, DecodeCache& cache, uint64_t budget = UINT64_MAX) {
+        return Countdown(policy, CachedDecode{cache}, budget, NoBreakpoint{});
+    }
+
+    // Instructions come pre-decoded from the (shared) image table
+    template<typename Policy>
+    uint64_t Loop(Policy& policy, const DecodeImage& image, uint64_t budget = UINT64_MAX) {
+        return Countdown(policy, ImageDecode{image, pc}, budget, NoBreakpoint{});
+    }
+
+    // Decoded blocks come from a cache shared with the other harts, the
+    // reader is online for the duration of the loop
+    template<typename Policy>
+    uint64_t Loop(Policy& policy, TranslationCache::Reader& reader, uint64_t budget = UINT64_MAX) {
+        TranslationCache::Online online{reader};
+        SharedDecode::Cursor cursor;
+        return Countdown(policy, SharedDecode{reader, pc, cursor}, budget, NoBreakpoint{});
+    }
+
+    // Batched execution for embedding hosts and schedulers: executes up to
+    // budget instructions and tells why it stopped. A halted hart stays
+    // halted (see Resume()), a faulted one is halted with StopReason::FAULT.
+    template<typename Policy>
+    RunResult Run(Policy& policy, uint64_t budget) {
+        return Guarded(budget, [&] { return Countdown(policy, Decode{}, budget, NoBreakpoint{}); });
+    }
+
+    RunResult Run(uint64_t budget);
+
+    template<typename Policy>
+    RunResult Run(Policy& policy, TranslationCache::Reader& reader, uint64_t budget) {
+        return Guarded(budget, [&] { return Loop(policy, reader, budget); });
+    }
+
+    RunResult Run(TranslationCache::Reader& reader, uint64_t budget);
+
+    // Like Run(), also stops before executing the instruction at breakpoint
+    // (StopReason::BREAKPOINT); Run(1) steps over it.
+    template<typename Policy>
+    RunResult RunUntil(Policy& policy, int32_t breakpoint, uint64_t budget = UINT64_MAX) {
+        return Guarded(budget, [&] {
+            return Countdown(policy, Decode{}, budget, [this, breakpoint] { return pc == breakpoint; });
+        });
+    }
+
+    RunResult RunUntil(int32_t breakpoint, uint64_t budget = UINT64_MAX);
+
     void Dump(int max_reg = 32) const {
 
         if (max_reg > 32) {
@@ -84,24 +190,253 @@ public:
         std::cout << "++++++++++++++++++++++++++\n";
     }
 
-    void Stop() {
+    // Power-on state at programCounter for the next guest: registers, halt,
+    // reservation and histories are cleared, the syscall handler, hart id
+    // and wfi setting are kept
+    void Reset(int32_t programCounter) {
+        for (RegisterIndex idx = 1; idx < NUM_REGISTER; ++idx) {
+            reg[idx] = 0U;
+        }
+        pc = programCounter;
+        isHalt = false;
+        stopReason = StopReason::NONE;
+        countdown = 0;
+        stopped = 0;
+        syscalls = 0;
+        reservation = Reservation{};
+        shadowStack.Clear();
+        flightRecorder.Clear();
+    }
+
+    // Ends the current loop after the executing instruction
+    void Stop(StopReason reason = StopReason::HALT) {
         isHalt = true;
+        stopReason = reason;
+        if (countdown != 0) {
+            stopped = countdown - 1;
+            countdown = 1;
+        }
     }
 
-    void Run() {
+    // Clears the halt, the next loop continues from pc
+    void Resume() {
         isHalt = false;
+        stopReason = StopReason::NONE;
     }
 
     bool IsStop() const {
         return isHalt;
     }
 
+    // wfi is a no-op (a legal implementation) unless a scheduler wants the
+    // hart back while it idles: then the run ends with StopReason::WAIT
+    // after the wfi, and Resume() continues past it
+    void WaitForInterrupt() {
+        if (wfiStops) {
+            Stop(StopReason::WAIT);
+        }
+    }
+
+    void SetWfiStops(bool stops) {
+        wfiStops = stops;
+    }
+
+    StopReason GetStopReason() const {
+        return stopReason;
+    }
+
+    ShadowStack& GetShadowStack() {
+        return shadowStack;
+    }
+
+    // Takes over ecall from the host syscall passthrough, returns false to
+    // fall back to it. Reads arguments and writes a0 through the hart.
+    using SyscallHandler = std::function<bool(Hart&)>;
+
+    void SetSyscallHandler(SyscallHandler handler) {
+        syscallHandler = std::move(handler);
+    }
+
+    bool HandleSyscall() {
+        return syscallHandler && syscallHandler(*this);
+    }
+
+    // mhartid
+    uint32_t GetHartId() const {
+        return hartId;
+    }
+
+    void SetHartId(uint32_t id) {
+        hartId = id;
+    }
+
+    void CountSyscall() {
+        ++syscalls;
+    }
+
+    uint64_t Syscalls() const {
+        return syscalls;
+    }
+
+    FlightRecorder& GetFlightRecorder() {
+        return flightRecorder;
+    }
+
 private:
+    struct Decode {
+        Instruction operator()(uint32_t binInstruction) const {
+            return Decoder::Decode(binInstruction);
+        }
+    };
+
+    struct CachedDecode {
+        DecodeCache& cache;
+
+        const Instruction& operator()(uint32_t binInstruction) const {
+            return cache.Lookup(binInstruction);
+        }
+    };
+
+    struct ImageDecode {
+        const DecodeImage& image;
+        const int32_t& pc;
+
+        DecodeImage::Entry operator()(uint32_t binInstruction) const {
+            return image.Lookup(pc, binInstruction);
+        }
+    };
+
+    // Walks the block of the shared cache that pc is in. A word that differs
+    // from the block was rewritten by the guest: the block is invalidated
+    // and the word decoded here, as it is while another hart decodes the
+    // block.
+    struct SharedDecode {
+        struct Cursor {
+            const TranslationCache::Block* block = nullptr;
+            size_t index = 0;
+            int32_t next = 0;
+            DecodeImage::Entry decoded{};
+        };
+
+        TranslationCache::Reader& reader;
+        const int32_t& pc;
+        Cursor& cursor;
+
+        const DecodeImage::Entry& operator()(uint32_t binInstruction) const {
+            if (cursor.block == nullptr || pc != cursor.next || cursor.index == cursor.block->Size()) {
+                // Between blocks: the previous one is no longer referenced
+                reader.Quiescent();
+                cursor.block = reader.Cache().Find(pc);
+                cursor.index = 0;
+            }
+
+            if (cursor.block != nullptr) [[likely]] {
+                if (cursor.block->codes[cursor.index] == binInstruction) [[likely]] {
+                    cursor.next = pc + static_cast<int32_t>(sizeof(uint32_t));
+                    return cursor.block->entries[cursor.index++];
+                }
+                reader.Cache().Invalidate(cursor.block);
+                cursor.block = nullptr;
+            }
+            cursor.decoded = DecodeImage::Decode(binInstruction);
+            return cursor.decoded;
+        }
+    };
+
+    struct NoBreakpoint {
+        constexpr bool operator()() const {
+            return false;
+        }
+    };
+
+    template<typename Policy, typename DecodeFunc>
+    void Step(Policy& policy, const DecodeFunc& decode, bool requireSkip = false) {
+        uint32_t binInstruction = Load(pc);
+        flightRecorder.Record(pc, binInstruction);
+        if constexpr (Policy::ENABLED) {
+            policy.Before(*this, binInstruction);
+        }
+
+        const auto& instruction = decode(binInstruction);
+        bool shiftPC = instruction.PFN_Instruction(*this, instruction.param1, instruction.param2, instruction.param3);
+
+        if (shiftPC && !requireSkip) {
+            NextInstructionPC();
+        }
+
+        if constexpr (Policy::ENABLED) {
+            policy.After(*this, binInstruction);
+        }
+    }
+
+    // The loop checks a single counter per instruction: Stop() cuts it to
+    // the executing instruction and remembers what was left in stopped.
+    template<typename Policy, typename DecodeFunc, typename Breakpoint>
+    uint64_t Countdown(Policy& policy, const DecodeFunc& decode, uint64_t budget, const Breakpoint& breakpoint) {
+        if (IsStop()) {
+            return 0;
+        }
+
+        countdown = budget;
+        stopped = 0;
+        while (countdown != 0 && !breakpoint()) {
+            Step(policy, decode);
+            --countdown;
+        }
+        return Executed(budget);
+    }
+
+    uint64_t Executed(uint64_t budget) {
+        const uint64_t executed = budget - countdown - stopped;
+        countdown = 0;
+        return executed;
+    }
+
+    template<typename Func>
+    RunResult Guarded(uint64_t budget, Func&& run) {
+        RunResult result;
+        try {
+            result.retired = run();
+        } catch (const char* message) {
+            result.retired = Executed(budget);
+            result.fault = message;
+            Stop(StopReason::FAULT);
+        } catch (const std::exception& exception) {
+            result.retired = Executed(budget);
+            result.fault = exception.what();
+            Stop(StopReason::FAULT);
+        }
+
+        if (IsStop()) {
+            result.reason = stopReason;
+        } else {
+            result.reason = result.retired == budget ? StopReason::BUDGET : StopReason::BREAKPOINT;
+        }
+        return result;
+    }
+
+    struct Reservation {
+        bool valid = false;
+        int32_t address = 0;
+        uint32_t value = 0;
+    };
+
     std::array<Register, NUM_REGISTER> reg{Register::REGISTER_MODE::ZERO, Register::REGISTER_MODE::DEFAULT};
     int32_t pc = 0x100d8; 
 
     Machine& machine;
     bool isHalt = false;
+    StopReason stopReason = StopReason::NONE;
+    uint64_t countdown = 0;
+    uint64_t stopped = 0;
+    uint64_t syscalls = 0;
+    uint32_t hartId = 0;
+    bool wfiStops = false;
+    Reservation reservation;
+    SyscallHandler syscallHandler;
+
+    ShadowStack shadowStack;
+    FlightRecorder flightRecorder;
 };
 
 }
\ No newline at end of file
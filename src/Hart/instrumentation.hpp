@@ -0,0 +1,325 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <unordered_map>
+#include <bitset>
+#include <variant>
+#include <algorithm>
+#include <vector>
+
+#include "hart.hpp"
+#include <trace.hpp>
+#include <traceDiff.hpp>
+#include <profiler.hpp>
+#include <callGraph.hpp>
+#include <region.hpp>
+#include <timing.hpp>
+
+// Instrumentation policies for Hart::Execute/Hart::Loop.
+//
+// A policy provides:
+//   constexpr static bool ENABLED;
+//   void Before(Hart& hart, uint32_t binInstruction); // pc is not moved yet
+//   void After(Hart& hart, uint32_t binInstruction);  // pc points to the next instruction
+//
+// The loop is instantiated once per policy, so hooks of a disabled policy are
+// compiled out and the default NoTrace loop pays nothing for them.
+//
+// Statistics policies may also provide Pause/Resume/Reset(), see Roi.
+
+namespace RISCVS::Instrumentation {
+
+struct NoTrace {
+    constexpr static bool ENABLED = false;
+
+    void Before(Hart&, uint32_t) {}
+    void After(Hart&, uint32_t) {}
+};
+
+// Binary trace of every executed instruction, see trace.hpp
+class Trace {
+public:
+    constexpr static bool ENABLED = true;
+
+    explicit Trace(TraceStream& stream) : stream(&stream) {}
+
+    void Before(Hart& hart, uint32_t binInstruction) {
+        stream->Before(hart, binInstruction);
+    }
+
+    void After(Hart& hart, uint32_t) {
+        stream->After(hart);
+    }
+
+private:
+    TraceStream* stream;
+};
+
+// Execution counts per static instruction, see profiler.hpp
+class Profile {
+public:
+    constexpr static bool ENABLED = true;
+
+    explicit Profile(BlockProfiler& profiler) : profiler(&profiler) {}
+
+    void Before(Hart& hart, uint32_t) {
+        pc = hart.GetPC();
+    }
+
+    void After(Hart& hart, uint32_t binInstruction) {
+        profiler->Count(pc, binInstruction, hart.GetPC());
+    }
+
+    void Pause() {
+        profiler->Pause();
+    }
+
+    void Resume() {
+        profiler->Resume();
+    }
+
+    void Reset() {
+        profiler->Reset();
+    }
+
+private:
+    BlockProfiler* profiler;
+    int32_t pc = 0;
+};
+
+// Exact per-function attribution through the hart shadow stack, see callGraph.hpp
+class CallProfile {
+public:
+    constexpr static bool ENABLED = true;
+
+    explicit CallProfile(CallGraph& callGraph) : callGraph(&callGraph) {}
+
+    void Before(Hart&, uint32_t) {}
+
+    void After(Hart& hart, uint32_t binInstruction) {
+        callGraph->Count(hart, binInstruction);
+    }
+
+    void Pause() {
+        callGraph->Pause();
+    }
+
+    void Resume() {
+        callGraph->Resume();
+    }
+
+    void Reset() {
+        callGraph->Reset();
+    }
+
+private:
+    CallGraph* callGraph;
+};
+
+// Set of executed static instructions
+class Coverage {
+public:
+    constexpr static bool ENABLED = true;
+    constexpr static uint32_t PAGE_INSTRUCTIONS = 1024U;
+
+    void Before(Hart& hart, uint32_t) {
+        const uint32_t index = static_cast<uint32_t>(hart.GetPC()) / sizeof(uint32_t);
+        const uint32_t page = index / PAGE_INSTRUCTIONS;
+        if (page != lastPage || lastBits == nullptr) {
+            lastPage = page;
+            lastBits = &pages[page];
+        }
+        lastBits->set(index % PAGE_INSTRUCTIONS);
+    }
+
+    void After(Hart&, uint32_t) {}
+
+    void Reset() {
+        pages.clear();
+        lastBits = nullptr;
+    }
+
+    size_t Count() const {
+        size_t count = 0;
+        for (const auto& [page, bits] : pages) {
+            count += bits.count();
+        }
+        return count;
+    }
+
+    // One covered pc per line, sorted
+    void Write(std::ostream& out) const {
+        std::vector<uint32_t> sorted;
+        for (const auto& [page, bits] : pages) {
+            sorted.push_back(page);
+        }
+        std::sort(sorted.begin(), sorted.end());
+
+        out << std::hex;
+        for (uint32_t page : sorted) {
+            const auto& bits = pages.at(page);
+            for (uint32_t i = 0; i < PAGE_INSTRUCTIONS; ++i) {
+                if (bits.test(i)) {
+                    out << "0x" << (page * PAGE_INSTRUCTIONS + i) * sizeof(uint32_t) << '\n';
+                }
+            }
+        }
+        out << std::dec;
+    }
+
+private:
+    std::unordered_map<uint32_t, std::bitset<PAGE_INSTRUCTIONS>> pages;
+    uint32_t lastPage = 0;
+    std::bitset<PAGE_INSTRUCTIONS>* lastBits = nullptr;
+};
+
+// Compares every executed instruction with a reference trace,
+// the hart is stopped on the first divergence
+class Lockstep {
+public:
+    constexpr static bool ENABLED = true;
+
+    explicit Lockstep(TraceDiffer& differ) : differ(&differ) {}
+
+    void Before(Hart& hart, uint32_t binInstruction) {
+        CaptureBefore(current, hart, binInstruction);
+    }
+
+    void After(Hart& hart, uint32_t) {
+        CaptureAfter(current, hart);
+        if (!differ->Check(current)) {
+            hart.Stop();
+        }
+    }
+
+private:
+    TraceDiffer* differ;
+    TraceRecord current;
+};
+
+// Feeds every retired instruction to a TimingModel, see timing.hpp
+class Timing {
+public:
+    constexpr static bool ENABLED = true;
+
+    explicit Timing(TimingStream& stream) : stream(&stream) {}
+
+    void Before(Hart& hart, uint32_t binInstruction) {
+        stream->Before(hart, binInstruction);
+    }
+
+    void After(Hart& hart, uint32_t) {
+        stream->After(hart);
+    }
+
+    void Pause() {
+        stream->Pause();
+    }
+
+    void Resume() {
+        stream->Resume();
+    }
+
+    void Reset() {
+        stream->Reset();
+    }
+
+private:
+    TimingStream* stream;
+};
+
+// Honors the guest region-of-interest markers (Decoder::Marker) on top of a
+// statistics policy. A policy with Pause/Resume sees every instruction and
+// gates itself (it may need to follow calls outside of the region), any
+// other policy is simply not called outside of the region.
+template<typename Inner>
+class Roi {
+public:
+    constexpr static bool ENABLED = true;
+
+    explicit Roi(Region& region, Inner inner = {}) : region(&region), inner(std::move(inner)) {
+        if constexpr (SELF_GATED) {
+            if (!region.Active()) {
+                this->inner.Pause();
+            }
+        }
+    }
+
+    void Before(Hart& hart, uint32_t binInstruction) {
+        if (const Decoder::Marker marker = Decoder::GetMarker(binInstruction); marker != Decoder::Marker::NONE) [[unlikely]] {
+            Mark(hart, marker);
+        }
+        if constexpr (Inner::ENABLED) {
+            if (SELF_GATED || region->Active()) {
+                inner.Before(hart, binInstruction);
+            }
+        }
+    }
+
+    void After(Hart& hart, uint32_t binInstruction) {
+        region->Count();
+        if constexpr (Inner::ENABLED) {
+            if (SELF_GATED || region->Active()) {
+                inner.After(hart, binInstruction);
+            }
+        }
+    }
+
+    Inner& GetInner() {
+        return inner;
+    }
+
+private:
+    constexpr static bool SELF_GATED = requires(Inner& policy) { policy.Pause(); policy.Resume(); };
+
+    void Mark(Hart& hart, Decoder::Marker marker) {
+        switch (marker) {
+            case Decoder::Marker::START:
+                region->Start();
+                if constexpr (SELF_GATED) {
+                    inner.Resume();
+                }
+                break;
+            case Decoder::Marker::STOP:
+                region->Stop();
+                if constexpr (SELF_GATED) {
+                    inner.Pause();
+                }
+                break;
+            case Decoder::Marker::RESET:
+                region->Reset();
+                if constexpr (requires { inner.Reset(); }) {
+                    inner.Reset();
+                }
+                break;
+            case Decoder::Marker::DUMP:
+                region->Dump(hart);
+                break;
+            default:
+                break;
+        }
+    }
+
+    Region* region;
+    Inner inner;
+};
+
+// Chosen at startup, every alternative gets its own specialized loop
+using Policy = std::variant<NoTrace, Trace, Roi<NoTrace>, Roi<Profile>, Roi<CallProfile>, Roi<Coverage>, Lockstep,
+                            Roi<Timing>>;
+
+inline uint64_t Loop(Hart& hart, Policy& policy, uint64_t budget = UINT64_MAX) {
+    return std::visit([&hart, budget](auto& concrete) { return hart.Loop(concrete, budget); }, policy);
+}
+
+inline uint64_t Loop(Hart& hart, Policy& policy, DecodeCache& cache, uint64_t budget = UINT64_MAX) {
+    return std::visit([&hart, &cache, budget](auto& concrete) { return hart.Loop(concrete, cache, budget); }, policy);
+}
+
+inline uint64_t Loop(Hart& hart, Policy& policy, const DecodeImage& image, uint64_t budget = UINT64_MAX) {
+    return std::visit([&hart, &image, budget](auto& concrete) { return hart.Loop(concrete, image, budget); }, policy);
+}
+
+} // namespace RISCVS::Instrumentation
@@ -0,0 +1,55 @@
+#include "multiHart.hpp"
+
+#include <latch>
+#include <stdexcept>
+#include <thread>
+
+namespace RISCVS {
+
+MultiHart::MultiHart(Machine& machine, size_t count, int32_t entry) {
+    if (count > 1 && !machine.Shareable()) {
+        throw std::runtime_error("Several harts need the mmap backend");
+    }
+
+    constexpr Hart::RegisterIndex A0 = 10;
+    for (size_t id = 0; id < count; ++id) {
+        auto& hart = harts.emplace_back(std::make_unique<Hart>(machine, entry));
+        hart->SetHartId(id);
+        (*hart)[A0] = id;
+    }
+}
+
+std::vector<RunResult> MultiHart::Run(uint64_t budget) {
+    std::vector<RunResult> results(harts.size());
+    std::latch start{static_cast<std::ptrdiff_t>(harts.size())};
+    {
+        std::vector<std::jthread> threads;
+        threads.reserve(harts.size());
+        for (size_t id = 0; id < harts.size(); ++id) {
+            threads.emplace_back([this, id, budget, &results, &start] {
+                start.arrive_and_wait();
+                results[id] = harts[id]->Run(budget);
+            });
+        }
+    }
+    return results;
+}
+
+std::vector<RunResult> MultiHart::Run(TranslationCache& cache, uint64_t budget) {
+    std::vector<RunResult> results(harts.size());
+    std::latch start{static_cast<std::ptrdiff_t>(harts.size())};
+    {
+        std::vector<std::jthread> threads;
+        threads.reserve(harts.size());
+        for (size_t id = 0; id < harts.size(); ++id) {
+            threads.emplace_back([this, id, budget, &cache, &results, &start] {
+                TranslationCache::Reader reader{cache};
+                start.arrive_and_wait();
+                results[id] = harts[id]->Run(reader, budget);
+            });
+        }
+    }
+    return results;
+}
+
+} // namespace RISCVS
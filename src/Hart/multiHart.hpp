@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "hart.hpp"
+
+namespace RISCVS {
+
+// Harts sharing one Machine, each running on its own host thread. Hart i
+// starts at entry with mhartid = a0 = i; guest memory is accessed with the
+// ordering described in Machine (relaxed accesses, fence is a full fence).
+class MultiHart {
+public:
+    // Throws if count > 1 and the machine cannot be shared
+    MultiHart(Machine& machine, size_t count, int32_t entry);
+
+    size_t Size() const {
+        return harts.size();
+    }
+
+    Hart& operator[](size_t id) {
+        return *harts[id];
+    }
+
+    // Runs all harts concurrently until each one stops or spends budget,
+    // returns the result of every hart
+    std::vector<RunResult> Run(uint64_t budget = UINT64_MAX);
+
+    // Same, the harts execute decoded blocks from one shared cache
+    std::vector<RunResult> Run(TranslationCache& cache, uint64_t budget = UINT64_MAX);
+
+private:
+    std::vector<std::unique_ptr<Hart>> harts;
+};
+
+} // namespace RISCVS
@@ -0,0 +1,228 @@
+#include "scheduler.hpp"
+
+#include <algorithm>
+#include <cerrno>
+
+#include <linux/futex.h>
+
+namespace RISCVS {
+
+namespace {
+
+// RISC-V Linux syscall numbers
+constexpr uint32_t SYS_FUTEX = 98;
+constexpr uint32_t SYS_SCHED_YIELD = 124;
+constexpr uint32_t SYS_FUTEX_TIME64 = 422;
+
+constexpr Hart::RegisterIndex A0 = 10;
+constexpr Hart::RegisterIndex A7 = 17;
+
+Hart::RegisterIndex Arg(unsigned index) {
+    return A0 + index;
+}
+
+} // anon namespace
+
+Scheduler::Task& Scheduler::Task::operator=(Task&& other) noexcept {
+    if (this != &other) {
+        if (handle) {
+            handle.destroy();
+        }
+        handle = std::exchange(other.handle, nullptr);
+    }
+    return *this;
+}
+
+Scheduler::Task::~Task() {
+    if (handle) {
+        handle.destroy();
+    }
+}
+
+Hart& Scheduler::Add(Machine& machine, int32_t entry) {
+    const size_t id = slots.size();
+    Slot& slot = slots.emplace_back();
+    slot.hart = std::make_unique<Hart>(machine, entry);
+    slot.machine = &machine;
+
+    Hart& hart = *slot.hart;
+    hart.SetHartId(id);
+    hart[A0] = id;
+    hart.SetWfiStops(true);
+    hart.SetSyscallHandler([this, id](Hart&) {
+        return Syscall(id);
+    });
+
+    slot.task = Execute(id);
+    return hart;
+}
+
+void Scheduler::Wake(size_t id) {
+    if (slots[id].park == Park::WFI) {
+        Unpark(id);
+    }
+}
+
+std::vector<RunResult> Scheduler::Run(uint64_t budget) {
+    ready.clear();
+    for (size_t id = 0; id < slots.size(); ++id) {
+        Slot& slot = slots[id];
+        slot.left = budget;
+        if (!slot.task.handle.done() && slot.park == Park::NONE) {
+            ready.push_back(id);
+        }
+    }
+
+    do {
+        while (!ready.empty()) {
+            const size_t id = ready.front();
+            ready.pop_front();
+            ++switches;
+            slots[id].task.handle.resume();
+        }
+    } while (Idle());
+
+    std::vector<RunResult> results;
+    results.reserve(slots.size());
+    for (const Slot& slot : slots) {
+        RunResult& result = results.emplace_back(slot.result);
+        if (slot.park != Park::NONE) {
+            result.reason = StopReason::WAIT;
+        }
+    }
+    return results;
+}
+
+Scheduler::Task Scheduler::Execute(size_t id) {
+    Slot& slot = slots[id];
+    Hart& hart = *slot.hart;
+    for (;;) {
+        // Out of budget: sleeps until the next Run()
+        if (slot.left == 0) {
+            slot.result.reason = StopReason::BUDGET;
+            co_await Suspend{*this, id, false};
+            continue;
+        }
+
+        const RunResult run = hart.Run(std::min(quantum, slot.left));
+        slot.left -= run.retired;
+        slot.result.retired += run.retired;
+        slot.result.reason = run.reason;
+        slot.result.fault = run.fault;
+
+        switch (run.reason) {
+            case StopReason::BUDGET:
+                // Quantum spent or sched_yield, which stops the hart
+                hart.Resume();
+                co_await Suspend{*this, id, true};
+                break;
+            case StopReason::WAIT:
+                // A blocking syscall has parked the hart already
+                if (slot.park == Park::NONE) {
+                    slot.park = Park::WFI;
+                }
+                hart.Resume();
+                co_await Suspend{*this, id, false};
+                break;
+            default:
+                co_return;
+        }
+    }
+}
+
+bool Scheduler::Syscall(size_t id) {
+    Hart& hart = *slots[id].hart;
+    switch (static_cast<uint32_t>(hart[A7])) {
+        case SYS_FUTEX:
+        case SYS_FUTEX_TIME64:
+            hart[A0] = Futex(id);
+            return true;
+        case SYS_SCHED_YIELD:
+            // Ends the quantum early, the hart goes to the back of the queue
+            hart[A0] = 0;
+            hart.Stop(StopReason::BUDGET);
+            return true;
+        default:
+            return false;
+    }
+}
+
+int32_t Scheduler::Futex(size_t id) {
+    Slot& slot = slots[id];
+    Hart& hart = *slot.hart;
+    const uint32_t address = hart[Arg(0)];
+    const uint32_t op = hart[Arg(1)];
+    const uint32_t value = hart[Arg(2)];
+    const uint32_t timeout = hart[Arg(3)];
+    uint32_t bitset = hart[Arg(5)];
+
+    if (address % sizeof(uint32_t) != 0) {
+        return -EINVAL;
+    }
+
+    switch (op & FUTEX_CMD_MASK) {
+        case FUTEX_WAIT:
+            bitset = FUTEX_BITSET_MATCH_ANY;
+            [[fallthrough]];
+        case FUTEX_WAIT_BITSET:
+            if (bitset == 0) {
+                return -EINVAL;
+            }
+            if (slot.machine->Load<uint32_t>(address) != value) {
+                return -EAGAIN;
+            }
+            // a0 = 0 unless the wait times out
+            slot.park = Park::FUTEX;
+            slot.futexAddress = address;
+            slot.futexBitset = bitset;
+            slot.timed = timeout != 0;
+            futexWaiters.push_back(id);
+            hart.Stop(StopReason::WAIT);
+            return 0;
+        case FUTEX_WAKE:
+            return FutexWake(slot.machine, address, value, FUTEX_BITSET_MATCH_ANY);
+        case FUTEX_WAKE_BITSET:
+            return bitset == 0 ? -EINVAL : FutexWake(slot.machine, address, value, bitset);
+        default:
+            return -ENOSYS;
+    }
+}
+
+int32_t Scheduler::FutexWake(Machine* machine, uint32_t address, uint32_t count, uint32_t bitset) {
+    // Waiters are woken in the order they blocked
+    int32_t woken = 0;
+    for (auto it = futexWaiters.begin(); it != futexWaiters.end() && static_cast<uint32_t>(woken) < count;) {
+        const Slot& waiter = slots[*it];
+        if (waiter.machine == machine && waiter.futexAddress == address && (waiter.futexBitset & bitset) != 0) {
+            Unpark(*it);
+            it = futexWaiters.erase(it);
+            ++woken;
+        } else {
+            ++it;
+        }
+    }
+    return woken;
+}
+
+void Scheduler::Unpark(size_t id) {
+    slots[id].park = Park::NONE;
+    ready.push_back(id);
+}
+
+bool Scheduler::Idle() {
+    bool timedOut = false;
+    for (auto it = futexWaiters.begin(); it != futexWaiters.end();) {
+        Slot& waiter = slots[*it];
+        if (waiter.timed) {
+            (*waiter.hart)[A0] = static_cast<uint32_t>(-ETIMEDOUT);
+            Unpark(*it);
+            it = futexWaiters.erase(it);
+            timedOut = true;
+        } else {
+            ++it;
+        }
+    }
+    return timedOut;
+}
+
+} // namespace RISCVS
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "hart.hpp"
+
+namespace RISCVS {
+
+// Many harts on the calling thread. Every hart is a coroutine that runs a
+// quantum of instructions and co_awaits the scheduler; harts blocked in
+// futex or wfi are parked until an event puts them back in the run queue.
+// There is no host thread per hart, so no OS context switch and no lock:
+// the run queue is round robin in Add() order and a run is reproducible,
+// same guests and same quantum give the same interleaving.
+//
+// Blocking is handled by the syscall handler the scheduler installs on its
+// harts (futex wait/wake, sched_yield; other syscalls take the usual ecall
+// path) and by wfi. The only clock is progress: when nothing is runnable,
+// timed futex waits time out, otherwise Run() returns with the parked harts
+// reporting StopReason::WAIT.
+class Scheduler {
+public:
+    constexpr static uint64_t DEFAULT_QUANTUM = 1U << 12U;
+
+    explicit Scheduler(uint64_t quantum = DEFAULT_QUANTUM) : quantum(quantum) {}
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    // A new hart at entry with mhartid = a0 = its id. Harts may run on
+    // different machines (independent guests) or share one, futexes are
+    // keyed by machine and address.
+    Hart& Add(Machine& machine, int32_t entry);
+
+    size_t Size() const {
+        return slots.size();
+    }
+
+    Hart& operator[](size_t id) {
+        return *slots[id].hart;
+    }
+
+    // Host event (a device interrupt, an IPI): resumes a hart parked in wfi
+    void Wake(size_t id);
+
+    // Runs until every hart stops, spends budget or is parked with nothing
+    // left to wake it; may be called again after Wake()
+    std::vector<RunResult> Run(uint64_t budget = UINT64_MAX);
+
+    // Coroutine resumptions so far
+    uint64_t Switches() const {
+        return switches;
+    }
+
+private:
+    class Task {
+    public:
+        struct promise_type {
+            Task get_return_object() {
+                return Task{std::coroutine_handle<promise_type>::from_promise(*this)};
+            }
+
+            std::suspend_always initial_suspend() noexcept {
+                return {};
+            }
+
+            std::suspend_always final_suspend() noexcept {
+                return {};
+            }
+
+            void return_void() {}
+
+            // Guest faults are already caught by Hart::Run()
+            void unhandled_exception() {
+                std::terminate();
+            }
+        };
+
+        Task() = default;
+        explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+        Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+        Task& operator=(Task&& other) noexcept;
+        ~Task();
+
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    // Suspends the running hart; requeue puts it at the back of the run
+    // queue, otherwise it stays parked until an event
+    struct Suspend {
+        Scheduler& scheduler;
+        size_t id;
+        bool requeue;
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<>) const {
+            if (requeue) {
+                scheduler.ready.push_back(id);
+            }
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    enum class Park {
+        NONE,
+        FUTEX,
+        WFI,
+    };
+
+    struct Slot {
+        std::unique_ptr<Hart> hart;
+        Machine* machine;
+        RunResult result;
+        uint64_t left = 0;          // budget of the current Run()
+
+        Park park = Park::NONE;
+        uint32_t futexAddress = 0;
+        uint32_t futexBitset = 0;
+        bool timed = false;
+
+        Task task;
+    };
+
+    Task Execute(size_t id);
+
+    bool Syscall(size_t id);
+    int32_t Futex(size_t id);
+    int32_t FutexWake(Machine* machine, uint32_t address, uint32_t count, uint32_t bitset);
+    void Unpark(size_t id);
+
+    // Nothing is runnable: times out the timed futex waits, returns false
+    // if there were none
+    bool Idle();
+
+    uint64_t quantum;
+    std::deque<Slot> slots;         // element addresses are stable
+    std::deque<size_t> ready;
+    std::deque<size_t> futexWaiters;
+    uint64_t switches = 0;
+};
+
+} // namespace RISCVS
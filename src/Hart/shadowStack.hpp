@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace RISCVS {
+
+// Guest call stack reconstructed from calls (jal/jalr with rd = ra) and
+// returns (jalr x0, ra, 0). Maintained only by the call graph profiler.
+class ShadowStack {
+public:
+    struct Frame {
+        uint32_t context;      // caller-defined id of the calling context
+        int32_t returnAddress;
+    };
+
+    void Push(uint32_t context, int32_t returnAddress) {
+        frames.push_back(Frame{.context = context, .returnAddress = returnAddress});
+    }
+
+    // Pops frames up to the one returning to returnAddress, so frames skipped
+    // by longjmp-like control flow are dropped, and gives back its context.
+    // Returns false and keeps the stack untouched if no frame matches.
+    bool Return(int32_t returnAddress, uint32_t& context) {
+        for (size_t i = frames.size(); i > 0; --i) {
+            if (frames[i - 1].returnAddress == returnAddress) {
+                context = frames[i - 1].context;
+                frames.resize(i - 1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool Empty() const {
+        return frames.empty();
+    }
+
+    const Frame& Top() const {
+        return frames.back();
+    }
+
+    size_t Depth() const {
+        return frames.size();
+    }
+
+    void Clear() {
+        frames.clear();
+    }
+
+private:
+    std::vector<Frame> frames;
+};
+
+} // namespace RISCVS
@@ -0,0 +1,177 @@
+#include "translationCache.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <functional>
+#include <utility>
+
+namespace RISCVS {
+
+namespace {
+
+// Instructions after which the next pc is not known when decoding
+bool EndsBlock(Decoder::Handler handler) {
+    using namespace InstructionSet;
+    constexpr Decoder::Handler ENDS[] = {Beq, Bne, Blt, Bge, BltU, BgeU, Jal, Jalr, ECall, EBreak, Wfi, FenceI};
+    return std::find(std::begin(ENDS), std::end(ENDS), handler) != std::end(ENDS);
+}
+
+} // anon namespace
+
+TranslationCache::Reader::Reader(TranslationCache& cache) : cache(cache) {
+    std::lock_guard lock{cache.mutex};
+    cache.readers.push_back(this);
+}
+
+TranslationCache::Reader::~Reader() {
+    std::lock_guard lock{cache.mutex};
+    std::erase(cache.readers, this);
+    cache.ReclaimLocked();
+}
+
+TranslationCache::TranslationCache(Machine& machine, size_t buckets)
+    : machine(machine), bucketCount(std::bit_ceil(std::max<size_t>(buckets, 2))),
+      shift(32 - std::countr_zero(bucketCount)) {
+    this->buckets = std::make_unique<std::atomic<Block*>[]>(bucketCount);
+}
+
+TranslationCache::~TranslationCache() {
+    for (size_t i = 0; i < bucketCount; ++i) {
+        Block* block = buckets[i].load(std::memory_order_relaxed);
+        while (block != nullptr) {
+            delete std::exchange(block, block->next.load(std::memory_order_relaxed));
+        }
+    }
+    for (const Retired& entry : retired) {
+        delete entry.block;
+    }
+}
+
+const TranslationCache::Block* TranslationCache::Translate(int32_t pc) {
+    std::atomic<Block*>& bucket = buckets[Index(pc)];
+    {
+        std::lock_guard lock{mutex};
+        // Linked while this hart was looking
+        for (const Block* block = bucket.load(std::memory_order_relaxed); block != nullptr;
+             block = block->next.load(std::memory_order_relaxed)) {
+            if (block->start == pc) {
+                return block;
+            }
+        }
+        if (!translating.insert(pc).second) {
+            ++stats.contended;
+            return nullptr;
+        }
+    }
+
+    std::unique_ptr<Block> block;
+    try {
+        block = Build(pc);
+    } catch (...) {
+        // Unreadable pc: the interpreter reports the fault
+    }
+
+    std::lock_guard lock{mutex};
+    translating.erase(pc);
+    if (block == nullptr) {
+        return nullptr;
+    }
+    block->next.store(bucket.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    bucket.store(block.get(), std::memory_order_release);
+    ++stats.translations;
+    return block.release();
+}
+
+std::unique_ptr<TranslationCache::Block> TranslationCache::Build(int32_t pc) const {
+    auto block = std::make_unique<Block>();
+    block->start = pc;
+    for (int32_t address = pc; block->Size() < MAX_BLOCK; address += sizeof(uint32_t)) {
+        const uint32_t binInstruction = machine.Load<uint32_t>(address);
+        DecodeImage::Entry entry;
+        try {
+            entry = DecodeImage::Decode(binInstruction);
+        } catch (const std::bad_function_call&) {
+            break;
+        }
+        block->codes.push_back(binInstruction);
+        block->entries.push_back(entry);
+        if (EndsBlock(entry.PFN_Instruction)) {
+            break;
+        }
+    }
+    return block->Size() == 0 ? nullptr : std::move(block);
+}
+
+void TranslationCache::Invalidate(const Block* stale) {
+    std::lock_guard lock{mutex};
+    std::atomic<Block*>* link = &buckets[Index(stale->start)];
+    for (Block* block = link->load(std::memory_order_relaxed); block != nullptr;
+         link = &block->next, block = link->load(std::memory_order_relaxed)) {
+        if (block == stale) {
+            Retire(*link, block);
+            break;
+        }
+    }
+    ReclaimLocked();
+}
+
+void TranslationCache::Invalidate(uint32_t address, uint32_t size) {
+    std::lock_guard lock{mutex};
+    const uint64_t end = static_cast<uint64_t>(address) + size;
+    for (size_t i = 0; i < bucketCount; ++i) {
+        std::atomic<Block*>* link = &buckets[i];
+        Block* block = link->load(std::memory_order_relaxed);
+        while (block != nullptr) {
+            const uint32_t start = static_cast<uint32_t>(block->start);
+            if (start < end && address < start + block->Size() * sizeof(uint32_t)) {
+                Retire(*link, block);
+            } else {
+                link = &block->next;
+            }
+            block = link->load(std::memory_order_relaxed);
+        }
+    }
+    ReclaimLocked();
+}
+
+void TranslationCache::Retire(std::atomic<Block*>& link, Block* block) {
+    // Readers already on the block still follow its next pointer
+    link.store(block->next.load(std::memory_order_relaxed), std::memory_order_release);
+    retired.push_back({block, epoch.fetch_add(1, std::memory_order_seq_cst)});
+    ++stats.invalidations;
+}
+
+void TranslationCache::Reclaim() {
+    std::lock_guard lock{mutex};
+    ReclaimLocked();
+}
+
+void TranslationCache::ReclaimLocked() {
+    if (retired.empty()) {
+        return;
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t oldest = UINT64_MAX;
+    for (const Reader* reader : readers) {
+        const uint64_t seen = reader->seen.load(std::memory_order_acquire);
+        if (seen != Reader::OFFLINE) {
+            oldest = std::min(oldest, seen);
+        }
+    }
+
+    // Free blocks retired before every online reader's last announcement
+    const auto freed = std::partition(retired.begin(), retired.end(),
+                                      [oldest](const Retired& entry) { return entry.epoch >= oldest; });
+    for (auto it = freed; it != retired.end(); ++it) {
+        delete it->block;
+        ++stats.reclaimed;
+    }
+    retired.erase(freed, retired.end());
+}
+
+TranslationCache::Stats TranslationCache::GetStats() const {
+    std::lock_guard lock{mutex};
+    return stats;
+}
+
+} // namespace RISCVS
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+#include <machine.hpp>
+#include "decodeImage.hpp"
+
+namespace RISCVS {
+
+// Decoded basic blocks shared by every hart of a Machine, keyed by the pc of
+// their first instruction. SPMD harts run the same code, so a block is
+// decoded once for all of them instead of once per hart.
+//
+// Lookups take no lock: buckets are singly linked lists published with
+// release stores. A miss claims the pc, decodes the block outside the lock
+// and links it; a hart that finds the pc claimed does not wait, it decodes
+// the instruction itself meanwhile. Blocks keep the words they were decoded
+// from and every executed word is compared with its record, so a block whose
+// code was rewritten is never executed: the hart that notices unlinks it.
+// Unlinked blocks are freed by quiescent-state based reclamation: a hart
+// announces the global epoch whenever it holds no block (between blocks),
+// and a block retired at epoch E is freed once every online hart has
+// announced a later epoch.
+class TranslationCache {
+public:
+    constexpr static size_t DEFAULT_BUCKETS = 1 << 14;
+    constexpr static size_t MAX_BLOCK = 64;
+
+    struct Block {
+        int32_t start;
+        std::vector<uint32_t> codes;
+        std::vector<DecodeImage::Entry> entries;
+        std::atomic<Block*> next{nullptr};
+
+        size_t Size() const {
+            return entries.size();
+        }
+
+        // One past the last instruction
+        int32_t End() const {
+            return start + static_cast<int32_t>(entries.size() * sizeof(uint32_t));
+        }
+    };
+
+    // Per hart (or host thread) registration for reclamation. Online while
+    // the hart executes from the cache, offline otherwise; an offline reader
+    // does not hold back freeing.
+    class Reader {
+    public:
+        explicit Reader(TranslationCache& cache);
+        ~Reader();
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        TranslationCache& Cache() {
+            return cache;
+        }
+
+        // No block is referenced by this reader from here on
+        void Quiescent() {
+            const uint64_t epoch = cache.epoch.load(std::memory_order_acquire);
+            if (seen.load(std::memory_order_relaxed) != epoch) {
+                seen.store(epoch, std::memory_order_relaxed);
+                // Later bucket loads must not be satisfied before the announcement
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+            }
+        }
+
+        void Offline() {
+            seen.store(OFFLINE, std::memory_order_release);
+        }
+
+    private:
+        friend class TranslationCache;
+        constexpr static uint64_t OFFLINE = 0;
+
+        TranslationCache& cache;
+        alignas(64) std::atomic<uint64_t> seen{OFFLINE};
+    };
+
+    // Keeps reader online for a scope, also when the run throws
+    class Online {
+    public:
+        explicit Online(Reader& reader) : reader(reader) {
+            reader.Quiescent();
+        }
+
+        ~Online() {
+            reader.Offline();
+        }
+
+        Online(const Online&) = delete;
+        Online& operator=(const Online&) = delete;
+
+    private:
+        Reader& reader;
+    };
+
+    struct Stats {
+        uint64_t translations = 0;
+        uint64_t contended = 0;       // misses that found the pc claimed
+        uint64_t invalidations = 0;
+        uint64_t reclaimed = 0;
+    };
+
+    // buckets is rounded up to a power of two
+    explicit TranslationCache(Machine& machine, size_t buckets = DEFAULT_BUCKETS);
+    ~TranslationCache();
+
+    TranslationCache(const TranslationCache&) = delete;
+    TranslationCache& operator=(const TranslationCache&) = delete;
+
+    // Block starting at pc, decoded on a miss. nullptr if another hart is
+    // decoding it or pc does not start a valid instruction: interpret then.
+    // The block stays valid until the reader's next Quiescent()/Offline().
+    const Block* Find(int32_t pc) {
+        for (const Block* block = buckets[Index(pc)].load(std::memory_order_acquire); block != nullptr;
+             block = block->next.load(std::memory_order_acquire)) {
+            if (block->start == pc) {
+                return block;
+            }
+        }
+        return Translate(pc);
+    }
+
+    // Unlinks a block found to be stale, no-op if another hart already did
+    void Invalidate(const Block* stale);
+
+    // Unlinks every block overlapping [address, address + size), for hosts
+    // that rewrite guest code
+    void Invalidate(uint32_t address, uint32_t size);
+
+    // Frees retired blocks no online reader can still hold
+    void Reclaim();
+
+    Stats GetStats() const;
+
+private:
+    struct Retired {
+        Block* block;
+        uint64_t epoch;
+    };
+
+    size_t Index(int32_t pc) const {
+        return (static_cast<uint32_t>(pc) >> 2) * 0x9E3779B1U >> shift;
+    }
+
+    const Block* Translate(int32_t pc);
+    std::unique_ptr<Block> Build(int32_t pc) const;
+    void Retire(std::atomic<Block*>& link, Block* block);
+    void ReclaimLocked();
+
+    Machine& machine;
+    std::unique_ptr<std::atomic<Block*>[]> buckets;
+    size_t bucketCount;
+    unsigned shift;
+
+    alignas(64) std::atomic<uint64_t> epoch{1};
+
+    // Writers: claims, linking, unlinking, reclamation and reader registration
+    alignas(64) mutable std::mutex mutex;
+    std::unordered_set<int32_t> translating;
+    std::vector<Retired> retired;
+    std::vector<Reader*> readers;
+    Stats stats;
+};
+
+// Self-modifying code and host rewrites through a TranslationCache (Test.cpp),
+// returns the number of failed tests
+int TestTranslationCache();
+
+} // namespace RISCVS
@@ -1,13 +1,13 @@
 #include "machine.hpp"
 
-#ifdef MMAP
-    #include <sys/mman.h>
-    #include <fcntl.h>
-    #include <unistd.h>
-    #include <sys/stat.h>
-    #include <errno.h>
-    #include <cstring>
-#endif // MMAP
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <cstring>
+#include <array>
+#include <vector>
 
 namespace RISCVS {
 
@@ -18,14 +18,51 @@ Machine::Machine() : ram(RAM_PATH) {
 }
 
 Machine::Machine(std::string_view code_path, uint32_t loadOffset) {
-    ;    
-#ifdef MMAP
     this->loadOffset_ = loadOffset;
     useFile_ = false;
 
-    int fd = open(code_path.data(), O_RDONLY);
+    MapMemory();
+    try {
+        LoadFile(code_path, loadOffset);
+    } catch (...) {
+        munmap(mmapRam_, MMAP_SIZE);
+        throw;
+    }
+
+    // printf("Successfully mapped 16GB of anonymous memory: %p with offset %d\n", mmapRam, loadOffset);
+    // std::cout << "Try read: " << std::bitset<32>{((uint32_t*)mmapRam)[loadOffset_/4U]} << '\n';
+}
+
+Machine::Machine(std::span<const uint8_t> image, uint32_t loadOffset) {
+    this->loadOffset_ = loadOffset;
+    useFile_ = false;
+
+    MapMemory();
+    WriteBlock(loadOffset, image);
+}
+
+void Machine::MapMemory() {
+    void *mmapRam = mmap(NULL, MMAP_SIZE,
+                        PROT_READ | PROT_WRITE,
+                        MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE,
+                        -1, 0);
+
+    if (mmapRam == MAP_FAILED) {
+        perror("mmap failed");
+        throw std::runtime_error("Failed to map memory");
+    }
+
+    this->mmapRam_ = static_cast<uint32_t*>(mmapRam);
+}
+
+void Machine::LoadFile(std::string_view path, uint32_t memoryRef) {
+    if (useFile_) {
+        throw std::runtime_error("Only the mmap backend loads files into guest memory");
+    }
+
+    int fd = open(std::string(path).c_str(), O_RDONLY);
     if (fd == -1) {
-        throw std::runtime_error("Failed to open code.bin");
+        throw std::runtime_error("Failed to open " + std::string(path));
     }
 
     // Get file size
@@ -36,48 +73,274 @@ Machine::Machine(std::string_view code_path, uint32_t loadOffset) {
     }
     lseek(fd, 0, SEEK_SET);
 
-    // Read the file content and write it to the shared memory
-    char* buffer = new char[fileSize];
-    ssize_t bytesRead = read(fd, buffer, fileSize);
+    // A page-aligned image is mapped from the file instead: its pages stay
+    // the page cache pages, shared by every instance running the same file
+    // until one of them stores to a page and gets a private copy of it
+    if (memoryRef % MEMORY_PAGE_SIZE == 0 && fileSize > 0) {
+        void* mapped = mmap(HostAddress(memoryRef), fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0);
+        if (mapped != MAP_FAILED) {
+            close(fd);
+            fileMappings_.push_back(FileMapping{.memoryRef = memoryRef, .size = static_cast<size_t>(fileSize)});
+            return;
+        }
+    }
+
+    // Read the file content straight into guest memory
+    std::span<uint8_t> code = HostSpan(memoryRef, fileSize);
+    ssize_t bytesRead = read(fd, code.data(), code.size());
+    close(fd);
     if (bytesRead != fileSize) {
-        delete[] buffer;
-        close(fd);
         throw std::runtime_error("Failed to read entire file");
     }
+}
 
-    // printf("File size: %ld\n", fileSize);
-
-    void *mmapRam = mmap(NULL, 16ULL * 1024 * 1024 * 1024,
-                        PROT_READ | PROT_WRITE,
-                        MAP_ANONYMOUS | MAP_PRIVATE,
-                        -1, 0);
-
-    if (mmapRam == MAP_FAILED) {
-        perror("mmap failed");
-        close(fd);
-        throw std::runtime_error("Failed to map memory");
+void Machine::Reset() {
+    if (useFile_) {
+        throw std::runtime_error("Only the mmap backend can be reset");
     }
 
-    // Write the buffer to memory
-    memcpy((char*) mmapRam + loadOffset, buffer, fileSize);
-    delete[] buffer;
-
-    // printf("Successfully mapped 16GB of anonymous memory: %p with offset %d\n", mmapRam, loadOffset);
-    // std::cout << "Try read: " << std::bitset<32>{((uint32_t*)mmapRam)[loadOffset_/4U]} << '\n';
+    // File pages would read back as the file, they become anonymous again
+    for (const FileMapping& file : fileMappings_) {
+        const size_t size = (file.size + MEMORY_PAGE_SIZE - 1) / MEMORY_PAGE_SIZE * MEMORY_PAGE_SIZE;
+        if (mmap(HostAddress(file.memoryRef), size, PROT_READ | PROT_WRITE,
+                 MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED) {
+            throw std::runtime_error("Failed to reset guest memory");
+        }
+    }
+    fileMappings_.clear();
 
-    this->mmapRam_ = static_cast<uint32_t*>(mmapRam);
-#endif // MMAP
+    // Private anonymous pages read back as zero after MADV_DONTNEED. Only
+    // the populated page tables are walked, so the cost follows what the
+    // guest touched, not the size of the mapping.
+    if (madvise(mmapRam_, MMAP_SIZE, MADV_DONTNEED) != 0) {
+        throw std::runtime_error("Failed to reset guest memory");
+    }
 }
 
 Machine::~Machine() {
     if (useFile_) {
         ram.close();
     } else {
-        ;
-    #ifdef MMAP
-        munmap(mmapRam_, 16ULL * 1024 * 1024 * 1024);
-    #endif // MMAP
+        munmap(mmapRam_, MMAP_SIZE);
+    }
+}
+
+void Machine::MapMmio(MmioRegion region) {
+    const uint64_t end = static_cast<uint64_t>(region.base) + region.size;
+    for (const MmioRegion& other : mmio_) {
+        if (region.base < static_cast<uint64_t>(other.base) + other.size && other.base < end) {
+            throw std::runtime_error("MMIO region overlaps an existing one");
+        }
+    }
+
+    const uint64_t low = mmio_.empty() ? region.base : std::min<uint64_t>(mmioLow_, region.base);
+    const uint64_t high = mmio_.empty() ? end : std::max(mmioLow_ + mmioSpan_, end);
+    mmioLow_ = low;
+    mmioSpan_ = high - low;
+    mmio_.push_back(std::move(region));
+}
+
+const Machine::MmioRegion* Machine::FindMmio(const int32_t memoryRef) const {
+    const uint32_t address = static_cast<uint32_t>(memoryRef);
+    for (const MmioRegion& region : mmio_) {
+        if (address - region.base < region.size) {
+            return &region;
+        }
+    }
+    return nullptr;
+}
+
+namespace {
+
+uint32_t AmoResult(Machine::AmoOp op, uint32_t old, uint32_t value) {
+    switch (op) {
+        case Machine::AmoOp::SWAP:
+            return value;
+        case Machine::AmoOp::ADD:
+            return old + value;
+        case Machine::AmoOp::XOR:
+            return old ^ value;
+        case Machine::AmoOp::AND:
+            return old & value;
+        case Machine::AmoOp::OR:
+            return old | value;
+        case Machine::AmoOp::MIN:
+            return std::min(static_cast<int32_t>(old), static_cast<int32_t>(value));
+        case Machine::AmoOp::MAX:
+            return std::max(static_cast<int32_t>(old), static_cast<int32_t>(value));
+        case Machine::AmoOp::MINU:
+            return std::min(old, value);
+        case Machine::AmoOp::MAXU:
+            return std::max(old, value);
+    }
+    return value;
+}
+
+void CheckAligned(const int32_t memoryRef) {
+    if (static_cast<uint32_t>(memoryRef) % sizeof(uint32_t) != 0) {
+        throw "misaligned atomic access\n";
+    }
+}
+
+} // anon namespace
+
+uint32_t Machine::Amo(const int32_t memoryRef, const AmoOp op, const uint32_t value) {
+    CheckAligned(memoryRef);
+    if (useFile_) {
+        const uint32_t old = Load<uint32_t>(memoryRef);
+        Store<uint32_t>(memoryRef, AmoResult(op, old, value));
+        return old;
+    }
+
+    std::atomic_ref<uint32_t> word{*reinterpret_cast<uint32_t*>(HostAddress(memoryRef))};
+    switch (op) {
+        case AmoOp::SWAP:
+            return word.exchange(value);
+        case AmoOp::ADD:
+            return word.fetch_add(value);
+        case AmoOp::XOR:
+            return word.fetch_xor(value);
+        case AmoOp::AND:
+            return word.fetch_and(value);
+        case AmoOp::OR:
+            return word.fetch_or(value);
+        default:
+            break;
     }
+
+    // min/max have no host instruction
+    uint32_t old = word.load();
+    while (!word.compare_exchange_weak(old, AmoResult(op, old, value))) {
+    }
+    return old;
+}
+
+uint32_t Machine::AtomicLoad(const int32_t memoryRef) {
+    CheckAligned(memoryRef);
+    if (useFile_) {
+        return Load<uint32_t>(memoryRef);
+    }
+    return std::atomic_ref<uint32_t>{*reinterpret_cast<uint32_t*>(HostAddress(memoryRef))}.load();
+}
+
+bool Machine::CompareExchange(const int32_t memoryRef, uint32_t expected, const uint32_t desired) {
+    CheckAligned(memoryRef);
+    if (useFile_) {
+        if (Load<uint32_t>(memoryRef) != expected) {
+            return false;
+        }
+        Store<uint32_t>(memoryRef, desired);
+        return true;
+    }
+    return std::atomic_ref<uint32_t>{*reinterpret_cast<uint32_t*>(HostAddress(memoryRef))}.compare_exchange_strong(expected, desired);
+}
+
+std::span<uint8_t> Machine::HostSpan(const uint32_t memoryRef, const size_t size) {
+    if (useFile_) {
+        return {};
+    }
+
+    return {HostAddress(memoryRef), size};
+}
+
+std::span<const uint8_t> Machine::ReadBlock(const uint32_t memoryRef, std::span<uint8_t> buffer) {
+    if (!useFile_) {
+        return HostSpan(memoryRef, buffer.size());
+    }
+
+    ForEachPage(memoryRef, buffer.size(), [&](uint32_t chunkRef, size_t offset, size_t chunkSize) {
+        ram.seekg(chunkRef);
+
+        if (ram.fail()) {
+            throw "seekg failed\n";
+        }
+
+        ram.read(reinterpret_cast<char*>(buffer.data() + offset), chunkSize);
+
+        if (ram.fail()) {
+            throw "read failed\n";
+        }
+    });
+
+    return buffer;
+}
+
+std::span<uint8_t> Machine::WriteBlock(const uint32_t memoryRef, std::span<const uint8_t> data) {
+    if (!useFile_) {
+        std::span<uint8_t> host = HostSpan(memoryRef, data.size());
+        std::memcpy(host.data(), data.data(), data.size());
+        return host;
+    }
+
+    ForEachPage(memoryRef, data.size(), [&](uint32_t chunkRef, size_t offset, size_t chunkSize) {
+        ram.seekp(chunkRef);
+
+        if (ram.fail()) {
+            throw "seekp failed\n";
+        }
+
+        ram.write(reinterpret_cast<const char*>(data.data() + offset), chunkSize);
+
+        if (ram.fail()) {
+            throw "write failed\n";
+        }
+    });
+
+    return {};
+}
+
+std::span<uint8_t> Machine::Fill(const uint32_t memoryRef, const uint8_t value, const size_t size) {
+    if (!useFile_) {
+        std::span<uint8_t> host = HostSpan(memoryRef, size);
+        std::memset(host.data(), value, size);
+        return host;
+    }
+
+    std::array<uint8_t, MEMORY_PAGE_SIZE> page;
+    page.fill(value);
+    ForEachPage(memoryRef, size, [&](uint32_t chunkRef, size_t, size_t chunkSize) {
+        WriteBlock(chunkRef, std::span<const uint8_t>{page.data(), chunkSize});
+    });
+
+    return {};
+}
+
+int Machine::Compare(const uint32_t memoryRef, std::span<const uint8_t> data) {
+    if (!useFile_) {
+        return std::memcmp(HostAddress(memoryRef), data.data(), data.size());
+    }
+
+    std::array<uint8_t, MEMORY_PAGE_SIZE> page;
+    int result = 0;
+    ForEachPage(memoryRef, data.size(), [&](uint32_t chunkRef, size_t offset, size_t chunkSize) {
+        if (result != 0) {
+            return;
+        }
+
+        std::span<const uint8_t> chunk = ReadBlock(chunkRef, std::span<uint8_t>{page.data(), chunkSize});
+        result = std::memcmp(chunk.data(), data.data() + offset, chunkSize);
+    });
+
+    return result;
+}
+
+size_t Machine::TouchedPages() const {
+    if (useFile_) {
+        return 0;
+    }
+
+    // The guest sees 4 GiB of the mapping
+    constexpr uint64_t GUEST_SIZE = 1ULL << 32U;
+    const size_t hostPage = sysconf(_SC_PAGESIZE);
+    std::vector<unsigned char> resident(GUEST_SIZE / hostPage);
+    if (mincore(mmapRam_, GUEST_SIZE, resident.data()) != 0) {
+        return 0;
+    }
+
+    const size_t hostPages = std::count_if(resident.begin(), resident.end(), [](unsigned char page) {
+        return page & 1U;
+    });
+    return hostPages * hostPage / MEMORY_PAGE_SIZE;
 }
 
-} // namespace RISCVS
\ No newline at end of file
+} // namespace RISCVS
@@ -6,6 +6,12 @@
 #include <iostream>
 #include <string_view>
 #include <cstdint>
+#include <cstring>
+#include <span>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <vector>
 
 #include <defines.hpp>
 
@@ -23,14 +29,49 @@ concept DataTypeRequirements = DataTypeRequirementsBase<T, PARAM_TYPES>;
 
 class Machine {
 public:
+    constexpr static uint32_t MEMORY_PAGE_SIZE = 4096U;
+    constexpr static uint64_t MMAP_SIZE = 16ULL * 1024 * 1024 * 1024;
 
     Machine();
 
     Machine(std::string_view code_path, uint32_t loadOffset);
 
+    // mmap backend with an in-memory image placed at loadOffset
+    Machine(std::span<const uint8_t> image, uint32_t loadOffset);
+
     ~Machine();
 
+    // Device registers: accesses to [base, base + size) go to the callbacks
+    // with the offset from base and the access size in bytes
+    struct MmioRegion {
+        uint32_t base;
+        uint32_t size;
+        std::function<uint32_t(uint32_t offset, uint32_t size)> read;
+        std::function<void(uint32_t offset, uint32_t value, uint32_t size)> write;
+    };
+
+    // mmap backend: back to an all-zero guest memory (MMIO regions stay
+    // mapped), cheap enough to reuse one Machine for many short guests.
+    // Throws for the file backend.
+    void Reset();
+
+    // Reads a file into guest memory at memoryRef (mmap backend). At a
+    // page-aligned memoryRef the file is mapped copy-on-write instead, so
+    // instances running the same image share its clean pages; the bytes
+    // after the end of the file up to the page end then read as zero.
+    void LoadFile(std::string_view path, uint32_t memoryRef);
+
+    // Throws if the region overlaps an already mapped one
+    void MapMmio(MmioRegion region);
+
     MACHINE_ATTR void Store(const int32_t memoryRef, const T data) {
+        if (InMmioWindow(memoryRef)) [[unlikely]] {
+            if (const MmioRegion* region = FindMmio(memoryRef)) {
+                region->write(static_cast<uint32_t>(memoryRef) - region->base, static_cast<uint32_t>(data), sizeof(T));
+                return;
+            }
+        }
+
         // std::cerr << "MemoryRef: " << (unsigned) memoryRef << '\n';
         if (useFile_) {
             ram.seekp((unsigned) memoryRef);
@@ -47,12 +88,18 @@ public:
                 throw "write failed\n";
             }
         } else {
-            // std::cerr << "Read: " << mmapRam_ + memoryRef/4U + loadOffset_/4U << '\n'; 
-            mmapRam_[memoryRef/4U] = data;
+            // std::cerr << "Read: " << mmapRam_ + memoryRef/4U + loadOffset_/4U << '\n';
+            StoreShared(HostAddress(memoryRef), data);
         }
     }
 
     MACHINE_ATTR T Load(const int32_t memoryRef) {
+        if (InMmioWindow(memoryRef)) [[unlikely]] {
+            if (const MmioRegion* region = FindMmio(memoryRef)) {
+                return static_cast<T>(region->read(static_cast<uint32_t>(memoryRef) - region->base, sizeof(T)));
+            }
+        }
+
         if (useFile_) {
             ram.seekg((unsigned) memoryRef);
 
@@ -70,18 +117,133 @@ public:
             return ret;
         } else {
             // std::cerr << "From: " << std::hex << memoryRef << '\n';
-            uint32_t read = mmapRam_[memoryRef/4U];
-            // std::cerr << memoryRef << '\n';
-            // std::cerr << std::bitset<32>{read} << '\n';
-            return read;
+            return LoadShared<T>(HostAddress(memoryRef));
         }
     }
 
+    // RV32A on aligned words, misaligned addresses fault. Every operation
+    // is sequentially consistent, which covers any aq/rl combination (an
+    // x86 locked instruction is a full barrier anyway). The file backend
+    // serves a single hart, it uses plain loads and stores.
+    enum class AmoOp {
+        SWAP, ADD, XOR, AND, OR, MIN, MAX, MINU, MAXU,
+    };
+
+    // Returns the old value
+    uint32_t Amo(const int32_t memoryRef, const AmoOp op, const uint32_t value);
+
+    uint32_t AtomicLoad(const int32_t memoryRef);
+
+    // Stores desired if the word still holds expected
+    bool CompareExchange(const int32_t memoryRef, uint32_t expected, const uint32_t desired);
+
+    // Bulk operations. Ranges are split at MEMORY_PAGE_SIZE boundaries for
+    // the file backend; the mmap backend keeps the whole guest address space
+    // in one host mapping, so it is served by a single memcpy/memset/memcmp.
+
+    // Returns host memory of [memoryRef, memoryRef + size) or an empty span
+    // when the range is not contiguous in host memory (file backend).
+    std::span<uint8_t> HostSpan(const uint32_t memoryRef, const size_t size);
+
+    // Returns a view of buffer.size() bytes starting at memoryRef. The view
+    // points directly into guest memory when possible (buffer is untouched),
+    // otherwise the bytes are copied into buffer.
+    std::span<const uint8_t> ReadBlock(const uint32_t memoryRef, std::span<uint8_t> buffer);
+
+    // WriteBlock and Fill return the host view of the written range
+    // (empty for the file backend).
+    std::span<uint8_t> WriteBlock(const uint32_t memoryRef, std::span<const uint8_t> data);
+    std::span<uint8_t> Fill(const uint32_t memoryRef, const uint8_t value, const size_t size);
+
+    // memcmp-like: compares guest memory at memoryRef with data.
+    int Compare(const uint32_t memoryRef, std::span<const uint8_t> data);
+
+    // Only the mmap backend can be shared by concurrently running harts
+    bool Shareable() const {
+        return !useFile_;
+    }
+
+    // Guest pages backed by host memory, i.e. touched by the guest
+    // (mmap backend only, 0 for the file backend). Walks the page tables,
+    // not meant for the hot path.
+    size_t TouchedPages() const;
+
 private:
+    void MapMemory();
+
+    // A single compare against the span of all regions keeps plain
+    // memory accesses cheap, the regions are searched only inside it
+    bool InMmioWindow(const int32_t memoryRef) const {
+        return static_cast<uint32_t>(memoryRef) - mmioLow_ < mmioSpan_;
+    }
+
+    const MmioRegion* FindMmio(const int32_t memoryRef) const;
+
+    // Guest memory may be shared by harts on several host threads. Aligned
+    // accesses are relaxed atomics (single-copy atomic as RVWMO requires,
+    // plain moves on the host), misaligned ones go byte by byte.
+    template<typename T>
+    static T LoadShared(uint8_t* host) {
+        if (reinterpret_cast<uintptr_t>(host) % sizeof(T) == 0) [[likely]] {
+            return std::atomic_ref<T>(*reinterpret_cast<T*>(host)).load(std::memory_order_relaxed);
+        }
+
+        uint8_t bytes[sizeof(T)];
+        for (size_t i = 0; i < sizeof(T); ++i) {
+            bytes[i] = std::atomic_ref<uint8_t>(host[i]).load(std::memory_order_relaxed);
+        }
+        T read;
+        std::memcpy(&read, bytes, sizeof(T));
+        return read;
+    }
+
+    template<typename T>
+    static void StoreShared(uint8_t* host, const T data) {
+        if (reinterpret_cast<uintptr_t>(host) % sizeof(T) == 0) [[likely]] {
+            std::atomic_ref<T>(*reinterpret_cast<T*>(host)).store(data, std::memory_order_relaxed);
+            return;
+        }
+
+        uint8_t bytes[sizeof(T)];
+        std::memcpy(bytes, &data, sizeof(T));
+        for (size_t i = 0; i < sizeof(T); ++i) {
+            std::atomic_ref<uint8_t>(host[i]).store(bytes[i], std::memory_order_relaxed);
+        }
+    }
+
+    uint8_t* HostAddress(const int32_t memoryRef) const {
+        return reinterpret_cast<uint8_t*>(mmapRam_) + static_cast<uint32_t>(memoryRef);
+    }
+
+    // Calls func(chunkRef, chunkOffset, chunkSize) for every page-bounded
+    // chunk of [memoryRef, memoryRef + size).
+    template<typename Func>
+    static void ForEachPage(const uint32_t memoryRef, const size_t size, Func&& func) {
+        size_t offset = 0;
+        while (offset < size) {
+            const uint32_t chunkRef = memoryRef + offset;
+            const size_t pageLeft = MEMORY_PAGE_SIZE - chunkRef % MEMORY_PAGE_SIZE;
+            const size_t chunkSize = std::min(pageLeft, size - offset);
+            func(chunkRef, offset, chunkSize);
+            offset += chunkSize;
+        }
+    }
+
     bool useFile_ = true;
     uint32_t loadOffset_ = 0;
     uint32_t* mmapRam_ = nullptr;
 
+    struct FileMapping {
+        uint32_t memoryRef;
+        size_t size;
+    };
+
+    std::vector<FileMapping> fileMappings_;
+
+    std::vector<MmioRegion> mmio_;
+    uint32_t mmioLow_ = 0;
+    uint64_t mmioSpan_ = 0;
+
     const char* RAM_PATH = "../ram/ram.bin";
 
     std::fstream ram;
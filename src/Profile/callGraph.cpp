@@ -0,0 +1,137 @@
+#include "callGraph.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+
+namespace RISCVS {
+
+CallGraph::CallGraph(int32_t entryPC) {
+    nodes.push_back(Node{.function = entryPC, .parent = 0, .calls = 1});
+}
+
+void CallGraph::Call(Hart& hart, int32_t target, int32_t returnAddress) {
+    Settle();
+
+    auto [it, inserted] = nodes[current].children.try_emplace(target, nodes.size());
+    if (inserted) {
+        nodes.push_back(Node{.function = target, .parent = current});
+    }
+    nodes[it->second].calls += !paused;
+
+    hart.GetShadowStack().Push(current, returnAddress);
+    current = it->second;
+}
+
+void CallGraph::Return(Hart& hart, int32_t returnAddress) {
+    Settle();
+
+    uint32_t caller = 0;
+    if (hart.GetShadowStack().Return(returnAddress, caller)) {
+        current = caller;
+    }
+}
+
+void CallGraph::Reset() {
+    Settle();
+    for (Node& node : nodes) {
+        node.exclusive = 0;
+        node.calls = 0;
+    }
+}
+
+std::string CallGraph::FunctionName(int32_t function, const SymbolTable& symbols) const {
+    std::string name = symbols.Describe(function);
+    if (!name.empty()) {
+        return name;
+    }
+
+    std::ostringstream out;
+    out << "0x" << std::hex << static_cast<uint32_t>(function);
+    return out.str();
+}
+
+void CallGraph::WriteCollapsed(std::ostream& out, const SymbolTable& symbols) {
+    Settle();
+
+    std::vector<std::string> names(nodes.size());
+    std::vector<std::string> stacks(nodes.size());
+    for (uint32_t i = 0; i < nodes.size(); ++i) {
+        // Parents are always created before their children
+        names[i] = FunctionName(nodes[i].function, symbols);
+        stacks[i] = i == 0 ? names[i] : stacks[nodes[i].parent] + ';' + names[i];
+    }
+
+    // Equal stacks may come from different entry pcs with the same symbol
+    std::map<std::string, uint64_t> collapsed;
+    for (uint32_t i = 0; i < nodes.size(); ++i) {
+        if (nodes[i].exclusive != 0) {
+            collapsed[stacks[i]] += nodes[i].exclusive;
+        }
+    }
+
+    for (const auto& [stack, count] : collapsed) {
+        out << stack << ' ' << count << '\n';
+    }
+}
+
+void CallGraph::Report(std::ostream& out, const SymbolTable& symbols, size_t topN) {
+    Settle();
+
+    std::vector<uint64_t> inclusive(nodes.size());
+    for (uint32_t i = nodes.size(); i > 0; --i) {
+        const Node& node = nodes[i - 1];
+        inclusive[i - 1] += node.exclusive;
+        if (i - 1 != 0) {
+            inclusive[node.parent] += inclusive[i - 1];
+        }
+    }
+
+    struct Cost {
+        uint64_t inclusive = 0;
+        uint64_t exclusive = 0;
+        uint64_t calls = 0;
+    };
+    std::map<std::string, Cost> functions;
+
+    for (uint32_t i = 0; i < nodes.size(); ++i) {
+        const std::string name = FunctionName(nodes[i].function, symbols);
+        Cost& cost = functions[name];
+        cost.exclusive += nodes[i].exclusive;
+        cost.calls += nodes[i].calls;
+
+        // Recursive activations are already included by the outermost one
+        bool recursive = false;
+        for (uint32_t parent = i; parent != 0 && !recursive;) {
+            parent = nodes[parent].parent;
+            recursive = FunctionName(nodes[parent].function, symbols) == name;
+        }
+        if (!recursive) {
+            cost.inclusive += inclusive[i];
+        }
+    }
+
+    std::vector<std::pair<std::string, Cost>> sorted(functions.begin(), functions.end());
+    std::sort(sorted.begin(), sorted.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.second.inclusive > rhs.second.inclusive;
+    });
+    sorted.resize(std::min(sorted.size(), topN));
+
+    const uint64_t total = inclusive[0];
+    out << std::fixed << std::setprecision(2);
+    out << "++++++++CALL_GRAPH++++++++\n";
+    out << "Instructions: " << total << '\n';
+    out << std::setw(14) << "inclusive" << std::setw(9) << "%" << std::setw(14) << "exclusive"
+        << std::setw(9) << "%" << std::setw(10) << "calls" << "  function\n";
+    for (const auto& [name, cost] : sorted) {
+        out << std::setw(14) << cost.inclusive << std::setw(8) << (total ? 100.0 * cost.inclusive / total : 0.0) << '%'
+            << std::setw(14) << cost.exclusive << std::setw(8) << (total ? 100.0 * cost.exclusive / total : 0.0) << '%'
+            << std::setw(10) << cost.calls << "  " << name << '\n';
+    }
+    out << "++++++++++++++++++++++++++\n";
+    out.unsetf(std::ios::floatfield);
+}
+
+} // namespace RISCVS
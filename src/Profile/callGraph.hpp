@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+#include <hart.hpp>
+#include <symbolTable.hpp>
+
+namespace RISCVS {
+
+// Exact call graph profile: instructions are attributed to the calling
+// context tree built from the hart shadow stack. Every context node keeps
+// its exclusive count, inclusive counts are derived at report time.
+class CallGraph {
+public:
+    explicit CallGraph(int32_t entryPC);
+
+    // Called after every executed instruction
+    void Count(Hart& hart, uint32_t binInstruction) {
+        ++executed;
+
+        const Uint opcode = Decoder::GetOpcode(binInstruction);
+        if (opcode != Decoder::Type::J::Opcode && opcode != Decoder::Type::IJump::Opcode) {
+            return;
+        }
+
+        const Uint rd = Decoder::GetRd(binInstruction);
+        if (rd == RA) {
+            Call(hart, hart.GetPC(), hart[RA]);
+        } else if (rd == 0 && opcode == Decoder::Type::IJump::Opcode &&
+                   Decoder::GetRs1(binInstruction) == RA && Decoder::GetImmTypeI(binInstruction) == 0) {
+            Return(hart, hart.GetPC());
+        }
+    }
+
+    // Region of interest control: calls and returns are still tracked while
+    // paused, only the instruction attribution stops
+    void Pause() {
+        Settle();
+        paused = true;
+    }
+
+    void Resume() {
+        Settle();
+        paused = false;
+    }
+
+    void Reset();
+
+    // Collapsed stacks ("main;foo;bar 42" per line) for flamegraph tools
+    void WriteCollapsed(std::ostream& out, const SymbolTable& symbols);
+
+    // Per function inclusive/exclusive counts, top-N by inclusive count
+    void Report(std::ostream& out, const SymbolTable& symbols, size_t topN);
+
+private:
+    constexpr static Uint RA = 1;
+
+    struct Node {
+        int32_t function;
+        uint32_t parent;
+        uint64_t exclusive = 0;
+        uint64_t calls = 0;
+        std::unordered_map<int32_t, uint32_t> children;
+    };
+
+    void Call(Hart& hart, int32_t target, int32_t returnAddress);
+    void Return(Hart& hart, int32_t returnAddress);
+
+    // Attributes instructions executed since the last call/return to current
+    void Settle() {
+        nodes[current].exclusive += paused ? 0 : executed - settled;
+        settled = executed;
+    }
+
+    std::string FunctionName(int32_t function, const SymbolTable& symbols) const;
+
+    std::vector<Node> nodes;
+    uint32_t current = 0;
+    uint64_t executed = 0;
+    uint64_t settled = 0;
+    bool paused = false;
+};
+
+} // namespace RISCVS
@@ -0,0 +1,111 @@
+#include "hostCounters.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace RISCVS {
+
+namespace {
+
+constexpr uint64_t CacheEvent(uint64_t cache, uint64_t operation, uint64_t result) {
+    return cache | (operation << 8U) | (result << 16U);
+}
+
+struct EventConfig {
+    uint32_t type;
+    uint64_t config;
+};
+
+constexpr std::array<EventConfig, HostCounters::EVENT_COUNT> CONFIGS = {{
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE, CacheEvent(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {PERF_TYPE_HW_CACHE, CacheEvent(PERF_COUNT_HW_CACHE_L1I, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {PERF_TYPE_HW_CACHE, CacheEvent(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+}};
+
+int OpenCounter(const EventConfig& event) {
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = event.type;
+    attr.config = event.config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+}
+
+} // anon namespace
+
+HostCounters::HostCounters() {
+    for (size_t i = 0; i < EVENT_COUNT; ++i) {
+        counters[i].fd = OpenCounter(CONFIGS[i]);
+        counters[i].error = counters[i].fd < 0 ? errno : 0;
+    }
+}
+
+HostCounters::~HostCounters() {
+    for (const Counter& counter : counters) {
+        if (counter.fd >= 0) {
+            close(counter.fd);
+        }
+    }
+}
+
+void HostCounters::Start() {
+    for (const Counter& counter : counters) {
+        if (counter.fd >= 0) {
+            ioctl(counter.fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(counter.fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+void HostCounters::Stop() {
+    for (Counter& counter : counters) {
+        if (counter.fd < 0) {
+            continue;
+        }
+        ioctl(counter.fd, PERF_EVENT_IOC_DISABLE, 0);
+
+        // value, time enabled, time running
+        uint64_t data[3] = {};
+        if (read(counter.fd, data, sizeof(data)) != sizeof(data)) {
+            counter.error = errno;
+            close(counter.fd);
+            counter.fd = -1;
+            continue;
+        }
+        counter.value = data[2] == 0 ? 0 : static_cast<uint64_t>(static_cast<double>(data[0]) * data[1] / data[2]);
+    }
+}
+
+void HostCounters::Report(std::ostream& out, uint64_t guestInstructions, std::chrono::nanoseconds elapsed) const {
+    const double nanoseconds = static_cast<double>(elapsed.count());
+
+    out << std::fixed << std::setprecision(3);
+    out << "++++++++HOST_COUNTERS++++++++\n";
+    out << "Guest MIPS: " << (nanoseconds == 0 ? 0.0 : 1000.0 * guestInstructions / nanoseconds) << '\n';
+    for (size_t i = 0; i < EVENT_COUNT; ++i) {
+        out << std::left << std::setw(14) << NAMES[i] << std::right;
+        if (counters[i].fd < 0) {
+            out << "unavailable (" << std::strerror(counters[i].error) << ")\n";
+            continue;
+        }
+        out << std::setw(16) << counters[i].value << "  "
+            << (guestInstructions == 0 ? 0.0 : static_cast<double>(counters[i].value) / guestInstructions)
+            << " per guest instruction\n";
+    }
+    out << "+++++++++++++++++++++++++++++\n";
+    out.unsetf(std::ios::floatfield);
+}
+
+} // namespace RISCVS
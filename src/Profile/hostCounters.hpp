@@ -0,0 +1,61 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+namespace RISCVS {
+
+// Host hardware counters (perf_event_open) around the execution loop, user
+// space of this process only. Every counter is opened on its own, so the ones
+// the host or the container does not provide are reported as unavailable.
+class HostCounters {
+public:
+    enum Event : size_t {
+        CYCLES,
+        INSTRUCTIONS,
+        BRANCH_MISSES,
+        L1D_MISSES,
+        L1I_MISSES,
+        DTLB_MISSES,
+        EVENT_COUNT,
+    };
+
+    HostCounters();
+    ~HostCounters();
+
+    HostCounters(const HostCounters&) = delete;
+    HostCounters& operator=(const HostCounters&) = delete;
+
+    void Start();
+    void Stop();
+
+    bool Available(Event event) const {
+        return counters[event].fd >= 0;
+    }
+
+    // Scaled by the time the counter was actually scheduled on the PMU
+    uint64_t Value(Event event) const {
+        return counters[event].value;
+    }
+
+    // Per guest instruction ratios and guest MIPS
+    void Report(std::ostream& out, uint64_t guestInstructions, std::chrono::nanoseconds elapsed) const;
+
+private:
+    struct Counter {
+        int fd = -1;
+        int error = 0;
+        uint64_t value = 0;
+    };
+
+    static constexpr std::array<std::string_view, EVENT_COUNT> NAMES = {
+        "cycles", "instructions", "branch-misses", "L1d-misses", "L1i-misses", "dTLB-misses",
+    };
+
+    std::array<Counter, EVENT_COUNT> counters;
+};
+
+} // namespace RISCVS
@@ -0,0 +1,163 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+
+namespace RISCVS {
+
+namespace {
+
+std::string Hex(int32_t value) {
+    std::ostringstream out;
+    out << "0x" << std::hex << std::setfill('0') << std::setw(8) << static_cast<uint32_t>(value);
+    return out.str();
+}
+
+std::string JsonString(std::string_view text) {
+    std::string escaped = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped + '"';
+}
+
+double Percent(uint64_t part, uint64_t total) {
+    return total == 0 ? 0.0 : 100.0 * part / total;
+}
+
+} // anon namespace
+
+struct BlockProfiler::Summary {
+    struct HotPC {
+        int32_t pc;
+        uint64_t count;
+        std::string_view name;
+    };
+
+    struct HotBlock {
+        int32_t start;
+        int32_t end;
+        uint64_t count;
+        uint64_t instructions;
+    };
+
+    uint64_t total = 0;
+    std::vector<std::pair<std::string_view, uint64_t>> mix;
+    std::vector<HotPC> hotPCs;
+    std::vector<HotBlock> hotBlocks;
+};
+
+BlockProfiler::Summary BlockProfiler::Summarize(Hart& hart, size_t topN) const {
+    Summary summary;
+
+    std::map<int32_t, uint64_t> pcCounts;
+    auto addBlock = [&](int32_t start, int32_t end, uint64_t count) {
+        uint64_t length = 0;
+        for (int32_t pc = start; pc <= end; pc += sizeof(uint32_t), ++length) {
+            pcCounts[pc] += count;
+        }
+        summary.hotBlocks.push_back({.start = start, .end = end, .count = count, .instructions = count * length});
+        summary.total += count * length;
+    };
+
+    for (const auto& [start, block] : blocks) {
+        addBlock(start, block.end, block.count);
+    }
+    if (open && active) {
+        addBlock(blockStart, lastPC, 1);
+    }
+
+    std::map<std::string_view, uint64_t> mix;
+    for (const auto& [pc, count] : pcCounts) {
+        std::string_view name = Decoder::Name(hart.Fetch(pc));
+        mix[name] += count;
+        summary.hotPCs.push_back({.pc = pc, .count = count, .name = name});
+    }
+
+    summary.mix.assign(mix.begin(), mix.end());
+    std::sort(summary.mix.begin(), summary.mix.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.second > rhs.second;
+    });
+
+    std::sort(summary.hotPCs.begin(), summary.hotPCs.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.count > rhs.count;
+    });
+    summary.hotPCs.resize(std::min(summary.hotPCs.size(), topN));
+
+    std::sort(summary.hotBlocks.begin(), summary.hotBlocks.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.instructions > rhs.instructions;
+    });
+    summary.hotBlocks.resize(std::min(summary.hotBlocks.size(), topN));
+
+    return summary;
+}
+
+void BlockProfiler::Report(std::ostream& out, Hart& hart, const SymbolTable& symbols, size_t topN) const {
+    const Summary summary = Summarize(hart, topN);
+
+    out << std::fixed << std::setprecision(2);
+    out << "++++++++PROFILE++++++++\n";
+    out << "Instructions: " << summary.total << '\n';
+
+    out << "Instruction mix:\n";
+    for (const auto& [name, count] : summary.mix) {
+        out << "  " << std::left << std::setw(8) << name << std::right
+            << std::setw(14) << count << std::setw(8) << Percent(count, summary.total) << "%\n";
+    }
+
+    out << "Hottest instructions:\n";
+    for (const auto& hot : summary.hotPCs) {
+        out << "  " << Hex(hot.pc) << ' ' << std::left << std::setw(8) << hot.name << std::right
+            << std::setw(14) << hot.count << std::setw(8) << Percent(hot.count, summary.total) << "%  "
+            << symbols.Describe(hot.pc) << '\n';
+    }
+
+    out << "Hottest blocks:\n";
+    for (const auto& hot : summary.hotBlocks) {
+        out << "  " << Hex(hot.start) << '-' << Hex(hot.end)
+            << std::setw(14) << hot.count << " x" << std::setw(4) << (hot.end - hot.start) / 4 + 1
+            << std::setw(8) << Percent(hot.instructions, summary.total) << "%  "
+            << symbols.Describe(hot.start) << '\n';
+    }
+    out << "+++++++++++++++++++++++\n";
+    out.unsetf(std::ios::floatfield);
+}
+
+void BlockProfiler::ReportJson(std::ostream& out, Hart& hart, const SymbolTable& symbols, size_t topN) const {
+    const Summary summary = Summarize(hart, topN);
+
+    out << "{\n  \"instructions\": " << summary.total << ",\n";
+
+    out << "  \"mix\": {";
+    for (size_t i = 0; i < summary.mix.size(); ++i) {
+        out << (i == 0 ? "" : ", ") << JsonString(summary.mix[i].first) << ": " << summary.mix[i].second;
+    }
+    out << "},\n";
+
+    out << "  \"hot_pcs\": [";
+    for (size_t i = 0; i < summary.hotPCs.size(); ++i) {
+        const auto& hot = summary.hotPCs[i];
+        out << (i == 0 ? "\n" : ",\n")
+            << "    {\"pc\": " << JsonString(Hex(hot.pc)) << ", \"name\": " << JsonString(hot.name)
+            << ", \"count\": " << hot.count << ", \"symbol\": " << JsonString(symbols.Describe(hot.pc)) << '}';
+    }
+    out << "\n  ],\n";
+
+    out << "  \"hot_blocks\": [";
+    for (size_t i = 0; i < summary.hotBlocks.size(); ++i) {
+        const auto& hot = summary.hotBlocks[i];
+        out << (i == 0 ? "\n" : ",\n")
+            << "    {\"start\": " << JsonString(Hex(hot.start)) << ", \"end\": " << JsonString(Hex(hot.end))
+            << ", \"count\": " << hot.count << ", \"instructions\": " << hot.instructions
+            << ", \"symbol\": " << JsonString(symbols.Describe(hot.start)) << '}';
+    }
+    out << "\n  ]\n}\n";
+}
+
+} // namespace RISCVS
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <hart.hpp>
+#include <symbolTable.hpp>
+
+namespace RISCVS {
+
+// Counts executions per static instruction. Counters are kept per basic
+// block (one hash lookup per block instead of per instruction) and expanded
+// to per-pc counts when the report is built.
+class BlockProfiler {
+public:
+    explicit BlockProfiler(int32_t startPC) : blockStart(startPC) {}
+
+    // Called after every executed instruction
+    void Count(int32_t pc, uint32_t binInstruction, int32_t nextPC) {
+        if (!EndsBlock(binInstruction) && nextPC == pc + static_cast<int32_t>(sizeof(uint32_t))) {
+            lastPC = pc;
+            open = true;
+            return;
+        }
+
+        if (active) {
+            if (blockStart != cachedStart || cachedBlock == nullptr) {
+                cachedStart = blockStart;
+                cachedBlock = &blocks[blockStart];
+            }
+            ++cachedBlock->count;
+            cachedBlock->end = pc;
+        }
+
+        blockStart = nextPC;
+        open = false;
+    }
+
+    // Region of interest control: blocks keep being tracked while paused,
+    // so a block cut by a marker is counted as a whole or not at all
+    void Pause() {
+        active = false;
+    }
+
+    void Resume() {
+        active = true;
+    }
+
+    void Reset() {
+        blocks.clear();
+        cachedBlock = nullptr;
+    }
+
+    // Human-readable report: instruction mix, top-N pcs and blocks
+    void Report(std::ostream& out, Hart& hart, const SymbolTable& symbols, size_t topN) const;
+    void ReportJson(std::ostream& out, Hart& hart, const SymbolTable& symbols, size_t topN) const;
+
+private:
+    struct Block {
+        uint64_t count = 0;
+        int32_t end = 0;
+    };
+
+    struct Summary;
+
+    static bool EndsBlock(uint32_t binInstruction) {
+        switch (Decoder::GetOpcode(binInstruction)) {
+            case Decoder::Type::B::Opcode:
+            case Decoder::Type::J::Opcode:
+            case Decoder::Type::IJump::Opcode:
+            case Decoder::Type::IEnv::Opcode:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    Summary Summarize(Hart& hart, size_t topN) const;
+
+    std::unordered_map<int32_t, Block> blocks;
+    int32_t blockStart;
+    int32_t cachedStart = 0;
+    Block* cachedBlock = nullptr;
+    bool active = true;
+
+    // The last block may be cut by the hart stop
+    int32_t lastPC = 0;
+    bool open = false;
+};
+
+} // namespace RISCVS
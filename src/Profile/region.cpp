@@ -0,0 +1,54 @@
+#include "region.hpp"
+
+#include <iomanip>
+#include <iostream>
+
+namespace RISCVS {
+
+Region::Region(bool active) : active(active), startTime(Clock::now()) {}
+
+void Region::Start() {
+    if (!active) {
+        active = true;
+        startTime = Clock::now();
+    }
+}
+
+void Region::Stop() {
+    if (active) {
+        elapsed += Clock::now() - startTime;
+        active = false;
+    }
+}
+
+void Region::Reset() {
+    instructions = 0;
+    elapsed = std::chrono::nanoseconds{0};
+    startTime = Clock::now();
+}
+
+void Region::Dump(Hart& hart) {
+    ++dumps;
+    std::cout << "ROI dump #" << dumps << '\n';
+    Report(std::cout);
+    if (dumpHandler) {
+        dumpHandler(hart);
+    }
+}
+
+std::chrono::nanoseconds Region::Elapsed() const {
+    return active ? elapsed + (Clock::now() - startTime) : elapsed;
+}
+
+void Region::Report(std::ostream& out) const {
+    const auto nanoseconds = Elapsed().count();
+    out << std::fixed << std::setprecision(2);
+    out << "++++++++ROI++++++++\n";
+    out << "Instructions: " << instructions << '\n';
+    out << "Time: " << nanoseconds / 1000000 << " milliseconds\n";
+    out << "MIPS: " << (nanoseconds == 0 ? 0.0 : 1000.0 * instructions / nanoseconds) << '\n';
+    out << "+++++++++++++++++++\n";
+    out.unsetf(std::ios::floatfield);
+}
+
+} // namespace RISCVS
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+
+namespace RISCVS {
+
+class Hart;
+
+// Region of interest controlled by the guest markers (Decoder::Marker):
+// instructions and host time are accumulated only while it is active.
+class Region {
+public:
+    using DumpHandler = std::function<void(Hart&)>;
+
+    explicit Region(bool active = true);
+
+    bool Active() const {
+        return active;
+    }
+
+    void Count() {
+        instructions += active;
+    }
+
+    void Start();
+    void Stop();
+    void Reset();
+
+    // Prints the counters and calls the dump handler (e.g. profiler reports)
+    void Dump(Hart& hart);
+
+    void SetDumpHandler(DumpHandler handler) {
+        dumpHandler = std::move(handler);
+    }
+
+    uint64_t Instructions() const {
+        return instructions;
+    }
+
+    std::chrono::nanoseconds Elapsed() const;
+
+    void Report(std::ostream& out) const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    bool active;
+    uint64_t instructions = 0;
+    std::chrono::nanoseconds elapsed{0};
+    Clock::time_point startTime;
+    uint64_t dumps = 0;
+    DumpHandler dumpHandler;
+};
+
+} // namespace RISCVS
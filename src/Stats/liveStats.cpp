@@ -0,0 +1,75 @@
+#include "liveStats.hpp"
+
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace RISCVS {
+
+LiveStats::LiveStats(std::string_view name) : path(StatsPath(name)), windowStart(Clock::now()) {
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to create stats file");
+    }
+    if (ftruncate(fd, sizeof(StatsPage)) != 0) {
+        close(fd);
+        throw std::runtime_error("Failed to resize stats file");
+    }
+
+    void* mapping = mmap(nullptr, sizeof(StatsPage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        close(fd);
+        throw std::runtime_error("Failed to map stats file");
+    }
+
+    // The file is zero-filled, the magic goes last so readers never see a half-made header
+    page = static_cast<StatsPage*>(mapping);
+    page->version = StatsPage::VERSION;
+    page->pid = getpid();
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(page->magic, StatsPage::MAGIC, sizeof(page->magic));
+}
+
+LiveStats::~LiveStats() {
+    munmap(page, sizeof(StatsPage));
+    close(fd);
+    unlink(path.c_str());
+}
+
+void LiveStats::Update(Hart& hart, const Machine& machine, uint64_t instructions, const DecodeCache* decodeCache) {
+    const Clock::time_point now = Clock::now();
+    const auto window = now - windowStart;
+
+    // Rates and the page walk are refreshed once a second, the rest on every update
+    if (window >= std::chrono::seconds{1} || snapshot.updateTime == 0) {
+        const auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(window).count();
+        if (nanoseconds > 0 && snapshot.updateTime != 0) {
+            snapshot.instructionsPerSecond = (instructions - windowInstructions) * 1000000000ULL / nanoseconds;
+        }
+        snapshot.touchedPages = machine.TouchedPages();
+        windowStart = now;
+        windowInstructions = instructions;
+    }
+
+    snapshot.instructions = instructions;
+    snapshot.pc = static_cast<uint32_t>(hart.GetPC());
+    snapshot.syscalls = hart.Syscalls();
+    if (decodeCache != nullptr) {
+        snapshot.decodeHits = decodeCache->Hits();
+        snapshot.decodeLookups = decodeCache->Lookups();
+    }
+    snapshot.updateTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    page->Publish(snapshot);
+}
+
+void LiveStats::Finish(Hart& hart, const Machine& machine, uint64_t instructions, const DecodeCache* decodeCache) {
+    snapshot.finished = 1;
+    snapshot.touchedPages = machine.TouchedPages();
+    Update(hart, machine, instructions, decodeCache);
+}
+
+} // namespace RISCVS
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include <hart.hpp>
+#include <machine.hpp>
+#include "statsPage.hpp"
+
+namespace RISCVS {
+
+// Publishes live counters of a running hart into a memory-mapped file (see
+// statsPage.hpp). The hot loop is not touched: the caller runs the hart in
+// INTERVAL-sized slices and calls Update between them.
+class LiveStats {
+public:
+    constexpr static uint64_t INTERVAL = 1U << 20U;
+
+    explicit LiveStats(std::string_view name);
+    ~LiveStats();
+
+    LiveStats(const LiveStats&) = delete;
+    LiveStats& operator=(const LiveStats&) = delete;
+
+    // decodeCache is the one the slices run through, if any
+    void Update(Hart& hart, const Machine& machine, uint64_t instructions, const DecodeCache* decodeCache = nullptr);
+
+    // Last update, readers see the run as finished
+    void Finish(Hart& hart, const Machine& machine, uint64_t instructions, const DecodeCache* decodeCache = nullptr);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::string path;
+    int fd = -1;
+    StatsPage* page = nullptr;
+
+    StatsSnapshot snapshot;
+    Clock::time_point windowStart;
+    uint64_t windowInstructions = 0;
+};
+
+} // namespace RISCVS
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Layout of the live statistics file shared by the simulator (liveStats.hpp)
+// and the RISCV_Simulator_stats reader. Header only, no simulator dependencies.
+
+namespace RISCVS {
+
+struct StatsSnapshot {
+    uint64_t instructions = 0;
+    uint64_t pc = 0;
+    uint64_t instructionsPerSecond = 0; // over the last second
+    uint64_t syscalls = 0;
+    uint64_t decodeHits = 0;            // DecodeCache, 0/0 without --decode-cache
+    uint64_t decodeLookups = 0;
+    uint64_t touchedPages = 0;
+    uint64_t updateTime = 0;            // system_clock nanoseconds
+    uint64_t finished = 0;
+
+    constexpr static uint64_t StatsSnapshot::* FIELDS[] = {
+        &StatsSnapshot::instructions, &StatsSnapshot::pc, &StatsSnapshot::instructionsPerSecond,
+        &StatsSnapshot::syscalls, &StatsSnapshot::decodeHits, &StatsSnapshot::decodeLookups,
+        &StatsSnapshot::touchedPages, &StatsSnapshot::updateTime, &StatsSnapshot::finished,
+    };
+};
+
+// The snapshot is guarded by a seqlock: the single writer makes sequence odd,
+// updates the fields and makes it even again, readers retry until they see
+// the same even sequence before and after copying.
+struct StatsPage {
+    constexpr static char MAGIC[4] = {'R', 'V', 'S', 'T'};
+    constexpr static uint32_t VERSION = 1;
+
+    char magic[4];
+    uint32_t version;
+    uint64_t pid;
+    alignas(64) uint64_t sequence;
+    StatsSnapshot snapshot;
+
+    void Publish(const StatsSnapshot& value) {
+        std::atomic_ref<uint64_t> seq{sequence};
+        const uint64_t current = seq.load(std::memory_order_relaxed);
+        seq.store(current + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (auto field : StatsSnapshot::FIELDS) {
+            std::atomic_ref<uint64_t>{snapshot.*field}.store(value.*field, std::memory_order_relaxed);
+        }
+
+        seq.store(current + 2, std::memory_order_release);
+    }
+
+    StatsSnapshot Read() {
+        std::atomic_ref<uint64_t> seq{sequence};
+        StatsSnapshot value;
+        uint64_t before = 0;
+        uint64_t after = 0;
+        do {
+            before = seq.load(std::memory_order_acquire);
+            for (auto field : StatsSnapshot::FIELDS) {
+                value.*field = std::atomic_ref<uint64_t>{snapshot.*field}.load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = seq.load(std::memory_order_relaxed);
+        } while ((before & 1U) != 0 || before != after);
+        return value;
+    }
+};
+
+// Plain names live in /dev/shm, anything with a slash is a path
+inline std::string StatsPath(std::string_view name) {
+    if (name.find('/') != std::string_view::npos) {
+        return std::string(name);
+    }
+    return "/dev/shm/" + std::string(name);
+}
+
+} // namespace RISCVS
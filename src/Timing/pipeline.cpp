@@ -0,0 +1,249 @@
+#include "pipeline.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <iomanip>
+#include <stdexcept>
+#include <string>
+
+namespace RISCVS {
+
+namespace {
+
+constexpr uint32_t FUNCT3_SLL = 0b001;
+constexpr uint32_t FUNCT3_SRL_SRA = 0b101;
+
+uint32_t ParseNumber(std::string_view name, std::string_view value) {
+    uint32_t number = 0;
+    const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), number);
+    if (error != std::errc{} || end != value.data() + value.size()) {
+        throw std::runtime_error("Bad value for pipeline parameter " + std::string(name) + ": " + std::string(value));
+    }
+    return number;
+}
+
+std::string_view PredictorName(PipelineModel::Predictor predictor) {
+    switch (predictor) {
+        case PipelineModel::Predictor::NOT_TAKEN:
+            return "not-taken";
+        case PipelineModel::Predictor::BACKWARD_TAKEN:
+            return "btfn";
+        case PipelineModel::Predictor::BIMODAL:
+            return "bimodal";
+    }
+    return "";
+}
+
+} // anon namespace
+
+PipelineModel::Config PipelineModel::Config::Parse(std::string_view text) {
+    Config config;
+    while (!text.empty()) {
+        const size_t comma = text.find(',');
+        const std::string_view item = text.substr(0, comma);
+        text = comma == std::string_view::npos ? std::string_view{} : text.substr(comma + 1);
+
+        const size_t equals = item.find('=');
+        if (equals == std::string_view::npos) {
+            throw std::runtime_error("Expected name=value, got " + std::string(item));
+        }
+        const std::string_view name = item.substr(0, equals);
+        const std::string_view value = item.substr(equals + 1);
+
+        if (name == "predictor") {
+            if (value == PredictorName(Predictor::NOT_TAKEN)) {
+                config.predictor = Predictor::NOT_TAKEN;
+            } else if (value == PredictorName(Predictor::BACKWARD_TAKEN)) {
+                config.predictor = Predictor::BACKWARD_TAKEN;
+            } else if (value == PredictorName(Predictor::BIMODAL)) {
+                config.predictor = Predictor::BIMODAL;
+            } else {
+                throw std::runtime_error("Unknown predictor " + std::string(value));
+            }
+            continue;
+        }
+
+        const uint32_t number = ParseNumber(name, value);
+        if (name == "forwarding") {
+            config.forwarding = number != 0;
+            continue;
+        }
+
+        uint32_t* latency = name == "alu"      ? &config.alu
+                          : name == "shift"    ? &config.shift
+                          : name == "load"     ? &config.load
+                          : name == "store"    ? &config.store
+                          : name == "atomic"   ? &config.atomic
+                          : name == "system"   ? &config.system
+                          : name == "miss"     ? &config.miss
+                                               : nullptr;
+        if (latency == nullptr) {
+            throw std::runtime_error("Unknown pipeline parameter " + std::string(name));
+        }
+        // A stage takes at least a cycle, a miss may be free
+        if (number == 0 && latency != &config.miss) {
+            throw std::runtime_error("Pipeline latency " + std::string(name) + " must be at least 1");
+        }
+        *latency = number;
+    }
+    return config;
+}
+
+PipelineModel::PipelineModel(const Config& config) : config(config) {}
+
+void PipelineModel::Retire(const TimingRecord& record) {
+    const bool first = !started;
+    started = true;
+    ++stats.instructions;
+    const uint32_t opcode = record.Opcode();
+    const uint32_t executeLatency = ExecuteLatency(record);
+    const uint32_t memoryLatency = MemoryLatency(record);
+
+    Stages now;
+    now.fetch = std::max({first ? 0 : last.fetch + 1, redirect, last.decode});
+    now.decode = std::max(now.fetch + 1, last.execute);
+    const uint64_t issue = std::max(now.decode + 1, last.memory);
+
+    // The latest source operand
+    Operand source;
+    for (const uint32_t reg : {record.Rs1(), record.Rs2()}) {
+        if (reg != 0 && operands[reg].ready > source.ready) {
+            source = operands[reg];
+        }
+    }
+    now.execute = std::max(issue, source.ready);
+    now.memory = std::max(now.execute + executeLatency, last.writeback);
+    now.writeback = std::max(now.memory + memoryLatency, first ? 0 : last.writeback + 1);
+
+    if (const uint32_t rd = record.Rd(); rd != 0) {
+        const bool load = opcode == Decoder::Type::ILoad::Opcode || opcode == Decoder::Type::A::Opcode;
+        const uint64_t forwarded = load ? now.memory + memoryLatency : now.execute + executeLatency;
+        operands[rd] = {.ready = config.forwarding ? forwarded : now.writeback + 1, .load = load};
+    }
+
+    switch (opcode) {
+        case Decoder::Type::B::Opcode:
+        case Decoder::Type::IJump::Opcode:
+            ++stats.branches;
+            if (!Predict(record)) {
+                ++stats.mispredicts;
+                redirect = now.execute + executeLatency;
+            } else if (record.Taken()) {
+                redirect = now.decode + 1;
+            }
+            break;
+        case Decoder::Type::J::Opcode:
+            predictor.Jump(record);
+            if (record.Taken()) {
+                redirect = now.decode + 1;
+            }
+            break;
+        default:
+            break;
+    }
+
+    if (first) {
+        stats.fill = now.writeback;
+    } else {
+        // Charge the writeback gap from the last stage backwards, the
+        // remainder can only come from a fetch redirect
+        uint64_t gap = now.writeback - last.writeback - 1;
+        const auto charge = [&gap](uint64_t& counter, uint64_t cycles) {
+            cycles = std::min(gap, cycles);
+            counter += cycles;
+            gap -= cycles;
+        };
+        charge(stats.memoryStalls, memoryLatency - 1);
+        charge(stats.executeStalls, executeLatency - 1);
+        charge(source.load ? stats.loadUseStalls : stats.rawStalls, now.execute - issue);
+        charge(stats.controlStalls, gap);
+    }
+    stats.cycles = now.writeback + 1 - origin;
+    last = now;
+}
+
+void PipelineModel::Reset() {
+    stats = {};
+    origin = started ? last.writeback + 1 : 0;
+}
+
+uint32_t PipelineModel::ExecuteLatency(const TimingRecord& record) const {
+    switch (record.Opcode()) {
+        case Decoder::Type::R::Opcode:
+        case Decoder::Type::ILogic::Opcode: {
+            const uint32_t funct3 = Decoder::GetFunct3(record.code);
+            return funct3 == FUNCT3_SLL || funct3 == FUNCT3_SRL_SRA ? config.shift : config.alu;
+        }
+        case Decoder::Type::IEnv::Opcode:
+        case Decoder::Type::IFence::Opcode:
+            return config.system;
+        default:
+            return config.alu;
+    }
+}
+
+uint32_t PipelineModel::MemoryLatency(const TimingRecord& record) {
+    uint32_t latency = 0;
+    switch (record.Opcode()) {
+        case Decoder::Type::ILoad::Opcode:
+            latency = config.load;
+            break;
+        case Decoder::Type::S::Opcode:
+            latency = config.store;
+            break;
+        case Decoder::Type::A::Opcode:
+            latency = config.atomic;
+            break;
+        default:
+            return 1;
+    }
+    ++stats.memoryAccesses;
+    if (!cache.Access(record.memoryRef)) {
+        ++stats.cacheMisses;
+        latency += config.miss;
+    }
+    return latency;
+}
+
+// True if the fetch after record was on the right path
+bool PipelineModel::Predict(const TimingRecord& record) {
+    if (record.Opcode() == Decoder::Type::IJump::Opcode) {
+        return predictor.Jump(record);
+    }
+    switch (config.predictor) {
+        case Predictor::NOT_TAKEN:
+            return !record.Taken();
+        case Predictor::BACKWARD_TAKEN:
+            // The sign bit of the B immediate
+            return (static_cast<int32_t>(record.code) < 0) == record.Taken();
+        case Predictor::BIMODAL:
+            return predictor.Branch(record);
+    }
+    return false;
+}
+
+void PipelineModel::Report(std::ostream& out) const {
+    const auto cpi = [this](uint64_t cycles) {
+        return stats.instructions == 0 ? 0.0 : static_cast<double>(cycles) / static_cast<double>(stats.instructions);
+    };
+    const uint64_t stalls = stats.controlStalls + stats.loadUseStalls + stats.rawStalls + stats.executeStalls +
+                            stats.memoryStalls;
+
+    out << "Pipeline: 5-stage in-order, forwarding " << (config.forwarding ? "on" : "off") << ", "
+        << PredictorName(config.predictor) << " predictor\n";
+    out << "Latencies: alu " << config.alu << ", shift " << config.shift << ", load " << config.load << ", store "
+        << config.store << ", atomic " << config.atomic << ", system " << config.system << ", miss " << config.miss
+        << '\n';
+    // Stall cycles and their share of the CPI
+    out << std::fixed << std::setprecision(3);
+    out << "Stall cycles: " << stalls << " (CPI " << cpi(stalls) << ")\n";
+    out << "  control:    " << stats.controlStalls << " (" << cpi(stats.controlStalls) << ")\n";
+    out << "  load-use:   " << stats.loadUseStalls << " (" << cpi(stats.loadUseStalls) << ")\n";
+    out << "  other RAW:  " << stats.rawStalls << " (" << cpi(stats.rawStalls) << ")\n";
+    out << "  execute:    " << stats.executeStalls << " (" << cpi(stats.executeStalls) << ")\n";
+    out << "  memory:     " << stats.memoryStalls << " (" << cpi(stats.memoryStalls) << ")\n";
+    out << "Pipeline fill: " << stats.fill << '\n';
+    out << std::defaultfloat;
+}
+
+} // namespace RISCVS
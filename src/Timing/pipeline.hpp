@@ -0,0 +1,111 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+#include "units.hpp"
+
+namespace RISCVS {
+
+// Classic in-order single-issue 5-stage pipeline (IF ID EX MEM WB). Every
+// instruction gets the cycle it enters each stage: it enters a stage once it
+// is done with the previous one and its predecessor has left it, so a
+// multi-cycle EX or MEM holds everything behind it.
+//
+//  - Operands are needed at the start of EX. With forwarding a result is
+//    available after the producer's EX (its MEM for loads), without it the
+//    consumer reads the register file in the producer's WB cycle.
+//  - Jumps and predicted-taken branches redirect fetch after ID (1 bubble),
+//    mispredicted branches and jalr after EX (2 bubbles).
+//  - Cache misses add to the MEM latency of loads, stores and AMOs.
+//
+// Stall cycles are the gaps between consecutive writebacks, charged to the
+// latest stage that caused them: memory, then execute latency, then data
+// hazards, then fetch redirects.
+class PipelineModel {
+public:
+    enum class Predictor : uint8_t {
+        NOT_TAKEN,
+        BACKWARD_TAKEN,         // backward taken, forward not taken
+        BIMODAL,
+    };
+
+    // Latencies are in cycles of the stage, 1 is fully pipelined
+    struct Config {
+        uint32_t alu = 1;           // EX
+        uint32_t shift = 1;         // EX
+        uint32_t load = 1;          // MEM, on a cache hit
+        uint32_t store = 1;         // MEM, on a cache hit
+        uint32_t atomic = 2;        // MEM, on a cache hit
+        uint32_t system = 3;        // EX of ecall, csr and fences
+        uint32_t miss = 20;         // added to MEM
+        bool forwarding = true;
+        Predictor predictor = Predictor::BIMODAL;
+
+        // "name=value,name=value", e.g. "load=2,forwarding=0,predictor=btfn".
+        // Throws std::runtime_error for an unknown name or a bad value.
+        static Config Parse(std::string_view text);
+    };
+
+    struct Stats {
+        uint64_t instructions = 0;
+        uint64_t cycles = 0;
+        uint64_t fill = 0;              // until the first writeback
+        uint64_t controlStalls = 0;
+        uint64_t loadUseStalls = 0;
+        uint64_t rawStalls = 0;         // other data hazards
+        uint64_t executeStalls = 0;     // multi-cycle EX
+        uint64_t memoryStalls = 0;      // multi-cycle MEM, cache misses included
+        uint64_t branches = 0;          // conditional branches and jalr
+        uint64_t mispredicts = 0;
+        uint64_t memoryAccesses = 0;
+        uint64_t cacheMisses = 0;
+    };
+
+    explicit PipelineModel(const Config& config);
+
+    void Retire(const TimingRecord& record);
+
+    // Clears the statistics, the pipeline, predictor and cache stay warm
+    void Reset();
+
+    const Stats& GetStats() const {
+        return stats;
+    }
+
+    void Report(std::ostream& out) const;
+
+private:
+    // Cycles an instruction enters each stage
+    struct Stages {
+        uint64_t fetch = 0;
+        uint64_t decode = 0;
+        uint64_t execute = 0;
+        uint64_t memory = 0;
+        uint64_t writeback = 0;
+    };
+
+    // When a register's value can be used by the EX of a consumer
+    struct Operand {
+        uint64_t ready = 0;
+        bool load = false;
+    };
+
+    uint32_t ExecuteLatency(const TimingRecord& record) const;
+    uint32_t MemoryLatency(const TimingRecord& record);
+    bool Predict(const TimingRecord& record);
+
+    Config config;
+    Stats stats;
+    Stages last;
+    bool started = false;
+    uint64_t origin = 0;        // cycle the statistics start from
+    uint64_t redirect = 0;      // first fetch cycle of the correct path
+    std::array<Operand, 32> operands{};
+    BranchPredictor predictor;
+    DataCache cache;
+};
+
+} // namespace RISCVS
@@ -0,0 +1,175 @@
+#include "timing.hpp"
+
+#include <array>
+#include <iomanip>
+#include <utility>
+
+namespace RISCVS {
+
+namespace {
+
+double Percent(uint64_t part, uint64_t total) {
+    return total == 0 ? 0.0 : 100.0 * static_cast<double>(part) / static_cast<double>(total);
+}
+
+} // anon namespace
+
+void CycleModel::Retire(const TimingRecord& record) {
+    const uint32_t opcode = record.Opcode();
+    ++stats.instructions;
+    ++stats.cycles;
+
+    if (loadRd != 0 && (record.Rs1() == loadRd || record.Rs2() == loadRd)) {
+        stats.cycles += LOAD_USE_STALL;
+        ++stats.loadUseStalls;
+    }
+    loadRd = opcode == Decoder::Type::ILoad::Opcode ? record.Rd() : 0;
+
+    switch (opcode) {
+        case Decoder::Type::B::Opcode:
+        case Decoder::Type::IJump::Opcode: {
+            ++stats.branches;
+            const bool predicted = opcode == Decoder::Type::B::Opcode ? predictor.Branch(record) : predictor.Jump(record);
+            if (!predicted) {
+                stats.cycles += MISPREDICT_PENALTY;
+                ++stats.mispredicts;
+            }
+            break;
+        }
+        case Decoder::Type::J::Opcode:
+            // The target is known at decode
+            stats.cycles += JUMP_BUBBLE;
+            predictor.Jump(record);
+            break;
+        case Decoder::Type::ILoad::Opcode:
+        case Decoder::Type::S::Opcode:
+        case Decoder::Type::A::Opcode:
+            ++stats.memoryAccesses;
+            if (!cache.Access(record.memoryRef)) {
+                stats.cycles += MISS_PENALTY;
+                ++stats.cacheMisses;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void CycleModel::Report(std::ostream& out) const {
+    out << "Load-use stalls: " << stats.loadUseStalls << '\n';
+}
+
+void TimingStream::Overflow() {
+    if (!lossless) {
+        ++dropped;
+        ++lost;
+        return;
+    }
+    // Wait for the back end, it is behind
+    do {
+        WakeModel();
+        std::this_thread::yield();
+    } while (!ring.Push(current));
+}
+
+void TimingStream::Reset() {
+    dropped = 0;
+    // Never dropped, even when lossy
+    TimingRecord reset;
+    reset.code = RESET;
+    while (!ring.Push(reset)) {
+        WakeModel();
+        std::this_thread::yield();
+    }
+    ++pushed;
+}
+
+void TimingStream::WakeModel() {
+    wakeups.fetch_add(1, std::memory_order_release);
+    wakeups.notify_one();
+}
+
+TimingModel::TimingModel(Model model, bool lossless)
+    : stream(std::make_unique<TimingStream>(lossless, wakeups)), model(std::move(model)) {
+    thread = std::jthread([this](std::stop_token stopToken) { Loop(stopToken); });
+}
+
+TimingModel::~TimingModel() {
+    Finish();
+}
+
+void TimingModel::Finish() {
+    if (thread.joinable()) {
+        thread.request_stop();
+        stream->WakeModel();
+        thread.join();
+    }
+    while (Drain()) {}
+}
+
+void TimingModel::Sync() {
+    while (consumed.load(std::memory_order_acquire) != stream->Queued()) {
+        stream->WakeModel();
+        std::this_thread::yield();
+    }
+}
+
+void TimingModel::Loop(std::stop_token stopToken) {
+    while (!stopToken.stop_requested()) {
+        const uint32_t seen = wakeups.load(std::memory_order_acquire);
+        if (!Drain()) {
+            wakeups.wait(seen, std::memory_order_acquire);
+        }
+    }
+}
+
+bool TimingModel::Drain() {
+    std::array<TimingRecord, 1024> records;
+    const size_t count = stream->ring.PopBulk(records);
+    std::visit(
+        [&](auto& active) {
+            for (size_t i = 0; i < count; ++i) {
+                if (records[i].code == TimingStream::RESET) [[unlikely]] {
+                    active.Reset();
+                    continue;
+                }
+                active.Retire(records[i]);
+            }
+        },
+        model);
+    if (count != 0) {
+        consumed.fetch_add(count, std::memory_order_release);
+    }
+    return count != 0;
+}
+
+void TimingModel::Report(std::ostream& out) const {
+    std::visit(
+        [&](const auto& active) {
+            const auto& stats = active.GetStats();
+            const uint64_t dropped = stream->Dropped();
+            const double cpi =
+                stats.instructions == 0 ? 0 : static_cast<double>(stats.cycles) / static_cast<double>(stats.instructions);
+
+            out << "++++++++TIMING++++++++\n";
+            out << "Modelled instructions: " << stats.instructions << '\n';
+            out << "Cycles: " << stats.cycles << '\n';
+            if (dropped != 0) {
+                out << "Dropped instructions: " << dropped << ", estimated cycles: "
+                    << stats.cycles + static_cast<uint64_t>(cpi * static_cast<double>(dropped)) << '\n';
+            }
+            out << std::fixed << std::setprecision(3);
+            out << "CPI: " << cpi << '\n';
+            out << std::defaultfloat;
+            active.Report(out);
+            out << std::fixed << std::setprecision(2);
+            out << "Branches: " << stats.branches << ", mispredicted: " << stats.mispredicts << " ("
+                << Percent(stats.mispredicts, stats.branches) << "%)\n";
+            out << "Memory accesses: " << stats.memoryAccesses << ", cache misses: " << stats.cacheMisses << " ("
+                << Percent(stats.cacheMisses, stats.memoryAccesses) << "%)\n";
+            out << std::defaultfloat;
+        },
+        model);
+}
+
+} // namespace RISCVS
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <thread>
+#include <variant>
+
+#include <hart.hpp>
+#include <ringBuffer.hpp>
+#include "pipeline.hpp"
+#include "units.hpp"
+
+namespace RISCVS {
+
+// Cycles of a simple in-order scalar core: one instruction per cycle plus
+// load-use interlocks, branch mispredictions (2-bit bimodal predictor,
+// return address stack for jalr) and data cache misses (direct mapped).
+// PipelineModel (pipeline.hpp) models the stages instead.
+class CycleModel {
+public:
+    constexpr static uint64_t LOAD_USE_STALL = 1;
+    constexpr static uint64_t JUMP_BUBBLE = 1;
+    constexpr static uint64_t MISPREDICT_PENALTY = 2;
+    constexpr static uint64_t MISS_PENALTY = 20;
+
+    struct Stats {
+        uint64_t instructions = 0;
+        uint64_t cycles = 0;
+        uint64_t loadUseStalls = 0;
+        uint64_t branches = 0;
+        uint64_t mispredicts = 0;
+        uint64_t memoryAccesses = 0;
+        uint64_t cacheMisses = 0;
+    };
+
+    void Retire(const TimingRecord& record);
+
+    // Clears the statistics, the predictor and the cache stay warm
+    void Reset() {
+        stats = {};
+    }
+
+    const Stats& GetStats() const {
+        return stats;
+    }
+
+    void Report(std::ostream& out) const;
+
+private:
+    Stats stats;
+    uint32_t loadRd = 0;        // destination of the previous instruction if it was a load
+    BranchPredictor predictor;
+    DataCache cache;
+};
+
+// Producer side, filled by Instrumentation::Timing on the hart thread.
+// Records go to a lock-free SPSC ring drained by the TimingModel thread.
+class TimingStream {
+public:
+    constexpr static size_t RING_SIZE = 1U << 16U;
+    // The back end sleeps until woken, the producer wakes it once per this many records
+    constexpr static size_t WAKE_INTERVAL = RING_SIZE / 4U;
+    // Code of the record that resets the model, 0 is illegal and never retires
+    constexpr static uint32_t RESET = 0;
+
+    TimingStream(bool lossless, std::atomic<uint32_t>& wakeups) : lossless(lossless), wakeups(wakeups) {}
+
+    // Called right before and right after the instruction is executed
+    void Before(Hart& hart, uint32_t code) {
+        if (!active) {
+            return;
+        }
+        current.pc = hart.GetPC();
+        current.code = code;
+        switch (Decoder::GetOpcode(code)) {
+            case Decoder::Type::ILoad::Opcode:
+                current.memoryRef = hart[Decoder::GetRs1(code)] + Decoder::GetImmTypeI(code);
+                break;
+            case Decoder::Type::S::Opcode:
+                current.memoryRef = hart[Decoder::GetRs1(code)] + Decoder::GetImmTypeS(code);
+                break;
+            case Decoder::Type::A::Opcode:
+                current.memoryRef = hart[Decoder::GetRs1(code)];
+                break;
+            default:
+                break;
+        }
+    }
+
+    void After(Hart& hart) {
+        if (!active) {
+            return;
+        }
+        current.nextPc = hart.GetPC();
+        if (!ring.Push(current)) [[unlikely]] {
+            Overflow();
+        }
+        if ((++pushed & (WAKE_INTERVAL - 1)) == 0) [[unlikely]] {
+            WakeModel();
+        }
+    }
+
+    // Region of interest control: nothing is pushed while paused, Reset()
+    // goes through the ring so the model resets between the right records
+    void Pause() {
+        active = false;
+    }
+
+    void Resume() {
+        active = true;
+    }
+
+    void Reset();
+
+    // Records lost to a full ring when not lossless, since the last reset
+    uint64_t Dropped() const {
+        return dropped;
+    }
+
+private:
+    friend class TimingModel;
+
+    void Overflow();
+    void WakeModel();
+
+    // Records in the ring so far, consumed or not
+    uint64_t Queued() const {
+        return pushed - lost;
+    }
+
+    bool lossless;
+    std::atomic<uint32_t>& wakeups;
+    bool active = true;
+    uint64_t pushed = 0;
+    uint64_t dropped = 0;
+    uint64_t lost = 0;          // dropped, not cleared by Reset()
+    TimingRecord current;
+    RingBuffer<TimingRecord, RING_SIZE> ring;
+};
+
+// Timing back end on its own thread, decoupled from functional execution
+// by the stream's ring. Lossless (the default), the hart waits when the
+// ring is full and the cycles are exact for the model; otherwise records
+// that do not fit are dropped, the hart never waits and dropped
+// instructions are charged the average CPI. The model is dispatched once
+// per drained batch, not per record. Without a TimingModel the execution
+// loop has no timing code at all (see instrumentation.hpp).
+class TimingModel {
+public:
+    using Model = std::variant<CycleModel, PipelineModel>;
+
+    explicit TimingModel(Model model = CycleModel{}, bool lossless = true);
+
+    // Stops the back end after it consumed everything
+    ~TimingModel();
+
+    TimingModel(const TimingModel&) = delete;
+    TimingModel& operator=(const TimingModel&) = delete;
+
+    TimingStream& Stream() {
+        return *stream;
+    }
+
+    // Consumes the remaining records and stops the back end thread
+    void Finish();
+
+    // Waits until the back end consumed every record pushed so far, so that
+    // Report() can be called from the hart thread in the middle of a run
+    void Sync();
+
+    void Report(std::ostream& out) const;
+
+private:
+    void Loop(std::stop_token stopToken);
+    bool Drain();
+
+    std::atomic<uint32_t> wakeups = 0;
+    std::atomic<uint64_t> consumed = 0;
+    std::unique_ptr<TimingStream> stream;
+    Model model;
+    std::jthread thread;
+};
+
+} // namespace RISCVS
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <Decoder.hpp>
+
+// Pieces shared by the timing models of timing.hpp and pipeline.hpp
+
+namespace RISCVS {
+
+// Retired instruction as the timing back end sees it. The model takes the
+// operands from the instruction word, the front end does not decode for it.
+struct TimingRecord {
+    int32_t pc = 0;
+    int32_t nextPc = 0;
+    uint32_t code = 0;
+    uint32_t memoryRef = 0;     // loads, stores and AMOs
+
+    uint32_t Opcode() const {
+        return Decoder::GetOpcode(code);
+    }
+
+    uint32_t Rs1() const {
+        switch (Opcode()) {
+            case Decoder::Type::R::Opcode:
+            case Decoder::Type::ILogic::Opcode:
+            case Decoder::Type::ILoad::Opcode:
+            case Decoder::Type::IJump::Opcode:
+            case Decoder::Type::S::Opcode:
+            case Decoder::Type::B::Opcode:
+            case Decoder::Type::A::Opcode:
+                return Decoder::GetRs1(code);
+            case Decoder::Type::ICsr::Opcode:
+                // csrrw/csrrs/csrrc, the immediate forms have no source
+                return (Decoder::GetFunct3(code) & 0b100U) == 0 ? Decoder::GetRs1(code) : 0;
+            default:
+                return 0;
+        }
+    }
+
+    uint32_t Rs2() const {
+        switch (Opcode()) {
+            case Decoder::Type::R::Opcode:
+            case Decoder::Type::S::Opcode:
+            case Decoder::Type::B::Opcode:
+            case Decoder::Type::A::Opcode:
+                return Decoder::GetRs2(code);
+            default:
+                return 0;
+        }
+    }
+
+    // 0 when the instruction writes no register
+    uint32_t Rd() const {
+        switch (Opcode()) {
+            case Decoder::Type::S::Opcode:
+            case Decoder::Type::B::Opcode:
+            case Decoder::Type::IFence::Opcode:
+                return 0;
+            default:
+                return Decoder::GetRd(code);
+        }
+    }
+
+    bool Taken() const {
+        return nextPc != pc + static_cast<int32_t>(sizeof(uint32_t));
+    }
+};
+
+// 2-bit bimodal branch predictor with a return address stack for jalr
+class BranchPredictor {
+public:
+    constexpr static size_t ENTRIES = 1024;
+    constexpr static size_t RETURN_STACK = 16;
+
+    BranchPredictor() {
+        counters.fill(1);           // weakly not taken
+    }
+
+    // Predicts the conditional branch of record and trains on its outcome
+    bool Branch(const TimingRecord& record) {
+        uint8_t& counter = counters[(static_cast<uint32_t>(record.pc) >> 2) % ENTRIES];
+        const bool taken = record.Taken();
+        const bool predicted = (counter >= 2) == taken;
+        if (taken && counter < 3) {
+            ++counter;
+        } else if (!taken && counter > 0) {
+            --counter;
+        }
+        return predicted;
+    }
+
+    // True if the jal/jalr target of record was predicted: calls (rd = ra/t0)
+    // push the return address, returns pop it, other jalr are not predicted
+    bool Jump(const TimingRecord& record) {
+        const uint32_t rd = Decoder::GetRd(record.code);
+        bool predicted = true;
+        if (record.Opcode() == Decoder::Type::IJump::Opcode) {
+            predicted = !IsLink(rd) && IsLink(Decoder::GetRs1(record.code)) && top != 0 &&
+                        returns[--top % RETURN_STACK] == record.nextPc;
+        }
+        if (IsLink(rd)) {
+            returns[top++ % RETURN_STACK] = record.pc + static_cast<int32_t>(sizeof(uint32_t));
+        }
+        return predicted;
+    }
+
+private:
+    // x1/x5 are link registers (RISC-V calling convention hints)
+    static bool IsLink(uint32_t reg) {
+        return reg == 1 || reg == 5;
+    }
+
+    std::array<uint8_t, ENTRIES> counters;
+    std::array<int32_t, RETURN_STACK> returns{};
+    size_t top = 0;
+};
+
+// Direct mapped data cache, tags only
+class DataCache {
+public:
+    constexpr static size_t LINES = 512;        // 32 KiB of 64 byte lines
+    constexpr static uint32_t LINE_SHIFT = 6;
+
+    DataCache() {
+        tags.fill(UINT32_MAX);
+    }
+
+    // True on a hit, the line is filled on a miss
+    bool Access(uint32_t address) {
+        const uint32_t line = address >> LINE_SHIFT;
+        uint32_t& tag = tags[line % LINES];
+        if (tag == line) {
+            return true;
+        }
+        tag = line;
+        return false;
+    }
+
+private:
+    std::array<uint32_t, LINES> tags;
+};
+
+} // namespace RISCVS
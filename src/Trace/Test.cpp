@@ -0,0 +1,188 @@
+#include <trace.hpp>
+#include <lz.hpp>
+#include <assembler.hpp>
+#include <machine.hpp>
+#include <iostream>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#define CHECK(cond)                                                         \
+    if (!(cond)) {                                                          \
+        std::cerr << testIdx << " is broken\n";     /* Not informative!*/   \
+        ++failures;                                                         \
+        return false;                                                       \
+    }
+
+namespace {
+
+    int failures = 0;
+
+    // A call far away from the loop gives 5 byte pc deltas both ways
+    constexpr uint32_t CodeAddr = 0x10000;
+    constexpr uint32_t FarAddr = 0x7FFF0000;
+    constexpr uint32_t DataAddr = 0x100000;
+
+    // Records the stream gets next to the ones it should read back
+    struct Recording {
+        constexpr static bool ENABLED = true;
+
+        RISCVS::TraceStream* stream;
+        std::vector<RISCVS::TraceRecord>* expected;
+        RISCVS::TraceRecord current;
+
+        void Before(RISCVS::Hart& hart, uint32_t binInstruction) {
+            stream->Before(hart, binInstruction);
+            RISCVS::CaptureBefore(current, hart, binInstruction);
+        }
+
+        void After(RISCVS::Hart& hart, uint32_t) {
+            stream->After(hart);
+            RISCVS::CaptureAfter(current, hart);
+            expected->push_back(current);
+        }
+    };
+
+    bool Same(const RISCVS::TraceRecord& lhs, const RISCVS::TraceRecord& rhs) {
+        using RISCVS::TraceRecord;
+        constexpr uint8_t CAPTURED = TraceRecord::RD | TraceRecord::MEMORY;
+        if (lhs.pc != rhs.pc || lhs.code != rhs.code || (lhs.flags & CAPTURED) != (rhs.flags & CAPTURED)) {
+            return false;
+        }
+        if ((lhs.flags & TraceRecord::RD) && (lhs.rd != rhs.rd || lhs.rdValue != rhs.rdValue)) {
+            return false;
+        }
+        return !(lhs.flags & TraceRecord::MEMORY) || lhs.memoryRef == rhs.memoryRef;
+    }
+
+} // anon namespace
+
+namespace RISCVS {
+
+    bool TestLz(std::span<const uint8_t> src, size_t maxCompressed) {
+        std::cerr << "---------[]---------\n";
+        static int testIdx = 0;
+        testIdx++;
+
+        std::vector<uint8_t> compressed;
+        Lz::Compress(src, compressed);
+        CHECK(compressed.size() <= maxCompressed);
+
+        std::vector<uint8_t> restored{1, 2, 3};
+        CHECK(Lz::Decompress(compressed, src.size(), restored));
+        CHECK(restored.size() == src.size() && std::equal(restored.begin(), restored.end(), src.begin()));
+
+        // A block that does not fill the raw size exactly is reported
+        if (!src.empty()) {
+            CHECK(!Lz::Decompress(compressed, src.size() - 1, restored));
+            CHECK(!Lz::Decompress(compressed, src.size() + 1, restored));
+        }
+
+        return true;
+    }
+
+    // Two harts trace into streams 0 and 1 of one file, interleaved, each
+    // long enough for several blocks; both are read back record by record
+    bool TestTraceRoundTrip() {
+        std::cerr << "---------[]---------\n";
+        static int testIdx = 0;
+        testIdx++;
+
+        Assembler far{FarAddr};
+        far.Xor(Assembler::A0, Assembler::A0, Assembler::T1);
+        far.Jalr(Assembler::ZERO, Assembler::RA, 0);
+
+        Assembler as{CodeAddr};
+        auto loop = as.NewLabel();
+        auto near = as.NewLabel();
+        as.Li(Assembler::S0, DataAddr);
+        as.Li(Assembler::S1, FarAddr);
+        as.Li(Assembler::T0, 3000);
+        as.Bind(loop);
+        as.Lw(Assembler::T1, Assembler::S0, 0);
+        as.AddI(Assembler::T1, Assembler::T1, 3);
+        as.Sw(Assembler::T1, Assembler::S0, 0);
+        as.Jal(Assembler::RA, near);
+        as.Jalr(Assembler::RA, Assembler::S1, 0);
+        as.AddI(Assembler::T0, Assembler::T0, -1);
+        as.Bnez(Assembler::T0, loop);
+        as.Exit();
+        as.Bind(near);
+        as.Sub(Assembler::A1, Assembler::A1, Assembler::T1);
+        as.Jalr(Assembler::ZERO, Assembler::RA, 0);
+
+        const std::filesystem::path path =
+            std::filesystem::temp_directory_path() / ("riscvs_test_" + std::to_string(getpid()) + ".rvt");
+        std::vector<TraceRecord> expected[2];
+        {
+            Machine machines[2] = {Machine{as.Image(), CodeAddr}, Machine{as.Image(), CodeAddr}};
+            TraceWriter writer{path.string()};
+            Hart harts[2] = {Hart{machines[0], CodeAddr}, Hart{machines[1], CodeAddr}};
+            Recording policies[2];
+            for (size_t i = 0; i < 2; ++i) {
+                machines[i].WriteBlock(FarAddr, far.Image());
+                harts[i].SetSyscallHandler([](Hart& hart) {
+                    hart.Stop();
+                    return true;
+                });
+                policies[i] = Recording{.stream = &writer.OpenStream(), .expected = &expected[i]};
+            }
+
+            while (!harts[0].IsStop() || !harts[1].IsStop()) {
+                for (size_t i = 0; i < 2; ++i) {
+                    if (!harts[i].IsStop()) {
+                        harts[i].Loop(policies[i], 1000 + 300 * i);
+                    }
+                }
+            }
+        }
+
+        bool ok = true;
+        for (uint32_t streamId = 0; streamId < 2 && ok; ++streamId) {
+            TraceReader reader{path.string(), streamId};
+            TraceRecord record;
+            size_t count = 0;
+            int32_t nextPC = 0;
+            while (ok && reader.Next(record)) {
+                ok = count < expected[streamId].size() && Same(record, expected[streamId][count]) &&
+                     ((record.flags & TraceRecord::PC_JUMP) != 0) == (record.pc != nextPC);
+                nextPC = record.pc + sizeof(uint32_t);
+                ++count;
+            }
+            ok = ok && count == expected[streamId].size() && count > 20000;
+        }
+        std::filesystem::remove(path);
+        CHECK(ok);
+
+        return true;
+    }
+
+    int TestTrace() {
+        failures = 0;
+
+        std::mt19937 random{0};
+        std::vector<uint8_t> noise(200000);
+        for (uint8_t& byte : noise) {
+            byte = static_cast<uint8_t>(random());
+        }
+        std::vector<uint8_t> runs(1U << 20U, 0);
+        for (size_t i = runs.size() / 2; i < runs.size(); ++i) {
+            runs[i] = "abc"[i % 3];
+        }
+        const uint8_t single[] = {42};
+
+        // Lz: incompressible input stays within the literal bound, runs shrink
+        TestLz(noise, noise.size() + noise.size() / 255 + 16);
+        TestLz(runs, runs.size() / 100);
+        TestLz({}, 16);
+        TestLz(single, 16);
+
+        // Binary trace
+        TestTraceRoundTrip();
+
+        return failures; // number of failed tests
+    }
+
+} // RISCVS
@@ -0,0 +1,188 @@
+#include "lz.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace RISCVS::Lz {
+
+namespace {
+
+constexpr size_t MIN_MATCH = 4;
+constexpr size_t MAX_OFFSET = 0xFFFF;
+constexpr unsigned HASH_BITS = 12;
+
+uint32_t Read32(const uint8_t* ptr) {
+    uint32_t value;
+    std::memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+uint32_t Hash(uint32_t sequence) {
+    return (sequence * 2654435761U) >> (32U - HASH_BITS);
+}
+
+uint64_t Read64(const uint8_t* ptr) {
+    uint64_t value;
+    std::memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+uint8_t* PutLength(uint8_t* out, size_t length) {
+    while (length >= 255) {
+        *out++ = 255;
+        length -= 255;
+    }
+    *out++ = static_cast<uint8_t>(length);
+    return out;
+}
+
+uint8_t* PutSequence(uint8_t* out, const uint8_t* literals, size_t literalLength, size_t offset, size_t matchLength) {
+    const size_t matchCode = matchLength != 0 ? matchLength - MIN_MATCH : 0;
+
+    *out++ = (std::min<size_t>(literalLength, 15) << 4) | std::min<size_t>(matchCode, 15);
+    if (literalLength >= 15) {
+        out = PutLength(out, literalLength - 15);
+    }
+    std::memcpy(out, literals, literalLength);
+    out += literalLength;
+
+    if (matchLength == 0) {
+        return out;
+    }
+
+    *out++ = offset & 0xFF;
+    *out++ = offset >> 8;
+    if (matchCode >= 15) {
+        out = PutLength(out, matchCode - 15);
+    }
+    return out;
+}
+
+// Length of the common prefix of a and b, at most limit bytes
+size_t CommonLength(const uint8_t* a, const uint8_t* b, size_t limit) {
+    size_t length = 0;
+    while (length + sizeof(uint64_t) <= limit) {
+        const uint64_t diff = Read64(a + length) ^ Read64(b + length);
+        if (diff != 0) {
+            return length + (__builtin_ctzll(diff) >> 3);
+        }
+        length += sizeof(uint64_t);
+    }
+    while (length < limit && a[length] == b[length]) {
+        ++length;
+    }
+    return length;
+}
+
+bool GetLength(std::span<const uint8_t> src, size_t& pos, size_t& length) {
+    uint8_t byte = 255;
+    while (byte == 255) {
+        if (pos >= src.size()) {
+            return false;
+        }
+        byte = src[pos++];
+        length += byte;
+    }
+    return true;
+}
+
+} // anon namespace
+
+void Compress(std::span<const uint8_t> src, std::vector<uint8_t>& dst) {
+    // Worst case: everything is literals
+    dst.resize(src.size() + src.size() / 255 + 16);
+
+    // Positions are stored +1, zero means empty slot
+    std::array<uint32_t, 1U << HASH_BITS> table{};
+
+    const uint8_t* data = src.data();
+    const size_t size = src.size();
+    uint8_t* out = dst.data();
+    size_t anchor = 0;
+    size_t pos = 0;
+    // Step grows while no match is found, so incompressible data is skipped fast
+    size_t misses = 0;
+
+    while (pos + MIN_MATCH <= size) {
+        const uint32_t sequence = Read32(data + pos);
+        const uint32_t hash = Hash(sequence);
+        const size_t candidate = table[hash];
+        table[hash] = pos + 1;
+
+        if (candidate == 0 || pos - (candidate - 1) > MAX_OFFSET || Read32(data + candidate - 1) != sequence) {
+            pos += 1 + (misses++ >> 6U);
+            continue;
+        }
+
+        const size_t matchPos = candidate - 1;
+        const size_t matchLength = MIN_MATCH + CommonLength(data + matchPos + MIN_MATCH, data + pos + MIN_MATCH,
+                                                            size - pos - MIN_MATCH);
+
+        out = PutSequence(out, data + anchor, pos - anchor, pos - matchPos, matchLength);
+        pos += matchLength;
+        anchor = pos;
+        misses = 0;
+    }
+
+    out = PutSequence(out, data + anchor, size - anchor, 0, 0);
+    dst.resize(out - dst.data());
+}
+
+bool Decompress(std::span<const uint8_t> src, size_t rawSize, std::vector<uint8_t>& dst) {
+    dst.resize(rawSize);
+
+    uint8_t* out = dst.data();
+    uint8_t* const outEnd = out + rawSize;
+    size_t pos = 0;
+    while (pos < src.size()) {
+        const uint8_t token = src[pos++];
+
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !GetLength(src, pos, literalLength)) {
+            return false;
+        }
+        if (pos + literalLength > src.size() || literalLength > static_cast<size_t>(outEnd - out)) {
+            return false;
+        }
+        std::memcpy(out, src.data() + pos, literalLength);
+        out += literalLength;
+        pos += literalLength;
+
+        if (pos == src.size()) {
+            break;
+        }
+
+        if (pos + 2 > src.size()) {
+            return false;
+        }
+        const size_t offset = src[pos] | (src[pos + 1] << 8);
+        pos += 2;
+
+        size_t matchLength = token & 0xF;
+        if (matchLength == 15 && !GetLength(src, pos, matchLength)) {
+            return false;
+        }
+        matchLength += MIN_MATCH;
+
+        if (offset == 0 || offset > static_cast<size_t>(out - dst.data()) ||
+            matchLength > static_cast<size_t>(outEnd - out)) {
+            return false;
+        }
+
+        // The match may overlap the bytes being produced
+        const uint8_t* from = out - offset;
+        if (offset >= matchLength) {
+            std::memcpy(out, from, matchLength);
+        } else {
+            for (size_t i = 0; i < matchLength; ++i) {
+                out[i] = from[i];
+            }
+        }
+        out += matchLength;
+    }
+
+    return out == outEnd;
+}
+
+} // namespace RISCVS::Lz
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace RISCVS::Lz {
+
+// In-tree LZ77 block compressor using the LZ4 block layout:
+// [token][literal length ext][literals][offset u16][match length ext]...
+// The last sequence carries literals only.
+
+void Compress(std::span<const uint8_t> src, std::vector<uint8_t>& dst);
+
+// rawSize is the size of the original block, returns false on corrupted input.
+bool Decompress(std::span<const uint8_t> src, size_t rawSize, std::vector<uint8_t>& dst);
+
+} // namespace RISCVS::Lz
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <span>
+
+namespace RISCVS {
+
+// Single-producer/single-consumer lock-free ring buffer.
+// Capacity must be a power of two.
+template<typename T, size_t Capacity>
+class RingBuffer {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    bool Push(const T& value) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tailCache_ == Capacity) {
+            tailCache_ = tail_.load(std::memory_order_acquire);
+            if (head - tailCache_ == Capacity) {
+                return false;
+            }
+        }
+
+        data_[head & MASK] = value;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool Pop(T& value) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == headCache_) {
+            headCache_ = head_.load(std::memory_order_acquire);
+            if (tail == headCache_) {
+                return false;
+            }
+        }
+
+        value = data_[tail & MASK];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Pops up to out.size() elements, returns the number of popped ones.
+    size_t PopBulk(std::span<T> out) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        headCache_ = head_.load(std::memory_order_acquire);
+
+        size_t count = std::min(out.size(), headCache_ - tail);
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = data_[(tail + i) & MASK];
+        }
+
+        tail_.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    bool Empty() const {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+private:
+    constexpr static size_t MASK = Capacity - 1;
+    constexpr static size_t CACHE_LINE = 64;
+
+    // Producer side
+    alignas(CACHE_LINE) std::atomic<size_t> head_ = 0;
+    size_t tailCache_ = 0;
+
+    // Consumer side
+    alignas(CACHE_LINE) std::atomic<size_t> tail_ = 0;
+    size_t headCache_ = 0;
+
+    alignas(CACHE_LINE) std::array<T, Capacity> data_;
+};
+
+}
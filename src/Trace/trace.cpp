@@ -0,0 +1,304 @@
+#include "trace.hpp"
+#include "lz.hpp"
+
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+namespace RISCVS {
+
+namespace {
+
+constexpr char MAGIC[4] = {'R', 'V', 'T', 'R'};
+
+void Put32(std::vector<uint8_t>& out, uint32_t value) {
+    for (unsigned i = 0; i < 4; ++i) {
+        out.push_back((value >> (8U * i)) & 0xFFU);
+    }
+}
+
+bool Get32(const std::vector<uint8_t>& in, size_t& pos, uint32_t& value) {
+    if (pos + 4 > in.size()) {
+        return false;
+    }
+    value = in[pos] | (in[pos + 1] << 8U) | (in[pos + 2] << 16U) | (static_cast<uint32_t>(in[pos + 3]) << 24U);
+    pos += 4;
+    return true;
+}
+
+bool GetVarint(const std::vector<uint8_t>& in, size_t& pos, int32_t& value) {
+    uint32_t zigzag = 0;
+    for (unsigned shift = 0; shift < 35; shift += 7) {
+        if (pos >= in.size()) {
+            return false;
+        }
+        uint8_t byte = in[pos++];
+        zigzag |= static_cast<uint32_t>(byte & 0x7FU) << shift;
+        if ((byte & 0x80U) == 0) {
+            value = static_cast<int32_t>((zigzag >> 1U) ^ -(zigzag & 1U));
+            return true;
+        }
+    }
+    return false;
+}
+
+} // anon namespace
+
+void CaptureBefore(TraceRecord& record, Hart& hart, uint32_t code) {
+    const Uint rd = Decoder::GetRd(code);
+    const Uint rs1 = Decoder::GetRs1(code);
+
+    record.pc = hart.GetPC();
+    record.code = code;
+    record.rd = rd;
+
+    switch (Decoder::GetOpcode(code)) {
+        case Decoder::Type::ILoad::Opcode:
+            record.flags = TraceRecord::RD | TraceRecord::MEMORY;
+            record.memoryRef = hart[rs1] + Decoder::GetImmTypeI(code);
+            break;
+
+        case Decoder::Type::S::Opcode:
+            record.flags = TraceRecord::MEMORY;
+            record.memoryRef = hart[rs1] + Decoder::GetImmTypeS(code);
+            break;
+
+        case Decoder::Type::B::Opcode:
+        case Decoder::Type::IEnv::Opcode:
+            record.flags = TraceRecord::NONE;
+            break;
+
+        default:
+            record.flags = TraceRecord::RD;
+            break;
+    }
+
+    if (rd == 0) {
+        record.flags &= ~TraceRecord::RD;
+    }
+}
+
+void CaptureAfter(TraceRecord& record, Hart& hart) {
+    if (record.flags & TraceRecord::RD) {
+        record.rdValue = hart[record.rd];
+    }
+}
+
+void TraceStream::Before(Hart& hart, uint32_t code) {
+    CaptureBefore(current, hart, code);
+}
+
+void TraceStream::After(Hart& hart) {
+    CaptureAfter(current, hart);
+
+    // Tracing is lossless: wait for the writer if it falls behind
+    while (!ring.Push(current)) {
+        WakeWriter();
+        std::this_thread::yield();
+    }
+
+    if ((++pushed & (WAKE_INTERVAL - 1)) == 0) {
+        WakeWriter();
+    }
+}
+
+void TraceStream::WakeWriter() {
+    wakeups.fetch_add(1, std::memory_order_release);
+    wakeups.notify_one();
+}
+
+TraceWriter::TraceWriter(std::string_view path) : file(std::string(path), std::ios::binary | std::ios::trunc) {
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open trace file");
+    }
+
+    std::vector<uint8_t> header(std::begin(MAGIC), std::end(MAGIC));
+    Put32(header, VERSION);
+    file.write(reinterpret_cast<const char*>(header.data()), header.size());
+
+    thread = std::jthread([this](std::stop_token stopToken) { Loop(stopToken); });
+}
+
+TraceWriter::~TraceWriter() {
+    thread.request_stop();
+    wakeups.fetch_add(1, std::memory_order_release);
+    wakeups.notify_one();
+    thread.join();
+
+    for (auto& output : outputs) {
+        while (Drain(*output)) {}
+        Flush(*output);
+    }
+}
+
+TraceStream& TraceWriter::OpenStream() {
+    std::lock_guard lock{outputsMutex};
+    auto output = std::make_unique<Output>();
+    output->stream = std::make_unique<TraceStream>(outputs.size(), wakeups);
+    output->raw.reserve(BLOCK_SIZE + 64);
+    outputs.push_back(std::move(output));
+    return *outputs.back()->stream;
+}
+
+void TraceWriter::Loop(std::stop_token stopToken) {
+    while (!stopToken.stop_requested()) {
+        const uint32_t seen = wakeups.load(std::memory_order_acquire);
+
+        bool drained = false;
+        {
+            std::lock_guard lock{outputsMutex};
+            for (auto& output : outputs) {
+                drained |= Drain(*output);
+            }
+        }
+
+        if (!drained) {
+            wakeups.wait(seen, std::memory_order_acquire);
+        }
+    }
+}
+
+bool TraceWriter::Drain(Output& output) {
+    std::array<TraceRecord, 1024> records;
+    size_t count = output.stream->ring.PopBulk(records);
+
+    for (size_t i = 0; i < count; ++i) {
+        Encode(output, records[i]);
+        if (output.raw.size() >= BLOCK_SIZE) {
+            Flush(output);
+        }
+    }
+
+    return count != 0;
+}
+
+void TraceWriter::Encode(Output& output, const TraceRecord& record) {
+    // Largest record: flags + 5 byte varint + code + rd + rdValue + memoryRef
+    std::array<uint8_t, 19> buffer;
+    uint8_t* out = buffer.data();
+
+    const int32_t delta = record.pc - output.nextPC;
+    uint8_t flags = record.flags & (TraceRecord::RD | TraceRecord::MEMORY);
+    if (delta != 0) {
+        flags |= TraceRecord::PC_JUMP;
+    }
+
+    *out++ = flags;
+    if (flags & TraceRecord::PC_JUMP) {
+        uint32_t zigzag = (static_cast<uint32_t>(delta) << 1U) ^ static_cast<uint32_t>(delta >> 31);
+        while (zigzag >= 0x80U) {
+            *out++ = (zigzag & 0x7FU) | 0x80U;
+            zigzag >>= 7U;
+        }
+        *out++ = zigzag;
+    }
+    std::memcpy(out, &record.code, sizeof(uint32_t));
+    out += sizeof(uint32_t);
+    if (flags & TraceRecord::RD) {
+        *out++ = record.rd;
+        std::memcpy(out, &record.rdValue, sizeof(uint32_t));
+        out += sizeof(uint32_t);
+    }
+    if (flags & TraceRecord::MEMORY) {
+        std::memcpy(out, &record.memoryRef, sizeof(uint32_t));
+        out += sizeof(uint32_t);
+    }
+
+    output.raw.insert(output.raw.end(), buffer.data(), out);
+    output.nextPC = record.pc + sizeof(uint32_t);
+}
+
+void TraceWriter::Flush(Output& output) {
+    if (output.raw.empty()) {
+        return;
+    }
+
+    Lz::Compress(output.raw, compressed);
+
+    std::vector<uint8_t> header;
+    Put32(header, output.stream->GetId());
+    Put32(header, output.raw.size());
+    Put32(header, compressed.size());
+    file.write(reinterpret_cast<const char*>(header.data()), header.size());
+    file.write(reinterpret_cast<const char*>(compressed.data()), compressed.size());
+
+    output.raw.clear();
+}
+
+TraceReader::TraceReader(std::string_view path, uint32_t streamId) : file(std::string(path), std::ios::binary), streamId(streamId) {
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open trace file");
+    }
+
+    std::vector<uint8_t> header(8);
+    file.read(reinterpret_cast<char*>(header.data()), header.size());
+
+    size_t headerPos = 4;
+    uint32_t version = 0;
+    if (!file || std::memcmp(header.data(), MAGIC, sizeof(MAGIC)) != 0 ||
+        !Get32(header, headerPos, version) || version != TraceWriter::VERSION) {
+        throw std::runtime_error("Not a binary trace file");
+    }
+}
+
+bool TraceReader::ReadBlock() {
+    std::vector<uint8_t> header(12);
+    while (file.read(reinterpret_cast<char*>(header.data()), header.size())) {
+        size_t headerPos = 0;
+        uint32_t id = 0;
+        uint32_t rawSize = 0;
+        uint32_t compressedSize = 0;
+        Get32(header, headerPos, id);
+        Get32(header, headerPos, rawSize);
+        Get32(header, headerPos, compressedSize);
+
+        if (id != streamId) {
+            file.seekg(compressedSize, std::ios::cur);
+            continue;
+        }
+
+        compressed.resize(compressedSize);
+        if (!file.read(reinterpret_cast<char*>(compressed.data()), compressedSize) ||
+            !Lz::Decompress(compressed, rawSize, raw)) {
+            throw std::runtime_error("Corrupted trace block");
+        }
+
+        pos = 0;
+        return true;
+    }
+
+    return false;
+}
+
+bool TraceReader::Next(TraceRecord& record) {
+    if (pos == raw.size() && !ReadBlock()) {
+        return false;
+    }
+
+    record = TraceRecord{};
+    record.flags = raw[pos++];
+
+    int32_t delta = 0;
+    if ((record.flags & TraceRecord::PC_JUMP) && !GetVarint(raw, pos, delta)) {
+        throw std::runtime_error("Corrupted trace record");
+    }
+    record.pc = nextPC + delta;
+
+    bool ok = Get32(raw, pos, record.code);
+    if (record.flags & TraceRecord::RD) {
+        ok = ok && pos < raw.size();
+        record.rd = ok ? raw[pos++] : 0;
+        ok = ok && Get32(raw, pos, record.rdValue);
+    }
+    if (record.flags & TraceRecord::MEMORY) {
+        ok = ok && Get32(raw, pos, record.memoryRef);
+    }
+    if (!ok) {
+        throw std::runtime_error("Corrupted trace record");
+    }
+
+    nextPC = record.pc + sizeof(uint32_t);
+    return true;
+}
+
+} // namespace RISCVS
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <hart.hpp>
+#include "ringBuffer.hpp"
+
+namespace RISCVS {
+
+// Binary trace file layout:
+//   header: "RVTR" u32 version
+//   blocks: u32 streamId, u32 rawSize, u32 compressedSize, Lz-compressed records
+// Record layout inside a block (little endian):
+//   u8 flags, [zigzag varint pc delta], u32 code, [u8 rd, u32 rdValue], [u32 memoryRef]
+// The pc delta is relative to pc + 4 of the previous record of the same stream
+// and is present only for non-sequential records (PC_JUMP flag).
+
+struct TraceRecord {
+    enum Flags : uint8_t {
+        NONE    = 0,
+        RD      = 1U << 0U,
+        MEMORY  = 1U << 1U,
+        PC_JUMP = 1U << 2U,
+    };
+
+    int32_t pc = 0;
+    uint32_t code = 0;
+    uint8_t flags = NONE;
+    uint8_t rd = 0;
+    uint32_t rdValue = 0;
+    uint32_t memoryRef = 0;
+};
+
+// Fill record from the hart state around the execution of one instruction
+void CaptureBefore(TraceRecord& record, Hart& hart, uint32_t code);
+void CaptureAfter(TraceRecord& record, Hart& hart);
+
+// Producer side, owned by one hart thread. Records are pushed into a
+// lock-free ring which is drained by the TraceWriter thread.
+class TraceStream {
+public:
+    constexpr static size_t RING_SIZE = 1U << 14U;
+    // The writer sleeps until woken, producers wake it once per this many records
+    constexpr static size_t WAKE_INTERVAL = RING_SIZE / 4U;
+
+    TraceStream(uint32_t id, std::atomic<uint32_t>& wakeups) : id(id), wakeups(wakeups) {}
+
+    // Called right before and right after the instruction is executed
+    void Before(Hart& hart, uint32_t code);
+    void After(Hart& hart);
+
+    uint32_t GetId() const {
+        return id;
+    }
+
+private:
+    friend class TraceWriter;
+
+    void WakeWriter();
+
+    uint32_t id;
+    std::atomic<uint32_t>& wakeups;
+    size_t pushed = 0;
+    TraceRecord current;
+    RingBuffer<TraceRecord, RING_SIZE> ring;
+};
+
+// Background writer: encodes, compresses and writes records of every stream.
+class TraceWriter {
+public:
+    constexpr static uint32_t VERSION = 1;
+    constexpr static size_t BLOCK_SIZE = 64U * 1024U;
+
+    explicit TraceWriter(std::string_view path);
+
+    // Drains all streams and flushes the file
+    ~TraceWriter();
+
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+    TraceStream& OpenStream();
+
+private:
+    struct Output {
+        std::unique_ptr<TraceStream> stream;
+        std::vector<uint8_t> raw;
+        int32_t nextPC = 0;
+    };
+
+    void Loop(std::stop_token stopToken);
+    bool Drain(Output& output);
+    void Encode(Output& output, const TraceRecord& record);
+    void Flush(Output& output);
+
+    std::ofstream file;
+    std::vector<uint8_t> compressed;
+    std::atomic<uint32_t> wakeups = 0;
+
+    std::mutex outputsMutex; // guards registration only, producers never take it
+    std::vector<std::unique_ptr<Output>> outputs;
+
+    std::jthread thread;
+};
+
+// Streaming reader of one stream of a binary trace.
+class TraceReader {
+public:
+    explicit TraceReader(std::string_view path, uint32_t streamId = 0);
+
+    bool Next(TraceRecord& record);
+
+private:
+    bool ReadBlock();
+
+    std::ifstream file;
+    uint32_t streamId;
+
+    std::vector<uint8_t> compressed;
+    std::vector<uint8_t> raw;
+    size_t pos = 0;
+    int32_t nextPC = 0;
+};
+
+// Round trips of Lz and of traces through TraceWriter/TraceReader (Test.cpp),
+// returns the number of failed tests
+int TestTrace();
+
+} // namespace RISCVS
@@ -0,0 +1,246 @@
+#include "traceDiff.hpp"
+
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <stdexcept>
+
+namespace RISCVS {
+
+namespace {
+
+constexpr size_t MAX_TOKENS = 8;
+
+size_t Tokenize(const std::string& line, size_t from, std::array<std::string_view, MAX_TOKENS>& tokens) {
+    size_t count = 0;
+    size_t pos = from;
+    while (count < MAX_TOKENS) {
+        pos = line.find_first_not_of(" \t", pos);
+        if (pos == std::string::npos) {
+            break;
+        }
+        size_t end = line.find_first_of(" \t", pos);
+        if (end == std::string::npos) {
+            end = line.size();
+        }
+        tokens[count++] = std::string_view(line).substr(pos, end - pos);
+        pos = end;
+    }
+    return count;
+}
+
+bool ParseHex(std::string_view token, uint32_t& value) {
+    if (token.size() < 3 || token[0] != '0' || token[1] != 'x') {
+        return false;
+    }
+    // 64-bit spike values of an RV32 guest are sign-extended, keep the low part
+    value = static_cast<uint32_t>(std::strtoull(std::string(token).c_str(), nullptr, 16));
+    return true;
+}
+
+void Print(std::ostream& out, const TraceRecord& record) {
+    out << std::hex << std::setfill('0') << "pc 0x" << std::setw(8) << record.pc
+        << " (0x" << std::setw(8) << record.code << ')';
+    if (record.flags & TraceRecord::RD) {
+        out << " x" << std::dec << static_cast<unsigned>(record.rd)
+            << " 0x" << std::hex << std::setw(8) << record.rdValue;
+    }
+    if (record.flags & TraceRecord::MEMORY) {
+        out << " mem 0x" << std::setw(8) << record.memoryRef;
+    }
+    out << std::dec << std::setfill(' ');
+}
+
+bool Same(const TraceRecord& expected, const TraceRecord& actual) {
+    if (expected.pc != actual.pc || expected.code != actual.code) {
+        return false;
+    }
+
+    const uint8_t expectedRd = expected.flags & TraceRecord::RD;
+    if (expectedRd != (actual.flags & TraceRecord::RD)) {
+        return false;
+    }
+    if (expectedRd && (expected.rd != actual.rd || expected.rdValue != actual.rdValue)) {
+        return false;
+    }
+
+    // Not every reference logs addresses, compare them when both sides have one
+    if ((expected.flags & actual.flags & TraceRecord::MEMORY) && expected.memoryRef != actual.memoryRef) {
+        return false;
+    }
+
+    return true;
+}
+
+} // anon namespace
+
+SpikeLogReference::SpikeLogReference(std::string_view path) : file(std::string(path)) {
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open reference trace");
+    }
+}
+
+bool SpikeLogReference::Next(TraceRecord& record) {
+    std::array<std::string_view, MAX_TOKENS> tokens;
+
+    while (std::getline(file, line)) {
+        if (line.compare(0, 4, "core") != 0) {
+            continue;
+        }
+        const size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+
+        const size_t count = Tokenize(line, colon + 1, tokens);
+        size_t idx = 0;
+        // Privilege level is printed by --log-commits only
+        if (count > 0 && !tokens[0].starts_with("0x")) {
+            ++idx;
+        }
+        if (idx + 1 >= count) {
+            continue;
+        }
+
+        record = TraceRecord{};
+        uint32_t pc = 0;
+        std::string_view code = tokens[idx + 1];
+        if (!ParseHex(tokens[idx], pc) || code.size() < 4 || code.front() != '(' || code.back() != ')' ||
+            !ParseHex(code.substr(1, code.size() - 2), record.code)) {
+            continue;
+        }
+        record.pc = pc;
+
+        for (idx += 2; idx < count; ++idx) {
+            std::string_view token = tokens[idx];
+            if (token == "mem" && idx + 1 < count) {
+                ParseHex(tokens[++idx], record.memoryRef);
+                record.flags |= TraceRecord::MEMORY;
+                // Stores are followed by the stored value
+                if (idx + 1 < count && tokens[idx + 1].starts_with("0x")) {
+                    ++idx;
+                }
+            } else if (token.size() > 1 && token[0] == 'x' && idx + 1 < count) {
+                record.rd = std::atoi(std::string(token.substr(1)).c_str());
+                ParseHex(tokens[++idx], record.rdValue);
+                record.flags |= TraceRecord::RD;
+            } else if (idx + 1 < count) {
+                // CSR and FP register writes
+                ++idx;
+            }
+        }
+
+        if (record.rd == 0) {
+            record.flags &= ~TraceRecord::RD;
+        }
+        return true;
+    }
+
+    return false;
+}
+
+std::unique_ptr<ReferenceTrace> OpenReferenceTrace(std::string_view path) {
+    std::ifstream file{std::string(path), std::ios::binary};
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open reference trace");
+    }
+
+    char magic[4] = {};
+    file.read(magic, sizeof(magic));
+    if (file && std::memcmp(magic, "RVTR", sizeof(magic)) == 0) {
+        return std::make_unique<BinaryTraceReference>(path);
+    }
+    return std::make_unique<SpikeLogReference>(path);
+}
+
+TraceDiffer::TraceDiffer(std::unique_ptr<ReferenceTrace> reference, size_t historySize)
+    : reference(std::move(reference)), history(historySize) {}
+
+bool TraceDiffer::Check(const TraceRecord& actual) {
+    if (diverged) {
+        return false;
+    }
+
+    TraceRecord expected;
+    bool hasExpected = reference->Next(expected);
+
+    // The reference may start earlier (e.g. spike boot ROM): skip up to our first pc
+    while (!synchronized && hasExpected && expected.pc != actual.pc) {
+        hasExpected = reference->Next(expected);
+    }
+    synchronized = true;
+
+    if (!hasExpected) {
+        referenceEnded = true;
+        diverged = true;
+        divergence = Entry{.expected = {}, .actual = actual};
+        return false;
+    }
+
+    if (!Same(expected, actual)) {
+        diverged = true;
+        divergence = Entry{.expected = expected, .actual = actual};
+        return false;
+    }
+
+    Remember(expected, actual);
+    ++index;
+    return true;
+}
+
+bool TraceDiffer::Finish() {
+    TraceRecord expected;
+    if (!diverged && reference->Next(expected)) {
+        executionEnded = true;
+        diverged = true;
+        divergence = Entry{.expected = expected, .actual = {}};
+    }
+    return !diverged;
+}
+
+void TraceDiffer::Remember(const TraceRecord& expected, const TraceRecord& actual) {
+    if (history.empty()) {
+        return;
+    }
+    history[historyNext % history.size()] = Entry{.expected = expected, .actual = actual};
+    ++historyNext;
+}
+
+void TraceDiffer::Report(std::ostream& out) const {
+    if (!diverged) {
+        out << "Trace matches the reference: " << index << " instructions\n";
+        return;
+    }
+
+    if (referenceEnded) {
+        out << "Reference trace ended at instruction #" << index << ", execution continues with\n  ";
+        Print(out, divergence.actual);
+        out << '\n';
+    } else if (executionEnded) {
+        out << "Execution stopped at instruction #" << index << ", reference continues with\n  ";
+        Print(out, divergence.expected);
+        out << '\n';
+    } else {
+        out << "Trace divergence at instruction #" << index << '\n';
+        out << "  expected: ";
+        Print(out, divergence.expected);
+        out << "\n  actual:   ";
+        Print(out, divergence.actual);
+        out << '\n';
+    }
+
+    const size_t count = std::min(historyNext, history.size());
+    if (count == 0) {
+        return;
+    }
+
+    out << "Preceding " << count << " instructions:\n";
+    for (size_t i = historyNext - count; i < historyNext; ++i) {
+        out << "  #" << index - (historyNext - i) << ' ';
+        Print(out, history[i % history.size()].actual);
+        out << '\n';
+    }
+}
+
+} // namespace RISCVS
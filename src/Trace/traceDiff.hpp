@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "trace.hpp"
+
+namespace RISCVS {
+
+// Source of reference records, read one by one
+class ReferenceTrace {
+public:
+    virtual ~ReferenceTrace() = default;
+
+    virtual bool Next(TraceRecord& record) = 0;
+};
+
+// spike --log-commits output:
+//   core   0: 3 0x80000000 (0x00000297) x5  0x80000000
+//   core   0: 3 0x80000004 (0x0002a023) mem 0x80001000 0x00000000
+// Lines that are not instruction commits are skipped.
+class SpikeLogReference : public ReferenceTrace {
+public:
+    explicit SpikeLogReference(std::string_view path);
+
+    bool Next(TraceRecord& record) override;
+
+private:
+    std::ifstream file;
+    std::string line;
+};
+
+class BinaryTraceReference : public ReferenceTrace {
+public:
+    explicit BinaryTraceReference(std::string_view path) : reader(path) {}
+
+    bool Next(TraceRecord& record) override {
+        return reader.Next(record);
+    }
+
+private:
+    TraceReader reader;
+};
+
+// Picks the reader by the file magic
+std::unique_ptr<ReferenceTrace> OpenReferenceTrace(std::string_view path);
+
+// Compares executed instructions with the reference one by one. Memory use
+// is bounded by the history size whatever the trace length is.
+class TraceDiffer {
+public:
+    TraceDiffer(std::unique_ptr<ReferenceTrace> reference, size_t historySize);
+
+    // Returns false on the first divergence
+    bool Check(const TraceRecord& actual);
+
+    // Reports the executed instructions the reference has and we do not
+    bool Finish();
+
+    void Report(std::ostream& out) const;
+
+    bool Diverged() const {
+        return diverged;
+    }
+
+private:
+    struct Entry {
+        TraceRecord expected;
+        TraceRecord actual;
+    };
+
+    void Remember(const TraceRecord& expected, const TraceRecord& actual);
+
+    std::unique_ptr<ReferenceTrace> reference;
+    bool synchronized = false;
+    bool diverged = false;
+    bool referenceEnded = false;
+    bool executionEnded = false;
+    uint64_t index = 0;
+
+    std::vector<Entry> history;
+    size_t historyNext = 0;
+    Entry divergence;
+};
+
+} // namespace RISCVS
@@ -1,6 +1,7 @@
 #include "instruction.hpp"
 #include <hart.hpp>
 #include <ios>
+#include <atomic>
 
 namespace RISCVS::InstructionSet {
 
@@ -12,15 +13,11 @@ using UImmediate = std::make_unsigned_t<Immediate>;
 
 using RegIdx = Hart::RegisterIndex;
 
-#define D(name, p1, p2, p3) std::cout /* << std::hex << hart.GetPC()  << ' ' */ <<  #name <<  std::dec << '\n';
-#define D(name, p1, p2, p3) 
-
 bool Add(FUNC_SIGNATURE) {
     RegIdx rd = std::get<RegIdx>(param1);
     RegIdx rs1 = std::get<RegIdx>(param2);
     RegIdx rs2 = std::get<RegIdx>(param3);
     hart[rd] = hart[rs1] + hart[rs2];
-    D(add, rd, rs1, rs2);
     return true;
 }
 
@@ -29,7 +26,6 @@ bool Sub(FUNC_SIGNATURE) {
     RegIdx rs1 = std::get<RegIdx>(param2);
     RegIdx rs2 = std::get<RegIdx>(param3);
     hart[rd] = hart[rs1] - hart[rs2];
-    D(sub, rd, rs1, rs2);
     return true;
 }
 
@@ -38,7 +34,6 @@ bool Xor(FUNC_SIGNATURE) {
     RegIdx rs1 = std::get<RegIdx>(param2);
     RegIdx rs2 = std::get<RegIdx>(param3);
     hart[rd] = hart[rs1] ^ hart[rs2];
-    D(xor, rd, rs1, rs2);
     return true;
 }
 
@@ -47,7 +42,6 @@ bool Or(FUNC_SIGNATURE) {
     RegIdx rs1 = std::get<RegIdx>(param2);
     RegIdx rs2 = std::get<RegIdx>(param3);
     hart[rd] = hart[rs1] | hart[rs2];
-    D(or, rd, rs1, rs2);
     return true;
 }
 
@@ -56,7 +50,6 @@ bool And(FUNC_SIGNATURE) {
     RegIdx rs1 = std::get<RegIdx>(param2);
     RegIdx rs2 = std::get<RegIdx>(param3);
     hart[rd] = hart[rs1] & hart[rs2];
-    D(and, rd, rs1, rs2);
     return true;
 }
 
@@ -65,7 +58,6 @@ bool Sll(FUNC_SIGNATURE) {
     RegIdx rs1 = std::get<RegIdx>(param2);
     RegIdx rs2 = std::get<RegIdx>(param3);
     hart[rd] = hart[rs1] << hart[rs2];
-    D(sll, rd, rs1, rs2);
     return true;
 }
 
@@ -74,7 +66,6 @@ bool Srl(FUNC_SIGNATURE) {
     RegIdx rs1 = std::get<RegIdx>(param2);
     RegIdx rs2 = std::get<RegIdx>(param3);
     hart[rd] = hart[rs1] >> hart[rs2];
-    D(srl, rd, rs1, rs2);
     return true;
 }
 
@@ -83,7 +74,6 @@ bool Sra(FUNC_SIGNATURE) {
     RegIdx rs1 = std::get<RegIdx>(param2);
     RegIdx rs2 = std::get<RegIdx>(param3);
     hart[rd] = static_cast<SRegister>(hart[rs1]) >> hart[rs2];
-    D(sra, rd, rs1, rs2);
     return true;
 }
 
@@ -92,7 +82,6 @@ bool Slt(FUNC_SIGNATURE) {
     RegIdx rs1 = std::get<RegIdx>(param2);
     RegIdx rs2 = std::get<RegIdx>(param3);
     hart[rd] = (static_cast<SRegister>(hart[rs1]) < static_cast<SRegister>(hart[rs2])) ? 1 : 0;
-    D(slt, rd, rs1, rs2);
     return true;
 }
 
@@ -101,7 +90,6 @@ bool Sltu(FUNC_SIGNATURE) {
     RegIdx rs1 = std::get<RegIdx>(param2);
     RegIdx rs2 = std::get<RegIdx>(param3);
     hart[rd] = (static_cast<URegister>(hart[rs1]) < static_cast<URegister>(hart[rs2])) ? 1 : 0;
-    D(sltu, rd, rs1, rs2);
     return true;
 }
 
@@ -110,7 +98,6 @@ bool AddI(FUNC_SIGNATURE) {
     RegIdx rs1 = std::get<RegIdx>(param2);
     Immediate imm = std::get<Immediate>(param3);
     hart[rd] = hart[rs1] + imm;
-    D(addi, rd, rs1, rs2);
     return true;
 }
 
@@ -119,7 +106,6 @@ bool XorI(FUNC_SIGNATURE) {
     RegIdx rs1 = std::get<RegIdx>(param2);
     Immediate imm = std::get<Immediate>(param3);
     hart[rd] = hart[rs1] ^ imm;
-    D(xori, rd, rs1, rs2);
     return true;
 }
 
@@ -128,7 +114,6 @@ bool OrI(FUNC_SIGNATURE) {
     RegIdx rs1 = std::get<RegIdx>(param2);
     Immediate imm = std::get<Immediate>(param3);
     hart[rd] = hart[rs1] | imm;
-    D(ori, rd, rs1, rs2);
     return true;
 }
 
@@ -137,7 +122,6 @@ bool AndI(FUNC_SIGNATURE) {
     RegIdx rs1 = std::get<RegIdx>(param2);
     Immediate imm = std::get<Immediate>(param3);
     hart[rd] = hart[rs1] & imm;
-    D(andi, rd, rs1, rs2);
     return true;
 }
 
@@ -146,7 +130,6 @@ bool SllI(FUNC_SIGNATURE) {
     RegIdx rs1 = std::get<RegIdx>(param2);
     Immediate imm = std::get<Immediate>(param3);
     hart[rd] = hart[rs1] << (imm & 0b11111U);
-    D(slli, rd, rs1, rs2);
     return true;
 }
 
@@ -155,7 +138,6 @@ bool SrlI(FUNC_SIGNATURE) {
     RegIdx rs1 = std::get<RegIdx>(param2);
     Immediate imm = std::get<Immediate>(param3);
     hart[rd] = hart[rs1] >> (imm & 0b11111U);
-    D(srli, rd, rs1, rs2);
     return true;
 }
 
@@ -164,7 +146,6 @@ bool SraI(FUNC_SIGNATURE) {
     RegIdx rs1 = std::get<RegIdx>(param2);
     Immediate imm = std::get<Immediate>(param3);
     hart[rd] = static_cast<SRegister>(hart[rs1]) >> (imm & 0b11111U);
-    D(srai, rd, rs1, rs2);
     return true;
 }
 
@@ -173,7 +154,6 @@ bool SltI(FUNC_SIGNATURE) {
     RegIdx rs1 = std::get<RegIdx>(param2);
     Immediate imm = std::get<Immediate>(param3);
     hart[rd] = (static_cast<SRegister>(hart[rs1]) < static_cast<SImmediate>(imm)) ? 1 : 0;
-    D(slti, rd, rs1, rs2);
     return true;
 }
 
@@ -182,7 +162,6 @@ bool SltIU(FUNC_SIGNATURE) {
     RegIdx rs1 = std::get<RegIdx>(param2);
     Immediate imm = std::get<Immediate>(param3);
     hart[rd] = (static_cast<URegister>(hart[rs1]) < static_cast<UImmediate>(imm)) ? 1 : 0;
-    D(sltiu, rd, rs1, rs2);
     return true;
 }
 
@@ -191,7 +170,6 @@ bool Lb(FUNC_SIGNATURE) {
     RegIdx rs1 = std::get<RegIdx>(param2);
     Immediate imm = std::get<Immediate>(param3);
     hart[rd] = hart.Load(hart[rs1] + imm);
-    D(lb, rd, rs1, rs2);
     return true;
 }
 
@@ -200,7 +178,6 @@ bool Lh(FUNC_SIGNATURE) {
     RegIdx rs1 = std::get<RegIdx>(param2);
     Immediate imm = std::get<Immediate>(param3);
     hart[rd] = hart.Load(hart[rs1] + imm); //FUCK: replace with bitwise bit setting: only lower part
-    D(lh, rd, rs1, rs2);
     return true;
 }
 
@@ -209,7 +186,6 @@ bool Lw(FUNC_SIGNATURE) {
     RegIdx rs1 = std::get<RegIdx>(param2);
     Immediate imm = std::get<Immediate>(param3);
     hart[rd] = hart.Load(hart[rs1] + imm);
-    D(lw, rd, rs1, rs2);
     return true;
 }
 
@@ -218,7 +194,6 @@ bool Lbu(FUNC_SIGNATURE) {
     RegIdx rs1 = std::get<RegIdx>(param2);
     Immediate imm = std::get<Immediate>(param3);
     hart[rd] = hart.Load(hart[rs1] + imm);
-    D(lbu, rd, rs1, rs2);
     return true;
 }
 
@@ -227,7 +202,6 @@ bool Lhu(FUNC_SIGNATURE) {
     RegIdx rs1 = std::get<RegIdx>(param2);
     Immediate imm = std::get<Immediate>(param3);
     hart[rd] = hart.Load(hart[rs1] + imm);
-    D(lhu, rd, rs1, rs2);
     return true;
 }
 
@@ -236,7 +210,6 @@ bool Sb(FUNC_SIGNATURE) {
     RegIdx rs2 = std::get<RegIdx>(param2);
     Immediate imm = std::get<Immediate>(param3);
     hart.Store<Byte>(hart[rs1] + imm, (hart[rs2] & ((1 << (8*sizeof(Byte))) - 1)));
-    D(sb, rd, rs1, rs2);
     return true;
 }
 
@@ -245,7 +218,6 @@ bool Sh(FUNC_SIGNATURE) {
     RegIdx rs2 = std::get<RegIdx>(param2);
     Immediate imm = std::get<Immediate>(param3);
     hart.Store<Half>(hart[rs1] + imm, (hart[rs2] & ((1 << (8*sizeof(Half))) - 1)));
-    D(sh, rd, rs1, rs2);
     return true;
 }
 
@@ -254,7 +226,6 @@ bool Sw(FUNC_SIGNATURE) {
     RegIdx rs2 = std::get<RegIdx>(param2);
     Immediate imm = std::get<Immediate>(param3);
     hart.Store<Word>(hart[rs1] + imm, hart[rs2]);
-    D(sw, rd, rs1, rs2);
     return true;
 }
 
@@ -262,7 +233,6 @@ bool Beq(FUNC_SIGNATURE) {
     RegIdx rs1 = std::get<RegIdx>(param1);
     RegIdx rs2 = std::get<RegIdx>(param2);
     Immediate imm = std::get<Immediate>(param3);
-    D(beq, rd, rs1, rs2);
     if (hart[rs1] == hart[rs2]) {
         hart.MovePC(imm);
         return false;
@@ -274,7 +244,6 @@ bool Bne(FUNC_SIGNATURE) {
     RegIdx rs1 = std::get<RegIdx>(param1);
     RegIdx rs2 = std::get<RegIdx>(param2);
     Immediate imm = std::get<Immediate>(param3);
-    D(bne, rd, rs1, rs2);
     if (hart[rs1] != hart[rs2]) {
         hart.MovePC(imm);
         return false;
@@ -286,7 +255,6 @@ bool Blt(FUNC_SIGNATURE) {
     RegIdx rs1 = std::get<RegIdx>(param1);
     RegIdx rs2 = std::get<RegIdx>(param2);
     Immediate imm = std::get<Immediate>(param3);
-    D(blt, rd, rs1, rs2);
     if (static_cast<SRegister>(hart[rs1]) < static_cast<SRegister>(hart[rs2])) {
         hart.MovePC(imm);
         return false;
@@ -298,7 +266,6 @@ bool Bge(FUNC_SIGNATURE) {
     RegIdx rs1 = std::get<RegIdx>(param1);
     RegIdx rs2 = std::get<RegIdx>(param2);
     Immediate imm = std::get<Immediate>(param3);
-    D(bge, rd, rs1, rs2);
     if (static_cast<SRegister>(hart[rs1]) >= static_cast<SRegister>(hart[rs2])) {
         hart.MovePC(imm);
         return false;
@@ -310,7 +277,6 @@ bool BltU(FUNC_SIGNATURE) {
     RegIdx rs1 = std::get<RegIdx>(param1);
     RegIdx rs2 = std::get<RegIdx>(param2);
     Immediate imm = std::get<Immediate>(param3);
-    D(bltu, rd, rs1, rs2);
     if (hart[rs1] < hart[rs2]) {
         hart.MovePC(imm);
         return false;
@@ -322,7 +288,6 @@ bool BgeU(FUNC_SIGNATURE) {
     RegIdx rs1 = std::get<RegIdx>(param1);
     RegIdx rs2 = std::get<RegIdx>(param2);
     Immediate imm = std::get<Immediate>(param3);
-    D(bgeu, rd, rs1, rs2);
     if (hart[rs1] >= hart[rs2]) {
         hart.MovePC(imm);
         return false;
@@ -334,7 +299,6 @@ bool Jal(FUNC_SIGNATURE) {
     RegIdx rd = std::get<RegIdx>(param1);
     Immediate imm = std::get<Immediate>(param2);
     hart[rd] = hart.GetPC() + 4;
-    D(jal, rd, rs1, rs2);
     if (imm == 0) {
         return true;    
     }
@@ -346,9 +310,10 @@ bool Jalr(FUNC_SIGNATURE) {
     RegIdx rd = std::get<RegIdx>(param1);
     RegIdx rs1 = std::get<RegIdx>(param2);
     Immediate imm = std::get<Immediate>(param3);
-    D(jalr, rd, rs1, rs2);
+    // rd may alias rs1 (e.g. auipc ra + jalr ra, ra), read the target first
+    const int32_t target = (hart[rs1] + imm) & ~1;
     hart[rd] = hart.GetPC() + 4;
-    hart.SetPC(hart[rs1] + imm);
+    hart.SetPC(target);
     // std::cout << hart[rs1] << ' ' << imm << '\n';
     // std::cout << hart.GetPC() << '\n';
     return false;
@@ -358,7 +323,6 @@ bool Lui(FUNC_SIGNATURE) {
     RegIdx rd = std::get<RegIdx>(param1);
     Immediate imm = std::get<Immediate>(param2);
     hart[rd] = imm << 12;
-    D(lui, rd, rs1, rs2);
     return true;
 }
 
@@ -366,7 +330,6 @@ bool AuiPC(FUNC_SIGNATURE) {
     RegIdx rd = std::get<RegIdx>(param1);
     Immediate imm = std::get<Immediate>(param2);
     hart[rd] = hart.GetPC() + (imm << 12);
-    D(auipc, rd, rs1, rs2);
     return true;
 }
 
@@ -374,7 +337,11 @@ bool AuiPC(FUNC_SIGNATURE) {
 #include <sys/syscall.h>
 
 bool ECall(FUNC_SIGNATURE) {
-    D(ecall, rd, rs1, rs2);
+    hart.CountSyscall();
+    if (hart.HandleSyscall()) {
+        return true;
+    }
+
     if (hart[17] == 93) {
         hart.Stop();
     }
@@ -385,9 +352,77 @@ bool ECall(FUNC_SIGNATURE) {
 }
 
 bool EBreak(FUNC_SIGNATURE) {
-    D(ebreak, rd, rs1, rs2);
-    hart.Stop();
+    hart.Stop(StopReason::BREAKPOINT);
     return false;
 }
 
-}
\ No newline at end of file
+bool Wfi(FUNC_SIGNATURE) {
+    hart.WaitForInterrupt();
+    return true;
+}
+
+bool LrW(FUNC_SIGNATURE) {
+    RegIdx rd = std::get<RegIdx>(param1);
+    RegIdx rs1 = std::get<RegIdx>(param2);
+    hart[rd] = hart.LoadReserved(hart[rs1]);
+    return true;
+}
+
+bool ScW(FUNC_SIGNATURE) {
+    RegIdx rd = std::get<RegIdx>(param1);
+    RegIdx rs1 = std::get<RegIdx>(param2);
+    RegIdx rs2 = std::get<RegIdx>(param3);
+    hart[rd] = hart.StoreConditional(hart[rs1], hart[rs2]) ? 0 : 1;
+    return true;
+}
+
+#define AMO(Instr, Op)                                              \
+bool Instr(FUNC_SIGNATURE) {                                        \
+    RegIdx rd = std::get<RegIdx>(param1);                           \
+    RegIdx rs1 = std::get<RegIdx>(param2);                          \
+    RegIdx rs2 = std::get<RegIdx>(param3);                          \
+    hart[rd] = hart.Amo(hart[rs1], Machine::AmoOp::Op, hart[rs2]);  \
+    return true;                                                    \
+}
+
+AMO(AmoSwapW, SWAP)
+AMO(AmoAddW, ADD)
+AMO(AmoXorW, XOR)
+AMO(AmoAndW, AND)
+AMO(AmoOrW, OR)
+AMO(AmoMinW, MIN)
+AMO(AmoMaxW, MAX)
+AMO(AmoMinUW, MINU)
+AMO(AmoMaxUW, MAXU)
+
+#undef AMO
+
+bool CsrRs(FUNC_SIGNATURE) {
+    constexpr uint32_t MHARTID = 0xF14;
+
+    RegIdx rd = std::get<RegIdx>(param1);
+    RegIdx rs1 = std::get<RegIdx>(param2);
+    uint32_t csr = std::get<uint32_t>(param3);
+    if (csr != MHARTID) {
+        throw "unsupported CSR\n";
+    }
+    if (rs1 != 0) {
+        throw "write to a read-only CSR\n";
+    }
+    hart[rd] = hart.GetHartId();
+    return true;
+}
+
+// Guest accesses are relaxed atomics (see Machine), a full host fence
+// covers any pred/succ combination
+bool Fence(FUNC_SIGNATURE) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return true;
+}
+
+// Decoded instructions are keyed by the instruction word, nothing to flush
+bool FenceI(FUNC_SIGNATURE) {
+    return true;
+}
+
+}
@@ -89,6 +89,24 @@ bool AuiPC(FUNC_SIGNATURE);
 
 bool ECall(FUNC_SIGNATURE);
 bool EBreak(FUNC_SIGNATURE);
+bool Wfi(FUNC_SIGNATURE);
+
+bool LrW(FUNC_SIGNATURE);
+bool ScW(FUNC_SIGNATURE);
+bool AmoSwapW(FUNC_SIGNATURE);
+bool AmoAddW(FUNC_SIGNATURE);
+bool AmoXorW(FUNC_SIGNATURE);
+bool AmoAndW(FUNC_SIGNATURE);
+bool AmoOrW(FUNC_SIGNATURE);
+bool AmoMinW(FUNC_SIGNATURE);
+bool AmoMaxW(FUNC_SIGNATURE);
+bool AmoMinUW(FUNC_SIGNATURE);
+bool AmoMaxUW(FUNC_SIGNATURE);
+
+bool CsrRs(FUNC_SIGNATURE);
+
+bool Fence(FUNC_SIGNATURE);
+bool FenceI(FUNC_SIGNATURE);
 
 }
 
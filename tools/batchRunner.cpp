@@ -0,0 +1,71 @@
+// RISCV_Simulator_batch: runs a list of independent guest jobs for throughput
+//   RISCV_Simulator_batch <jobs.jsonl | -> [--output <results.jsonl>] [--threads <n>]
+//                         [--output-limit <bytes>] [--lanes <k>] [--no-pin]
+// Results go to stdout unless --output is given, the summary to stderr.
+
+#include <batch.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+int main(int argc, const char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <jobs.jsonl | -> [--output <results.jsonl>] [--threads <n>]"
+                  << " [--output-limit <bytes>] [--lanes <k>] [--no-pin]\n";
+        return 2;
+    }
+
+    const std::string_view jobsPath = argv[1];
+    std::string_view outputPath;
+    RISCVS::Batch::Options options{.threads = 0, .pin = true, .outputLimit = 4096};
+    for (int i = 2; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        if (arg == "--no-pin") {
+            options.pin = false;
+        } else if (i + 1 < argc && arg == "--output") {
+            outputPath = argv[++i];
+        } else if (i + 1 < argc && arg == "--threads") {
+            options.threads = std::stoul(argv[++i]);
+        } else if (i + 1 < argc && arg == "--output-limit") {
+            options.outputLimit = std::stoul(argv[++i]);
+        } else if (i + 1 < argc && arg == "--lanes") {
+            options.lanes = std::stoul(argv[++i]);
+        } else {
+            std::cerr << "Unknown argument " << arg << '\n';
+            return 2;
+        }
+    }
+
+    try {
+        std::vector<RISCVS::BatchJob> jobs;
+        if (jobsPath == "-") {
+            jobs = RISCVS::ReadJobs(std::cin);
+        } else {
+            std::ifstream file{std::string(jobsPath)};
+            if (!file) {
+                std::cerr << "Cannot open " << jobsPath << '\n';
+                return 2;
+            }
+            jobs = RISCVS::ReadJobs(file);
+        }
+
+        std::ofstream outputFile;
+        if (!outputPath.empty()) {
+            outputFile.open(std::string(outputPath));
+            if (!outputFile) {
+                std::cerr << "Cannot create " << outputPath << '\n';
+                return 2;
+            }
+        }
+
+        RISCVS::Batch batch{std::move(jobs), options};
+        const RISCVS::Batch::Summary summary = batch.Run(outputPath.empty() ? std::cout : outputFile);
+        RISCVS::Batch::Report(std::cerr, summary);
+        return summary.failed == 0 ? 0 : 1;
+    } catch (const std::exception& exception) {
+        std::cerr << exception.what() << '\n';
+        return 2;
+    }
+}
@@ -0,0 +1,94 @@
+// RISCV_Simulator_stats: prints the live statistics of a running simulator
+//   RISCV_Simulator_stats <name> [--watch <milliseconds>]
+
+#include <statsPage.hpp>
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+void Print(const RISCVS::StatsPage& page, const RISCVS::StatsSnapshot& snapshot) {
+    const auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    const double age = snapshot.updateTime == 0 ? 0.0 : (now - static_cast<int64_t>(snapshot.updateTime)) / 1e6;
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "++++++++LIVE_STATS++++++++\n";
+    // A killed simulator leaves its file behind
+    const bool alive = kill(static_cast<pid_t>(page.pid), 0) == 0 || errno != ESRCH;
+    std::cout << "pid: " << page.pid << (snapshot.finished ? " (finished)" : alive ? " (running)" : " (dead)") << '\n';
+    std::cout << "Instructions: " << snapshot.instructions << '\n';
+    std::cout << "pc: 0x" << std::hex << snapshot.pc << std::dec << '\n';
+    std::cout << "MIPS (last second): " << snapshot.instructionsPerSecond / 1e6 << '\n';
+    std::cout << "Syscalls: " << snapshot.syscalls << '\n';
+    if (snapshot.decodeLookups == 0) {
+        std::cout << "Decode cache hit rate: n/a\n";
+    } else {
+        std::cout << "Decode cache hit rate: " << 100.0 * snapshot.decodeHits / snapshot.decodeLookups << "%\n";
+    }
+    std::cout << "Touched pages: " << snapshot.touchedPages << '\n';
+    std::cout << "Updated: " << age << " milliseconds ago\n";
+    std::cout << "++++++++++++++++++++++++++" << std::endl;
+}
+
+} // anon namespace
+
+int main(int argc, const char* argv[]) {
+    using namespace RISCVS;
+
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <name> [--watch <milliseconds>]\n";
+        return 2;
+    }
+
+    int watchMilliseconds = 0;
+    for (int i = 2; i + 1 < argc; ++i) {
+        if (std::string_view(argv[i]) == "--watch") {
+            watchMilliseconds = std::stoi(std::string(argv[i + 1]));
+        }
+    }
+
+    const std::string path = StatsPath(argv[1]);
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat status{};
+    if (fd < 0 || fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(StatsPage))) {
+        std::cerr << "No live stats at " << path << '\n';
+        return 1;
+    }
+
+    void* mapping = mmap(nullptr, sizeof(StatsPage), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Failed to map " << path << '\n';
+        return 1;
+    }
+    auto* page = static_cast<StatsPage*>(mapping);
+
+    if (std::memcmp(page->magic, StatsPage::MAGIC, sizeof(page->magic)) != 0 || page->version != StatsPage::VERSION) {
+        std::cerr << path << " is not a version " << StatsPage::VERSION << " stats file\n";
+        return 1;
+    }
+
+    while (true) {
+        const StatsSnapshot snapshot = page->Read();
+        Print(*page, snapshot);
+        if (watchMilliseconds <= 0 || snapshot.finished ||
+            (kill(static_cast<pid_t>(page->pid), 0) != 0 && errno == ESRCH)) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds{watchMilliseconds});
+    }
+
+    munmap(mapping, sizeof(StatsPage));
+}